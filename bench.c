@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define CRENA_IMPLEMENTATION
+#include "crena.h"
+
+// crena vs glibc malloc microbenchmarks.
+// Every test reports ns per operation and how much RSS it left behind
+// before cleaning up. Pass "quick" to run with smaller counts.
+
+#define BENCH_MAX_THREADS 8
+
+static size_t bench_scale = 1;
+static volatile size_t bench_sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Signed so that deltas can go negative when the allocator returns memory
+static long rss_kb(void) {
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (!f) return 0;
+  size_t size = 0, resident = 0;
+  if (fscanf(f, "%zu %zu", &size, &resident) != 2) resident = 0;
+  fclose(f);
+  return (long)resident * (getpagesize() / 1024);
+}
+
+typedef struct {
+  char const* name;
+  size_t size;
+  size_t count;
+  size_t threads;
+  double ns;
+  size_t ops;
+  long rss_kb;
+} bench_result;
+
+static void report(bench_result r) {
+  printf("%-28s %7zu %9zu %4zu %10.2f %10ld\n",
+         r.name, r.size, r.count, r.threads, r.ns / r.ops, r.rss_kb);
+}
+
+static void touch(void* p, size_t size) {
+  // Write the first and last byte like a real user would
+  ((char*)p)[0] = 1;
+  ((char*)p)[size - 1] = 1;
+}
+
+static void bench_alloc(size_t size, size_t count) {
+  void** ptrs = malloc(sizeof(void*) * count);
+
+  long rss0 = rss_kb();
+  double t0 = now_ns();
+  for (size_t i = 0; i < count; i ++) {
+    ptrs[i] = malloc(size);
+    touch(ptrs[i], size);
+  }
+  double t1 = now_ns();
+  long rss1 = rss_kb();
+  for (size_t i = 0; i < count; i ++) free(ptrs[i]);
+  double t2 = now_ns();
+  report((bench_result){"malloc", size, count, 1, t1 - t0, count, rss1 - rss0});
+  report((bench_result){"malloc+free", size, count, 1, t2 - t0, count, rss1 - rss0});
+
+  crena_arena arena = crena_init_growing();
+  rss0 = rss_kb();
+  t0 = now_ns();
+  for (size_t i = 0; i < count; i ++) {
+    ptrs[i] = crena_alloc(&arena, size);
+    touch(ptrs[i], size);
+  }
+  t1 = now_ns();
+  rss1 = rss_kb();
+  crena_free(&arena, CRENA_FT_HOT_READY);
+  t2 = now_ns();
+  report((bench_result){"crena_alloc", size, count, 1, t1 - t0, count, rss1 - rss0});
+  report((bench_result){"crena_alloc+free", size, count, 1, t2 - t0, count, rss1 - rss0});
+
+  // Second round on the now warm arena
+  t0 = now_ns();
+  for (size_t i = 0; i < count; i ++) {
+    ptrs[i] = crena_alloc(&arena, size);
+    touch(ptrs[i], size);
+  }
+  t1 = now_ns();
+  report((bench_result){"crena_alloc (hot)", size, count, 1, t1 - t0, count, 0});
+  crena_free(&arena, CRENA_FT_ALL);
+
+  free(ptrs);
+}
+
+static void bench_realloc(size_t step, size_t count) {
+  long rss0 = rss_kb();
+  double t0 = now_ns();
+  char* buf = NULL;
+  for (size_t i = 1; i <= count; i ++) {
+    buf = realloc(buf, i * step);
+    buf[i * step - 1] = 1;
+  }
+  double t1 = now_ns();
+  report((bench_result){"realloc grow", step, count, 1, t1 - t0, count, rss_kb() - rss0});
+  free(buf);
+
+  // Alone on the arena, so every grow is in place
+  crena_arena arena = crena_init_growing();
+  rss0 = rss_kb();
+  t0 = now_ns();
+  buf = crena_alloc(&arena, step);
+  for (size_t i = 2; i <= count; i ++) {
+    buf = crena_realloc(&arena, buf, (i - 1) * step, i * step);
+    buf[i * step - 1] = 1;
+  }
+  t1 = now_ns();
+  report((bench_result){"crena_realloc in place", step, count, 1, t1 - t0, count, rss_kb() - rss0});
+  crena_free(&arena, CRENA_FT_ALL);
+
+  // Something else allocated after every grow, so every grow copies.
+  // Quadratic, so keep it to a fraction of the count.
+  size_t ccount = count / 16;
+  arena = crena_init_growing();
+  rss0 = rss_kb();
+  t0 = now_ns();
+  buf = crena_alloc(&arena, step);
+  for (size_t i = 2; i <= ccount; i ++) {
+    buf = crena_realloc(&arena, buf, (i - 1) * step, i * step);
+    buf[i * step - 1] = 1;
+    crena_alloc(&arena, 8);
+  }
+  t1 = now_ns();
+  report((bench_result){"crena_realloc copying", step, ccount, 1, t1 - t0, ccount, rss_kb() - rss0});
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+static void bench_da(size_t count) {
+  long rss0 = rss_kb();
+  double t0 = now_ns();
+  size_t* vec = NULL;
+  size_t len = 0, cap = 0;
+  for (size_t i = 0; i < count; i ++) {
+    if (len == cap) {
+      cap = cap ? cap * 2 : 20;
+      vec = realloc(vec, cap * sizeof(*vec));
+    }
+    vec[len++] = i;
+  }
+  double t1 = now_ns();
+  report((bench_result){"malloc vector push", sizeof(size_t), count, 1, t1 - t0, count, rss_kb() - rss0});
+  free(vec);
+
+  crena_arena arena = crena_init_growing();
+  size_t* da;
+  crena_da_init(da, &arena);
+  rss0 = rss_kb();
+  t0 = now_ns();
+  for (size_t i = 0; i < count; i ++) crena_da_push(da, i);
+  t1 = now_ns();
+  report((bench_result){"crena_da_push", sizeof(size_t), count, 1, t1 - t0, count, rss_kb() - rss0});
+
+  size_t sum = 0;
+  t0 = now_ns();
+  for (size_t i = 0; i < count / 2; i ++) sum += crena_da_pop(da);
+  t1 = now_ns();
+  report((bench_result){"crena_da_pop", sizeof(size_t), count / 2, 1, t1 - t0, count / 2, 0});
+
+  t0 = now_ns();
+  sum += crena_da_compress(da);
+  t1 = now_ns();
+  report((bench_result){"crena_da_compress", sizeof(size_t), count / 2, 1, t1 - t0, 1, 0});
+  bench_sink = sum;
+  crena_free(&arena, CRENA_FT_ALL);
+
+  // Two arrays growing interleaved: every grow of either one copies
+  arena = crena_init_growing();
+  size_t* a;
+  size_t* b;
+  crena_da_init(a, &arena);
+  crena_da_init(b, &arena);
+  rss0 = rss_kb();
+  t0 = now_ns();
+  for (size_t i = 0; i < count / 2; i ++) {
+    crena_da_push(a, i);
+    crena_da_push(b, i);
+  }
+  t1 = now_ns();
+  report((bench_result){"crena_da_push interleaved", sizeof(size_t), count, 1, t1 - t0, count, rss_kb() - rss0});
+  crena_free(&arena, CRENA_FT_ALL);
+
+  arena = crena_init_growing();
+  crena_sda(size_t) sa;
+  crena_sda(size_t) sb;
+  crena_sda_init(sa, &arena);
+  crena_sda_init(sb, &arena);
+  rss0 = rss_kb();
+  t0 = now_ns();
+  for (size_t i = 0; i < count / 2; i ++) {
+    crena_sda_push(sa, i);
+    crena_sda_push(sb, i);
+  }
+  t1 = now_ns();
+  report((bench_result){"crena_sda_push interleaved", sizeof(size_t), count, 1, t1 - t0, count, rss_kb() - rss0});
+
+  sum = 0;
+  t0 = now_ns();
+  for (size_t i = 0; i < count / 2; i ++) sum += crena_sda_at(sa, i);
+  t1 = now_ns();
+  report((bench_result){"crena_sda_at", sizeof(size_t), count / 2, 1, t1 - t0, count / 2, 0});
+  bench_sink = sum;
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+static void bench_pool(size_t size, size_t count) {
+  // Steady state churn: keep a window of live objects, free the oldest
+  size_t window = 1024;
+  void** live = calloc(window, sizeof(void*));
+
+  double t0 = now_ns();
+  for (size_t i = 0; i < count; i ++) {
+    free(live[i % window]);
+    live[i % window] = malloc(size);
+    touch(live[i % window], size);
+  }
+  double t1 = now_ns();
+  report((bench_result){"malloc/free churn", size, count, 1, t1 - t0, count, 0});
+  for (size_t i = 0; i < window; i ++) free(live[i]);
+  memset(live, 0, window * sizeof(void*));
+
+  crena_arena arena = crena_init_growing();
+  crena_pool pool = crena_pool_init(&arena);
+  t0 = now_ns();
+  for (size_t i = 0; i < count; i ++) {
+    crena_pool_free(&pool, live[i % window], size);
+    live[i % window] = crena_pool_alloc(&pool, size);
+    touch(live[i % window], size);
+  }
+  t1 = now_ns();
+  report((bench_result){"crena_pool churn", size, count, 1, t1 - t0, count, 0});
+  crena_free(&arena, CRENA_FT_ALL);
+  free(live);
+}
+
+typedef enum {
+  BENCH_MT_MALLOC,
+  BENCH_MT_PRIVATE_ARENA,
+  BENCH_MT_SHARED_ARENA,
+  BENCH_MT_POOL_CACHE,
+} bench_mt_kind;
+
+typedef struct {
+  bench_mt_kind kind;
+  size_t size;
+  size_t count;
+  crena_arena* shared;
+  crena_pool* pool;
+  pthread_barrier_t* start;
+} bench_mt_args;
+
+static void* bench_mt_worker(void* arg) {
+  bench_mt_args* a = arg;
+  pthread_barrier_wait(a->start);
+
+  switch (a->kind) {
+  case BENCH_MT_MALLOC: {
+    void** ptrs = malloc(sizeof(void*) * a->count);
+    for (size_t i = 0; i < a->count; i ++) {
+      ptrs[i] = malloc(a->size);
+      touch(ptrs[i], a->size);
+    }
+    for (size_t i = 0; i < a->count; i ++) free(ptrs[i]);
+    free(ptrs);
+  } break;
+  case BENCH_MT_PRIVATE_ARENA: {
+    crena_arena arena = crena_init_growing();
+    for (size_t i = 0; i < a->count; i ++) touch(crena_alloc(&arena, a->size), a->size);
+    crena_free(&arena, CRENA_FT_ALL);
+  } break;
+  case BENCH_MT_SHARED_ARENA: {
+    for (size_t i = 0; i < a->count; i ++) touch(crena_alloc(a->shared, a->size), a->size);
+  } break;
+  case BENCH_MT_POOL_CACHE: {
+    crena_pool_cache cache = crena_pool_cache_init(a->pool);
+    void* window[64] = {0};
+    for (size_t i = 0; i < a->count; i ++) {
+      crena_pool_cache_free(&cache, window[i % 64], a->size);
+      window[i % 64] = crena_pool_cache_alloc(&cache, a->size);
+      touch(window[i % 64], a->size);
+    }
+    crena_pool_cache_flush(&cache);
+  } break;
+  }
+  return NULL;
+}
+
+static void bench_threads(bench_mt_kind kind, char const* name, size_t size, size_t count, size_t nthreads) {
+  pthread_t threads[BENCH_MAX_THREADS];
+  bench_mt_args args[BENCH_MAX_THREADS];
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, nthreads + 1);
+
+  crena_arena shared = crena_init_growing();
+  crena_set_concurrent(&shared, true);
+  crena_pool pool = crena_pool_init(&shared);
+
+  long rss0 = rss_kb();
+  for (size_t i = 0; i < nthreads; i ++) {
+    args[i] = (bench_mt_args){kind, size, count, &shared, &pool, &start};
+    pthread_create(&threads[i], NULL, bench_mt_worker, &args[i]);
+  }
+  double t0 = now_ns();
+  pthread_barrier_wait(&start);
+  for (size_t i = 0; i < nthreads; i ++) pthread_join(threads[i], NULL);
+  double t1 = now_ns();
+  report((bench_result){name, size, count, nthreads, t1 - t0, count * nthreads, rss_kb() - rss0});
+
+  crena_free(&shared, CRENA_FT_ALL);
+  pthread_barrier_destroy(&start);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "quick") == 0) bench_scale = 10;
+
+  size_t sizes[] = {16, 64, 256, 4096};
+  size_t counts[] = {10000, 1000000};
+  size_t nthreads[] = {1, 2, 4, 8};
+
+  printf("%-28s %7s %9s %4s %10s %10s\n", "test", "size", "count", "thr", "ns/op", "rss KiB");
+
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c ++) {
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s ++) {
+      size_t count = counts[c] / bench_scale;
+      // Don't map gigabytes for the big objects
+      if (sizes[s] * count > (KNOB_MMAP_SIZE / 4)) count = (KNOB_MMAP_SIZE / 4) / sizes[s];
+      bench_alloc(sizes[s], count);
+    }
+  }
+
+  bench_realloc(16, 100000 / bench_scale);
+  bench_realloc(256, 10000 / bench_scale);
+  bench_da(10000000 / bench_scale);
+
+  for (size_t s = 0; s < 3; s ++) {
+    bench_pool(sizes[s], 10000000 / bench_scale);
+  }
+
+  for (size_t t = 0; t < sizeof(nthreads) / sizeof(nthreads[0]); t ++) {
+    size_t count = 1000000 / bench_scale;
+    bench_threads(BENCH_MT_MALLOC, "threads malloc+free", 64, count, nthreads[t]);
+    bench_threads(BENCH_MT_PRIVATE_ARENA, "threads private arena", 64, count, nthreads[t]);
+    bench_threads(BENCH_MT_SHARED_ARENA, "threads shared arena", 64, count, nthreads[t]);
+    bench_threads(BENCH_MT_POOL_CACHE, "threads pool cache churn", 64, count, nthreads[t]);
+  }
+
+  return 0;
+}
@@ -6,12 +6,27 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 // https://github.com/olemorud/arena-allocator/tree/master
 // I am going to take inspiration from that API because it is excellent
 // TODO: add error checking
 #define KNOB_MMAP_SIZE (1UL << 30UL)
 #define KNOB_ALIGNMENT (sizeof(char*))
+#define KNOB_CACHE_LINE 64
+#define KNOB_CONCURRENT_COMMIT_PAGES 16
+#define KNOB_SDA_FIRST_SEGMENT 16
+#define KNOB_SDA_MAX_SEGMENTS 32
+#define KNOB_HM_MIN_CAPACITY 16
+#define KNOB_HM_MAX_LOAD_PCT 85
+#define KNOB_FILE_MAGIC 0x31414e455243ULL
+#define KNOB_POOL_CLASS_STEP 16
+#define KNOB_POOL_CLASSES 16
+#define KNOB_POOL_SLAB_SIZE 4096
+#define KNOB_POOL_CACHE_BATCH 32
 
 #ifdef CRENA_UT
 #define CRPF(...) printf(__VA_ARGS__)
@@ -19,89 +34,454 @@
 #define CRPF(...)
 #endif
 
+// Build with -DCRENA_STATS to get per-arena counters and a report at exit.
+// The counters live in a static table (not in the arena itself) so that
+// arenas can keep being passed around by value and still be reported
+// after the stack frame that owned them is gone. Arenas past
+// KNOB_STATS_MAX_ARENAS go untracked; the report says how many.
+#ifdef CRENA_STATS
+#include <stdio.h>
+#define KNOB_STATS_MAX_ARENAS 64
+#endif
+
 typedef enum flags {
   CRENA_ARENA_NOGROW = 1 << 0,
   CRENA_ARENA_NOALIGN = 1 << 1,
+  CRENA_ARENA_CONCURRENT = 1 << 2,
+  CRENA_ARENA_FILE = 1 << 3,
+  CRENA_ARENA_COW = 1 << 4,
 } crena_flags;
 
+#ifdef CRENA_STATS
+typedef struct {
+  char const* name;
+  size_t alloc_count;
+  size_t bytes_requested;
+  size_t bytes_allocated;
+  size_t align_waste;
+  size_t peak_loc;
+  size_t committed_pages;
+  size_t peak_committed_pages;
+  size_t realloc_count;
+  size_t realloc_in_place;
+  size_t realloc_copy_bytes;
+  size_t dealloc_bytes;
+  size_t free_count;
+} crena_stats;
+
+#define CRENA_STAT(arena, ...) do { if ((arena)->stats) { crena_stats* st = (arena)->stats; __VA_ARGS__; } } while (0)
+#define CRENA_STAT_ADD(arena, field, n) CRENA_STAT(arena, __atomic_fetch_add(&st->field, (n), __ATOMIC_RELAXED))
+#define CRENA_STAT_MAX(arena, field, v) CRENA_STAT(arena, _crena_stat_max(&st->field, (v)))
+#else
+#define CRENA_STAT(arena, ...) do { } while (0)
+#define CRENA_STAT_ADD(arena, field, n) do { } while (0)
+#define CRENA_STAT_MAX(arena, field, v) do { } while (0)
+#endif
+
 typedef struct _crena_arena {
   void *mem;
   size_t siz;
   size_t loc;
   crena_flags flags;
+  int grow_lock;
+  size_t retain;
+  size_t start;
+  int fd;
+  size_t snapshots;
+#ifdef CRENA_STATS
+  crena_stats* stats;
+#endif
 } crena_arena;
 
+// CRENA_FT_HOT_READY keeps every committed page resident for the next user.
+// CRENA_FT_DECOMMIT hands pages above the retain threshold back to the OS
+// right away, CRENA_FT_LAZY only marks them MADV_FREE so the kernel can
+// take them under memory pressure and they stay cheap to reuse otherwise.
 typedef enum {
   CRENA_FT_ALL,
-  CRENA_FT_HOT_READY
+  CRENA_FT_HOT_READY,
+  CRENA_FT_DECOMMIT,
+  CRENA_FT_LAZY
 } crena_free_type;
 
 crena_arena crena_init(void*mem, size_t size);
 crena_arena crena_init_growing();
 void *crena_alloc(crena_arena *arena, size_t size);
 void *crena_realloc(crena_arena *arena, void* mem, size_t oldsiz, size_t newsiz);
+void *crena_alloc_aligned(crena_arena *arena, size_t size, size_t align);
+void *crena_realloc_aligned(crena_arena *arena, void* mem, size_t oldsiz, size_t newsiz, size_t align);
 void crena_free(crena_arena *arena, crena_free_type free_type);
 void crena_dealloc(crena_arena *arena, size_t size);
 size_t crena_amount_free(crena_arena *arena);
 void crena_set_aligned(crena_arena* arena, bool aligned);
+void crena_set_concurrent(crena_arena* arena, bool concurrent);
+void crena_set_retain(crena_arena* arena, size_t bytes);
+bool crena_prefault(crena_arena* arena, size_t size);
+
+// File backed arenas.
+// The arena is a MAP_SHARED mapping of a file or memfd, so whatever is
+// allocated in it can be flushed with crena_sync and mapped back later,
+// by this or another process, at whatever address mmap hands out. The
+// first bytes of the file hold a small header with loc and a root offset
+// so the reopened arena continues where it left off. Anything stored in
+// it must not hold absolute pointers into the arena: use crena_off
+// (relative to the arena base) or crena_rel (relative to the field
+// itself) instead. On failure the returned arena has a NULL mem.
+typedef uint64_t crena_off;
+typedef int64_t crena_rel;
+
+crena_arena crena_init_fd(int fd);
+crena_arena crena_init_file(char const* path);
+crena_arena crena_init_memfd(char const* name);
+bool crena_sync(crena_arena* arena);
+void crena_set_root(crena_arena* arena, void* root);
+void* crena_get_root(crena_arena* arena);
+
+#define crena_off_of(arena, ptr) ((crena_off)((char*)(ptr) - (char*)(arena)->mem))
+#define crena_ptr_of(arena, off) ((void*)((char*)(arena)->mem + (off)))
 
+// Copy-on-write snapshots of file backed arenas (use a memfd for state
+// that doesn't need to outlive the process).
+// Taking a snapshot remaps the arena MAP_PRIVATE over its file, so the
+// file keeps the snapshot and every page written afterwards becomes a
+// private copy. Restoring maps the file over the arena again, which just
+// drops the private copies: the cost is proportional to the pages dirtied
+// since the snapshot, not to the arena size. Taking another snapshot writes
+// only the dirtied pages back to the file, found through /proc/self/pagemap.
+// Only the most recent snapshot can be restored, as often as needed. While
+// snapshotted, crena_sync takes a new snapshot.
+typedef struct {
+  size_t loc;
+  size_t gen;
+} crena_snapshot;
+
+crena_snapshot crena_snapshot_take(crena_arena* arena);
+bool crena_snapshot_restore(crena_arena* arena, crena_snapshot snap);
+
+static inline void crena_rel_set(crena_rel* field, void const* ptr) {
+  *field = ptr ? (char const*)ptr - (char const*)field : 0;
+}
+
+static inline void* crena_rel_get(crena_rel const* field) {
+  return *field ? (char*)field + *field : NULL;
+}
+
+#ifdef CRENA_STATS
+void crena_stats_name(crena_arena* arena, char const* name);
+void crena_stats_report(crena_arena* arena, FILE* out);
+void crena_stats_report_all(FILE* out);
+#else
+#define crena_stats_name(arena, name) ((void)(arena), (void)(name))
+#endif
+
+// The header always sits right before the elements. For over-aligned
+// arrays the block starts with padding so that the elements land on
+// `align`, and growth reallocates with the same alignment.
 typedef struct {
   size_t count;
   size_t capacity;
+  size_t esize;
+  size_t align;
   crena_arena* arena;
 } _crena_da_header;
 
-void* _crena_da_init(size_t esize, crena_arena* arena);
+void* _crena_da_init(size_t esize, crena_arena* arena, size_t align);
 void* _crena_da_grow(void* daptr, size_t size, size_t count);
 size_t _crena_da_compress(void* da);
 
 #define crena_da_header(da) ((_crena_da_header*)(da) - 1)
-#define crena_da_init(da, arena) (da) = _crena_da_init(sizeof(*da), arena);
+#define crena_da_init(da, arena) (da) = _crena_da_init(sizeof(*da), arena, KNOB_ALIGNMENT);
+#define crena_da_init_aligned(da, arena, align) (da) = _crena_da_init(sizeof(*da), arena, align);
 #define crena_da_push(da, itm) ((da) = _crena_da_grow(da, sizeof(*da), 1), (da)[crena_da_header(da)->count++] = (itm))
 #define crena_da_pop(da) (crena_da_header(da)->count--, (da)[crena_da_header(da)->count])
 #define crena_da_len(da) (crena_da_header(da)->count)
 #define crena_da_compress(da) _crena_da_compress(da)
+#define crena_da_reserve(da, n) ((da) = _crena_da_grow(da, sizeof(*da), n))
+#define crena_da_append_many(da, items, n) \
+  (crena_da_reserve(da, n), \
+   memcpy(&(da)[crena_da_header(da)->count], (items), sizeof(*da) * (n)), \
+   crena_da_header(da)->count += (n))
+
+// Segmented dynamic array.
+// Segment k holds KNOB_SDA_FIRST_SEGMENT << k elements, so growing never
+// moves what is already there: element addresses stay valid for the life
+// of the arena and nothing is copied. Indexing is a clz and a subtract.
+// Declare with `crena_sda(type) name;` and index with crena_sda_at.
+#define crena_sda(type) struct { \
+  size_t count; \
+  size_t capacity; \
+  size_t align; \
+  crena_arena* arena; \
+  type* seg[KNOB_SDA_MAX_SEGMENTS]; \
+}
+
+static inline size_t _crena_sda_seg(size_t i) {
+  return 63 - __builtin_clzll(i / KNOB_SDA_FIRST_SEGMENT + 1);
+}
+
+static inline size_t _crena_sda_off(size_t i) {
+  return i - KNOB_SDA_FIRST_SEGMENT * ((1ULL << _crena_sda_seg(i)) - 1);
+}
+
+bool _crena_sda_reserve(void** seg, size_t* capacity, crena_arena* arena, size_t esize, size_t align,
+                        size_t needed);
+void _crena_sda_append(void** seg, size_t* capacity, crena_arena* arena, size_t esize, size_t align,
+                       size_t* count, void const* items, size_t n);
+
+#define _crena_sda_args(sda) (void**)(sda).seg, &(sda).capacity, (sda).arena, sizeof(*(sda).seg[0]), (sda).align
+
+#define crena_sda_init(sda, arena_) crena_sda_init_aligned(sda, arena_, KNOB_ALIGNMENT)
+#define crena_sda_init_aligned(sda, arena_, align_) \
+  ((sda).count = 0, (sda).capacity = 0, (sda).align = (align_), (sda).arena = (arena_))
+#define crena_sda_at(sda, i) ((sda).seg[_crena_sda_seg(i)][_crena_sda_off(i)])
+#define crena_sda_len(sda) ((sda).count)
+#define crena_sda_reserve(sda, n) _crena_sda_reserve(_crena_sda_args(sda), (sda).count + (n))
+#define crena_sda_push(sda, itm) \
+  (crena_sda_reserve(sda, 1), crena_sda_at(sda, (sda).count) = (itm), (sda).count++)
+#define crena_sda_pop(sda) ((sda).count--, crena_sda_at(sda, (sda).count))
+#define crena_sda_append_many(sda, items, n) _crena_sda_append(_crena_sda_args(sda), &(sda).count, (items), (n))
 
 #define CRan(arena, type, count) crena_alloc(arena, sizeof(type) * count)
 #define CRa(arena, type) CRan(arena, type, 1)
 
+#define CRaln(arena, type, count, align) crena_alloc_aligned(arena, sizeof(type) * count, align)
+#define CRal(arena, type, align) CRaln(arena, type, 1, align)
+// Cache line isolated: aligned and padded so nothing else shares its lines
+#define CRcl(arena, type) \
+  crena_alloc_aligned(arena, (sizeof(type) + KNOB_CACHE_LINE - 1) & ~(KNOB_CACHE_LINE - 1), KNOB_CACHE_LINE)
+
 #define CRdn(arena, type, count) crena_dealloc(arena, sizeof(type) * count)
 #define CRd(arena, type) CRdn(arena, type, 1)
 
+// Fixed size object pool on top of an arena.
+// Objects are binned into size classes of KNOB_POOL_CLASS_STEP bytes, each
+// with its own free list, so alloc and free are a pointer pop/push. Empty
+// classes are refilled with a whole slab carved out of the arena; memory
+// only goes back to the arena when the arena itself is freed. Slabs are
+// KNOB_POOL_CLASS_STEP aligned, and so is every object in them.
+// Sizes above the largest class come from the arena directly. Freeing one
+// hands it back to the arena if it is the last thing allocated there,
+// otherwise it is kept for the next allocation of the same rounded size.
+typedef struct _crena_pool_node {
+  struct _crena_pool_node* next;
+} _crena_pool_node;
+
+typedef struct _crena_pool_big {
+  struct _crena_pool_big* next;
+  size_t size;
+} _crena_pool_big;
+
+typedef struct {
+  crena_arena* arena;
+  _crena_pool_node* free[KNOB_POOL_CLASSES];
+  _crena_pool_big* big;
+  int lock;
+} crena_pool;
+
+// Per-thread front end for a shared pool. Only refills and flushes touch
+// the pool (under its lock), in batches of KNOB_POOL_CACHE_BATCH objects.
+// Once caches are in use, all threads must go through a cache.
+typedef struct {
+  crena_pool* pool;
+  _crena_pool_node* free[KNOB_POOL_CLASSES];
+  size_t count[KNOB_POOL_CLASSES];
+} crena_pool_cache;
+
+crena_pool crena_pool_init(crena_arena* arena);
+void* crena_pool_alloc(crena_pool* pool, size_t size);
+void crena_pool_free(crena_pool* pool, void* mem, size_t size);
+
+crena_pool_cache crena_pool_cache_init(crena_pool* pool);
+void* crena_pool_cache_alloc(crena_pool_cache* cache, size_t size);
+void crena_pool_cache_free(crena_pool_cache* cache, void* mem, size_t size);
+void crena_pool_cache_flush(crena_pool_cache* cache);
+
+#define CRPa(pool, type) crena_pool_alloc(pool, sizeof(type))
+#define CRPf(pool, ptr) crena_pool_free(pool, ptr, sizeof(*(ptr)))
+
+// Open addressing hash map with robin hood probing.
+// The map is a pointer to entries of any struct type with `key` and
+// `value` members, e.g. `struct { size_t key; vpi_scope* value; }* map;`.
+// Like crena_da, a header lives in front of the entries, followed by two
+// scratch entries: map[-1] is where the macros stage the key, so keys can
+// be any expression, and map[-2] carries entries displaced by an insert. Keys are hashed and compared bytewise unless a
+// hash/eq pair is given to crena_hm_init_fn (needed for keys that point at
+// their data, like str). Each slot has a 16 bit meta word holding its
+// probe distance + 1 (0 means empty) and 8 bits of hash, so most misses
+// never call eq. Growing rehashes into a new block, so entry pointers are
+// only valid until the next put.
+typedef size_t (*crena_hm_hash_fn)(void const* key);
+typedef bool (*crena_hm_eq_fn)(void const* a, void const* b);
+
+typedef struct {
+  size_t count;
+  size_t capacity;
+  size_t esize;
+  size_t koff;
+  size_t ksize;
+  crena_hm_hash_fn hash;
+  crena_hm_eq_fn eq;
+  size_t last;
+  uint16_t* meta;
+  crena_arena* arena;
+} _crena_hm_header;
+
+void* _crena_hm_init(crena_arena* arena, size_t esize, size_t koff, size_t ksize,
+                     crena_hm_hash_fn hash, crena_hm_eq_fn eq);
+void* _crena_hm_reserve(void* hm, size_t esize, size_t n);
+void _crena_hm_insert(void** hmp, size_t esize);
+void* _crena_hm_find(void* hm, size_t esize);
+bool _crena_hm_del(void* hm, size_t esize);
+size_t _crena_hm_next(void* hm, size_t esize, size_t i);
+size_t crena_hm_hash_bytes(void const* data, size_t len);
+
+#define crena_hm_header(hm) ((_crena_hm_header*)((hm) - 2) - 1)
+#define _crena_hm_koff(hm) ((size_t)((char*)&(hm)[-1].key - (char*)&(hm)[-1]))
+#define crena_hm_init_fn(hm, arena, hash, eq) \
+  (hm) = _crena_hm_init(arena, sizeof(*(hm)), _crena_hm_koff(hm), sizeof((hm)->key), hash, eq)
+#define crena_hm_init(hm, arena) crena_hm_init_fn(hm, arena, NULL, NULL)
+#define crena_hm_len(hm) (crena_hm_header(hm)->count)
+#define crena_hm_cap(hm) (crena_hm_header(hm)->capacity)
+#define crena_hm_reserve(hm, n) ((hm) = _crena_hm_reserve(hm, sizeof(*(hm)), n))
+// Inserts or overwrites, evaluates to the stored value
+#define crena_hm_put(hm, k, v) \
+  (crena_hm_reserve(hm, 1), (hm)[-1].key = (k), _crena_hm_insert((void**)&(hm), sizeof(*(hm))), \
+   (hm)[crena_hm_header(hm)->last].value = (v))
+// Pointer to the entry, or NULL
+#define crena_hm_get(hm, k) ((hm)[-1].key = (k), (__typeof__(hm))_crena_hm_find(hm, sizeof(*(hm))))
+#define crena_hm_del(hm, k) ((hm)[-1].key = (k), _crena_hm_del(hm, sizeof(*(hm))))
+#define crena_hm_foreach(hm, i) \
+  for (size_t i = _crena_hm_next(hm, sizeof(*(hm)), 0); i < crena_hm_cap(hm); i = _crena_hm_next(hm, sizeof(*(hm)), i + 1))
+
 
 #ifdef CRENA_IMPLEMENTATION
 
+#ifdef CRENA_STATS
+static crena_stats _crena_stats_table[KNOB_STATS_MAX_ARENAS];
+static size_t _crena_stats_count = 0;
+// Arenas created after the table filled up, reported at the end
+static size_t _crena_stats_untracked = 0;
+
+static void _crena_stat_max(size_t* field, size_t v) {
+  size_t cur = __atomic_load_n(field, __ATOMIC_RELAXED);
+  while (v > cur && !__atomic_compare_exchange_n(field, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { }
+}
+
+static void _crena_stats_atexit(void) {
+  crena_stats_report_all(stderr);
+}
+
+static crena_stats* _crena_stats_register(size_t siz) {
+  if (_crena_stats_count == 0) atexit(_crena_stats_atexit);
+  if (_crena_stats_count >= KNOB_STATS_MAX_ARENAS) {
+    _crena_stats_untracked++;
+    return NULL;
+  }
+
+  crena_stats* st = &_crena_stats_table[_crena_stats_count++];
+  st->committed_pages = siz / getpagesize();
+  st->peak_committed_pages = st->committed_pages;
+  return st;
+}
+
+void crena_stats_name(crena_arena* arena, char const* name) {
+  if (arena->stats) arena->stats->name = name;
+}
+
+static void _crena_stats_print(crena_stats* st, size_t idx, FILE* out) {
+  size_t page_size = getpagesize();
+  if (st->name) {
+    fprintf(out, "crena arena '%s':\n", st->name);
+  } else {
+    fprintf(out, "crena arena #%zu:\n", idx);
+  }
+  fprintf(out, "  allocs     %zu (requested %zu B, allocated %zu B, align waste %zu B)\n",
+          st->alloc_count, st->bytes_requested, st->bytes_allocated, st->align_waste);
+  fprintf(out, "  peak loc   %zu B\n", st->peak_loc);
+  fprintf(out, "  committed  %zu pages (%zu B), peak %zu pages (%zu B)\n",
+          st->committed_pages, st->committed_pages * page_size,
+          st->peak_committed_pages, st->peak_committed_pages * page_size);
+  fprintf(out, "  reallocs   %zu (%zu in place, %zu B copied)\n",
+          st->realloc_count, st->realloc_in_place, st->realloc_copy_bytes);
+  fprintf(out, "  deallocs   %zu B, frees %zu\n", st->dealloc_bytes, st->free_count);
+}
+
+void crena_stats_report(crena_arena* arena, FILE* out) {
+  if (!arena->stats) return;
+  _crena_stats_print(arena->stats, arena->stats - _crena_stats_table, out);
+}
+
+void crena_stats_report_all(FILE* out) {
+  for (size_t i = 0; i < _crena_stats_count; i ++) {
+    _crena_stats_print(&_crena_stats_table[i], i, out);
+  }
+  if (_crena_stats_untracked) {
+    fprintf(out, "crena: %zu more arenas not tracked, raise KNOB_STATS_MAX_ARENAS (%d)\n",
+            _crena_stats_untracked, KNOB_STATS_MAX_ARENAS);
+  }
+}
+#endif
+
+static void _crena_lock(int* lock) {
+  while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(lock, __ATOMIC_RELAXED)) { }
+  }
+}
+
+static void _crena_unlock(int* lock) {
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static size_t _crena_round(crena_arena *arena, size_t size) {
+  if ((arena->flags & 0b10) == 0) {
+    size = (size + (KNOB_ALIGNMENT - 1)) &  ~(KNOB_ALIGNMENT - 1);
+  }
+  return size;
+}
+
+static bool _crena_commit_concurrent(crena_arena *arena, size_t end);
+
+static size_t _crena_da_pad(size_t align) {
+  if (align < KNOB_ALIGNMENT) align = KNOB_ALIGNMENT;
+  return (sizeof(_crena_da_header) + align - 1) & ~(align - 1);
+}
+
 size_t _crena_da_compress(void* da) {
   _crena_da_header* header = crena_da_header(da);
   crena_arena* arena = header->arena;
 
-  char* cmem = (char*)header;
+  size_t pad = _crena_da_pad(header->align);
+  size_t oldsiz = _crena_round(arena, header->capacity * header->esize + pad);
+  size_t newsiz = _crena_round(arena, header->count * header->esize + pad);
+  char* cmem = (char*)da - pad;
   char* amem = ((char*)arena->mem) + arena->loc;
-  bool can_compress = cmem == (amem - header->capacity);
+  bool can_compress = cmem == (amem - oldsiz);
 
   if (can_compress) {
-    size_t oldcap = header->capacity;
-    size_t newcap = header->count;
-    crena_dealloc(arena, oldcap - newcap);
-    return oldcap - newcap;
+    crena_dealloc(arena, oldsiz - newsiz);
+    header->capacity = header->count;
+    return oldsiz - newsiz;
   }
 
   return 0;
 }
 
-void* _crena_da_init(size_t esize, crena_arena* arena) {
+void* _crena_da_init(size_t esize, crena_arena* arena, size_t align) {
 #ifdef CRENA_UT
   static size_t capacity = 2;
 #else
   static size_t capacity = 20;
 #endif
-  size_t alloc_size = esize * capacity + sizeof(_crena_da_header);
-  char* mem = crena_alloc(arena, alloc_size);
-  char* ret = mem + sizeof(_crena_da_header);
-  _crena_da_header* header = (_crena_da_header*)mem;
+  size_t pad = _crena_da_pad(align);
+  size_t alloc_size = esize * capacity + pad;
+  char* mem = crena_alloc_aligned(arena, alloc_size, align);
+  char* ret = mem + pad;
+  _crena_da_header* header = crena_da_header(ret);
   header->arena = arena;
   header->count = 0;
   header->capacity = capacity;
+  header->esize = esize;
+  header->align = align;
   return ret;
 }
 
@@ -109,18 +489,202 @@ void* _crena_da_grow(void* daptr, size_t size, size_t count) {
   _crena_da_header* header = crena_da_header(daptr);
   if (header->count + count <= header->capacity) return daptr;
 
-  size_t actual_size = header->capacity * size + sizeof(_crena_da_header);
-  size_t actual_new_size = (header->capacity * 2) * size + sizeof(_crena_da_header);
-  char* mem = crena_realloc(header->arena, header, actual_size, actual_new_size);
-  char* ret = mem + sizeof(_crena_da_header);
+  size_t new_capacity = header->capacity * 2;
+  if (new_capacity < header->count + count) new_capacity = header->count + count;
+
+  size_t pad = _crena_da_pad(header->align);
+  size_t actual_size = header->capacity * size + pad;
+  size_t actual_new_size = new_capacity * size + pad;
+  char* mem = crena_realloc_aligned(header->arena, (char*)daptr - pad, actual_size, actual_new_size, header->align);
+  char* ret = mem + pad;
+  crena_da_header(ret)->capacity = new_capacity;
   return ret;
 }
 
+bool _crena_sda_reserve(void** seg, size_t* capacity, crena_arena* arena, size_t esize, size_t align,
+                        size_t needed) {
+  while (*capacity < needed) {
+    // capacity is always a whole number of segments, so it indexes the next one
+    size_t k = _crena_sda_seg(*capacity);
+    if (k >= KNOB_SDA_MAX_SEGMENTS) return false;
+    size_t n = (size_t)KNOB_SDA_FIRST_SEGMENT << k;
+    seg[k] = crena_alloc_aligned(arena, n * esize, align);
+    if (!seg[k]) return false;
+    *capacity += n;
+  }
+  return true;
+}
+
+void _crena_sda_append(void** seg, size_t* capacity, crena_arena* arena, size_t esize, size_t align,
+                       size_t* count, void const* items, size_t n) {
+  if (!_crena_sda_reserve(seg, capacity, arena, esize, align, *count + n)) return;
+
+  // One memcpy per segment touched
+  char const* src = items;
+  while (n) {
+    size_t k = _crena_sda_seg(*count);
+    size_t off = _crena_sda_off(*count);
+    size_t room = ((size_t)KNOB_SDA_FIRST_SEGMENT << k) - off;
+    size_t take = n < room ? n : room;
+    memcpy((char*)seg[k] + off * esize, src, take * esize);
+    src += take * esize;
+    *count += take;
+    n -= take;
+  }
+}
+
 crena_arena crena_init(void *mem, size_t size) {
   crena_arena ret = {.mem = mem, .siz = size, .flags = 0b1};
+#ifdef CRENA_STATS
+  ret.stats = _crena_stats_register(size);
+#endif
   return ret;
 }
 
+typedef struct {
+  uint64_t magic;
+  uint64_t loc;
+  uint64_t root;
+} _crena_file_header;
+
+crena_arena crena_init_fd(int fd) {
+  crena_arena ret = {0};
+  size_t page_size = getpagesize();
+  struct stat st;
+  if (fstat(fd, &st) != 0) return ret;
+
+  bool fresh = st.st_size == 0;
+  size_t size = fresh ? page_size : ((size_t)st.st_size + page_size - 1) & ~(page_size - 1);
+  if (size > KNOB_MMAP_SIZE) return ret;
+  if (size != (size_t)st.st_size && ftruncate(fd, size) != 0) return ret;
+
+  // Reserve the whole range so the file can grow in place, then put the
+  // file over the front of it
+  char* mem = mmap(NULL, KNOB_MMAP_SIZE, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (mem == MAP_FAILED) return ret;
+  if (mmap(mem, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(mem, KNOB_MMAP_SIZE);
+    return ret;
+  }
+
+  _crena_file_header* header = (_crena_file_header*)mem;
+  if (fresh) {
+    header->magic = KNOB_FILE_MAGIC;
+    header->loc = sizeof(_crena_file_header);
+    header->root = 0;
+  } else if (header->magic != KNOB_FILE_MAGIC || header->loc > size) {
+    munmap(mem, KNOB_MMAP_SIZE);
+    return ret;
+  }
+
+  ret = crena_init(mem, size);
+  ret.flags &= ~(0b1);
+  ret.flags |= CRENA_ARENA_FILE;
+  ret.fd = fd;
+  ret.start = sizeof(_crena_file_header);
+  ret.loc = header->loc;
+  ret.retain = page_size;
+  return ret;
+}
+
+crena_arena crena_init_file(char const* path) {
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) return (crena_arena){0};
+  crena_arena ret = crena_init_fd(fd);
+  if (!ret.mem) close(fd);
+  return ret;
+}
+
+crena_arena crena_init_memfd(char const* name) {
+  // MFD_CLOEXEC; called through syscall() so nobody needs _GNU_SOURCE
+  int fd = syscall(SYS_memfd_create, name, 1U);
+  if (fd < 0) return (crena_arena){0};
+  crena_arena ret = crena_init_fd(fd);
+  if (!ret.mem) close(fd);
+  return ret;
+}
+
+bool crena_sync(crena_arena* arena) {
+  if (!(arena->flags & CRENA_ARENA_FILE)) return false;
+  if (arena->flags & CRENA_ARENA_COW) return crena_snapshot_take(arena).gen != 0;
+  _crena_file_header* header = arena->mem;
+  header->loc = arena->loc;
+  return msync(arena->mem, arena->siz, MS_SYNC) == 0;
+}
+
+#define _CRENA_PM_PRESENT (1ULL << 63)
+#define _CRENA_PM_SWAPPED (1ULL << 62)
+#define _CRENA_PM_FILE (1ULL << 61)
+
+// Write pages that were copied on write back into the file
+static bool _crena_cow_writeback(crena_arena* arena) {
+  size_t page_size = getpagesize();
+  size_t npages = arena->siz / page_size;
+  int pm = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (pm < 0) return false;
+
+  uint64_t entries[512];
+  size_t first = (size_t)arena->mem / page_size;
+  bool ok = true;
+  for (size_t p = 0; ok && p < npages; p += 512) {
+    size_t n = npages - p < 512 ? npages - p : 512;
+    ssize_t got = pread(pm, entries, n * sizeof(uint64_t), (first + p) * sizeof(uint64_t));
+    if (got != (ssize_t)(n * sizeof(uint64_t))) {
+      ok = false;
+      break;
+    }
+    for (size_t i = 0; i < n; i ++) {
+      uint64_t e = entries[i];
+      bool dirty = ((e & _CRENA_PM_PRESENT) && !(e & _CRENA_PM_FILE)) || (e & _CRENA_PM_SWAPPED);
+      if (!dirty) continue;
+      size_t off = (p + i) * page_size;
+      if (pwrite(arena->fd, (char*)arena->mem + off, page_size, off) != (ssize_t)page_size) {
+        ok = false;
+        break;
+      }
+    }
+  }
+  close(pm);
+  return ok;
+}
+
+static bool _crena_cow_remap(crena_arena* arena) {
+  return mmap(arena->mem, arena->siz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, arena->fd, 0) != MAP_FAILED;
+}
+
+crena_snapshot crena_snapshot_take(crena_arena* arena) {
+  crena_snapshot snap = {0};
+  if (!(arena->flags & CRENA_ARENA_FILE)) return snap;
+
+  ((_crena_file_header*)arena->mem)->loc = arena->loc;
+  if ((arena->flags & CRENA_ARENA_COW) && !_crena_cow_writeback(arena)) return snap;
+  // Shared pages already are the file, nothing to write
+  if (!_crena_cow_remap(arena)) return snap;
+
+  arena->flags |= CRENA_ARENA_COW;
+  snap.loc = arena->loc;
+  snap.gen = ++arena->snapshots;
+  return snap;
+}
+
+bool crena_snapshot_restore(crena_arena* arena, crena_snapshot snap) {
+  if (!(arena->flags & CRENA_ARENA_COW) || snap.gen != arena->snapshots) return false;
+  if (!_crena_cow_remap(arena)) return false;
+  arena->loc = snap.loc;
+  return true;
+}
+
+void crena_set_root(crena_arena* arena, void* root) {
+  if (!(arena->flags & CRENA_ARENA_FILE)) return;
+  ((_crena_file_header*)arena->mem)->root = root ? crena_off_of(arena, root) : 0;
+}
+
+void* crena_get_root(crena_arena* arena) {
+  if (!(arena->flags & CRENA_ARENA_FILE)) return NULL;
+  crena_off root = ((_crena_file_header*)arena->mem)->root;
+  return root ? crena_ptr_of(arena, root) : NULL;
+}
+
 crena_arena crena_init_growing() {
   size_t chunk_size = getpagesize();
   void *mem = mmap(NULL, KNOB_MMAP_SIZE, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
@@ -128,10 +692,30 @@ crena_arena crena_init_growing() {
   crena_arena ret = crena_init(mem, chunk_size);
   // enable growing
   ret.flags &= ~(0b1);
+  ret.retain = chunk_size;
 
   return ret;
 }
 
+// Concurrent arenas bump loc with an atomic fetch-add, so any number of
+// threads may crena_alloc from them at once. Committing more pages is the
+// only locked path, and it commits KNOB_CONCURRENT_COMMIT_PAGES ahead so
+// it is rarely taken. crena_dealloc is a no-op on them, and crena_realloc
+// only grows in place when nobody allocated after the block.
+void crena_set_concurrent(crena_arena* arena, bool concurrent) {
+  if (concurrent) {
+    arena->flags |= CRENA_ARENA_CONCURRENT;
+  } else {
+    arena->flags &= ~CRENA_ARENA_CONCURRENT;
+  }
+}
+
+// Bytes kept committed by CRENA_FT_DECOMMIT and CRENA_FT_LAZY
+void crena_set_retain(crena_arena* arena, size_t bytes) {
+  size_t page_size = getpagesize();
+  arena->retain = (bytes + page_size - 1) & ~(page_size - 1);
+}
+
 void crena_set_aligned(crena_arena* arena, bool aligned) {
   if (aligned) {
     arena->flags &= ~(0b10);
@@ -141,55 +725,226 @@ void crena_set_aligned(crena_arena* arena, bool aligned) {
 }
 
 size_t crena_amount_free(crena_arena *arena) {
-  return arena->siz - arena->loc;
+  size_t siz = __atomic_load_n(&arena->siz, __ATOMIC_ACQUIRE);
+  size_t loc = __atomic_load_n(&arena->loc, __ATOMIC_RELAXED);
+  return loc < siz ? siz - loc : 0;
 }
 
 void *crena_realloc(crena_arena *arena, void* mem, size_t oldsiz, size_t newsiz) {
-  char* cmem = (char*)mem;
-  char* amem = ((char*)arena->mem) + arena->loc;
+  return crena_realloc_aligned(arena, mem, oldsiz, newsiz, KNOB_ALIGNMENT);
+}
 
-  bool can_grow_without_copy = cmem == (amem - oldsiz);
+// The in place paths keep `mem` where it is, which is already aligned
+void *crena_realloc_aligned(crena_arena *arena, void* mem, size_t oldsiz, size_t newsiz, size_t align) {
+  size_t off = (char*)mem - (char*)arena->mem;
+  size_t end = off + _crena_round(arena, oldsiz);
 
-  if (can_grow_without_copy) {
-    crena_dealloc(arena, oldsiz);
+  CRENA_STAT_ADD(arena, realloc_count, 1);
+  if (arena->flags & CRENA_ARENA_CONCURRENT) {
+    // Only in place if nobody else bumped loc since we got this block
+    size_t new_end = off + _crena_round(arena, newsiz);
+    if (__atomic_compare_exchange_n(&arena->loc, &end, new_end, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      if (new_end > __atomic_load_n(&arena->siz, __ATOMIC_ACQUIRE) && !_crena_commit_concurrent(arena, new_end)) {
+        return NULL;
+      }
+      CRENA_STAT_ADD(arena, realloc_in_place, 1);
+      CRENA_STAT_MAX(arena, peak_loc, new_end);
+      return mem;
+    }
+  } else if (end == arena->loc) {
+    CRENA_STAT_ADD(arena, realloc_in_place, 1);
+    crena_dealloc(arena, end - off);
     return crena_alloc(arena, newsiz);
-  } else {
-    void* ret = crena_alloc(arena, newsiz);
-    memcpy(ret, mem, oldsiz);
-    return ret;
   }
+
+  size_t copy = oldsiz < newsiz ? oldsiz : newsiz;
+  CRENA_STAT_ADD(arena, realloc_copy_bytes, copy);
+  void* ret = crena_alloc_aligned(arena, newsiz, align);
+  if (ret) memcpy(ret, mem, copy);
+  return ret;
 }
 
-static void _crena_grow(crena_arena *arena, size_t alloc_requested) {
+static bool _crena_grow(crena_arena *arena, size_t alloc_requested) {
   size_t page_size = getpagesize();
   size_t new_pages = (alloc_requested / page_size) + 1;
   size_t new_size = arena->siz + (new_pages * page_size);
+  if (new_size > KNOB_MMAP_SIZE) return false;
+
+  if (arena->flags & CRENA_ARENA_FILE) {
+    // Extend the file if needed and map the new tail over the reservation
+    struct stat st;
+    if (fstat(arena->fd, &st) != 0) return false;
+    if ((size_t)st.st_size < new_size && ftruncate(arena->fd, new_size) != 0) return false;
+    int share = (arena->flags & CRENA_ARENA_COW) ? MAP_PRIVATE : MAP_SHARED;
+    if (mmap(arena->mem + arena->siz, new_size - arena->siz, PROT_READ | PROT_WRITE,
+             share | MAP_FIXED, arena->fd, arena->siz) == MAP_FAILED) {
+      return false;
+    }
+  } else if (mprotect(arena->mem + arena->siz, new_size - arena->siz, PROT_READ | PROT_WRITE) != 0) {
+    return false;
+  }
+  __atomic_store_n(&arena->siz, new_size, __ATOMIC_RELEASE);
+  CRENA_STAT(arena,
+    st->committed_pages = new_size / page_size;
+    if (st->committed_pages > st->peak_committed_pages) st->peak_committed_pages = st->committed_pages;
+  );
+  return true;
+}
+
+static bool _crena_commit_concurrent(crena_arena *arena, size_t end) {
+  if (arena->flags & 0b1) return false;
+
+  bool ok = true;
+  _crena_lock(&arena->grow_lock);
+  // Someone may have committed past us while we waited
+  if (arena->siz < end) {
+    ok = _crena_grow(arena, (end - arena->siz) + KNOB_CONCURRENT_COMMIT_PAGES * getpagesize());
+  }
+  _crena_unlock(&arena->grow_lock);
+  return ok;
+}
+
+static void *_crena_alloc_concurrent(crena_arena *arena, size_t size, size_t asize) {
+  (void)size; // only used by stats
+  size_t off = __atomic_fetch_add(&arena->loc, asize, __ATOMIC_RELAXED);
+  size_t end = off + asize;
+  if (end > __atomic_load_n(&arena->siz, __ATOMIC_ACQUIRE) && !_crena_commit_concurrent(arena, end)) {
+    return NULL;
+  }
 
-  mprotect(arena->mem + arena->siz, new_size - arena->siz, PROT_READ | PROT_WRITE);
-  arena->siz = new_size;
+  CRENA_STAT_ADD(arena, alloc_count, 1);
+  CRENA_STAT_ADD(arena, bytes_requested, size);
+  CRENA_STAT_ADD(arena, bytes_allocated, asize);
+  CRENA_STAT_ADD(arena, align_waste, asize - size);
+  CRENA_STAT_MAX(arena, peak_loc, end);
+  return (char*)arena->mem + off;
 }
 
 void *crena_alloc(crena_arena *arena, size_t size) {
-  if ((arena->flags & 0b10) == 0) {
-    size = (size + (KNOB_ALIGNMENT - 1)) &  ~(KNOB_ALIGNMENT - 1);
+  size_t asize = _crena_round(arena, size);
+  if (arena->flags & CRENA_ARENA_CONCURRENT) return _crena_alloc_concurrent(arena, size, asize);
+
+  if (crena_amount_free(arena) < asize) {
+    if ((arena->flags & 0b1) != 0) return NULL;
+    if (!_crena_grow(arena, asize)) return NULL;
   }
-  if (crena_amount_free(arena) >= size) {
-    void *ret = arena->mem + arena->loc;
-    arena->loc += size;
-    return ret;
+
+  void *ret = arena->mem + arena->loc;
+  arena->loc += asize;
+  CRENA_STAT_ADD(arena, alloc_count, 1);
+  CRENA_STAT_ADD(arena, bytes_requested, size);
+  CRENA_STAT_ADD(arena, bytes_allocated, asize);
+  CRENA_STAT_ADD(arena, align_waste, asize - size);
+  CRENA_STAT_MAX(arena, peak_loc, arena->loc);
+  return ret;
+}
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+// Commit and fault in the next `size` bytes past loc so a latency
+// sensitive phase doesn't take page faults when it allocates them
+bool crena_prefault(crena_arena* arena, size_t size) {
+  size_t end = arena->loc + size;
+  if (end > arena->siz) {
+    if ((arena->flags & 0b1) != 0) return false;
+    if (!_crena_grow(arena, end - arena->siz)) return false;
   }
-  if ((arena->flags & 0b1) == 0) {
-    _crena_grow(arena, size);
-    return crena_alloc(arena, size);
+
+  size_t page_size = getpagesize();
+  char* start = (char*)((size_t)((char*)arena->mem + arena->loc) & ~(page_size - 1));
+  char* stop = (char*)arena->mem + end;
+  if (madvise(start, stop - start, MADV_POPULATE_WRITE) != 0) {
+    // Kernels before 5.14, touch every page ourselves
+    for (volatile char* p = start; p < stop; p += page_size) {
+      *p = *p;
+    }
+  }
+  return true;
+}
+
+// File backed arenas: on a shared mapping MADV_DONTNEED only unmaps, the
+// pages stay in the file (or memfd), so they get a hole punched instead
+// where the filesystem supports it.
+// MADV_FREE doesn't apply to shared mappings, so lazy does the same there.
+// Under a snapshot the file is the snapshot: only the private copies go,
+// and the mapping stays so the snapshot can still be restored.
+static void _crena_decommit(crena_arena *arena, bool lazy) {
+  if (arena->siz <= arena->retain) return;
+
+  char* start = (char*)arena->mem + arena->retain;
+  size_t len = arena->siz - arena->retain;
+  if (arena->flags & CRENA_ARENA_COW) {
+    madvise(start, len, MADV_DONTNEED);
+    return;
+  }
+  if (arena->flags & CRENA_ARENA_FILE) {
+    madvise(start, len, MADV_REMOVE);
+  } else if (lazy) {
+    madvise(start, len, MADV_FREE);
+    return;
+  } else {
+    madvise(start, len, MADV_DONTNEED);
   }
-  return NULL;
+  mprotect(start, len, PROT_NONE);
+  arena->siz = arena->retain;
+  CRENA_STAT(arena, st->committed_pages = arena->siz / getpagesize());
+}
+
+static size_t _crena_align_pad(crena_arena *arena, size_t loc, size_t align) {
+  size_t addr = (size_t)arena->mem + loc;
+  return ((addr + align - 1) & ~(align - 1)) - addr;
+}
+
+// `align` must be a power of two. Padding in front of the block counts
+// as alignment waste in the stats.
+void *crena_alloc_aligned(crena_arena *arena, size_t size, size_t align) {
+  if (align <= KNOB_ALIGNMENT && (arena->flags & 0b10) == 0) return crena_alloc(arena, size);
+
+  size_t asize = _crena_round(arena, size);
+  size_t pad;
+  if (arena->flags & CRENA_ARENA_CONCURRENT) {
+    // Can't fetch-add an amount we only know once we see loc, so CAS
+    size_t loc = __atomic_load_n(&arena->loc, __ATOMIC_RELAXED);
+    do {
+      pad = _crena_align_pad(arena, loc, align);
+    } while (!__atomic_compare_exchange_n(&arena->loc, &loc, loc + pad + asize, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    size_t end = loc + pad + asize;
+    if (end > __atomic_load_n(&arena->siz, __ATOMIC_ACQUIRE) && !_crena_commit_concurrent(arena, end)) {
+      return NULL;
+    }
+    CRENA_STAT_ADD(arena, alloc_count, 1);
+    CRENA_STAT_ADD(arena, bytes_requested, size);
+    CRENA_STAT_ADD(arena, bytes_allocated, pad + asize);
+    CRENA_STAT_ADD(arena, align_waste, pad + asize - size);
+    CRENA_STAT_MAX(arena, peak_loc, end);
+    return (char*)arena->mem + loc + pad;
+  }
+
+  pad = _crena_align_pad(arena, arena->loc, align);
+  if (crena_amount_free(arena) < pad + asize) {
+    if ((arena->flags & 0b1) != 0) return NULL;
+    if (!_crena_grow(arena, pad + asize)) return NULL;
+  }
+  arena->loc += pad;
+  CRENA_STAT_ADD(arena, bytes_allocated, pad);
+  CRENA_STAT_ADD(arena, align_waste, pad);
+  return crena_alloc(arena, size);
 }
 
 static void crena_free_all(crena_arena *arena) {
+  if (arena->flags & CRENA_ARENA_FILE) {
+    crena_sync(arena);
+    close(arena->fd);
+  }
   munmap(arena->mem, KNOB_MMAP_SIZE);
+  CRENA_STAT(arena, st->committed_pages = 0);
 }
 
 void crena_free(crena_arena *arena, crena_free_type free_type) {
+  CRENA_STAT_ADD(arena, free_count, 1);
   if ((arena->flags & 0b1)) {
     arena->loc = 0;
   } else {
@@ -198,21 +953,422 @@ void crena_free(crena_arena *arena, crena_free_type free_type) {
       crena_free_all(arena);
       break;
     case CRENA_FT_HOT_READY:
-      arena->loc = 0;
+      arena->loc = arena->start;
+      break;
+    case CRENA_FT_DECOMMIT:
+    case CRENA_FT_LAZY:
+      arena->loc = arena->start;
+      _crena_decommit(arena, free_type == CRENA_FT_LAZY);
       break;
     }
   }
 }
 
 void crena_dealloc(crena_arena *arena, size_t size) {
-  if (size >= arena->loc) {
+  if (arena->flags & CRENA_ARENA_CONCURRENT) return;
+  if (size <= arena->loc) {
     arena->loc -= size;
+    CRENA_STAT_ADD(arena, dealloc_bytes, size);
+  }
+}
+
+#define _crena_pool_class(size) (((size) + (KNOB_POOL_CLASS_STEP - 1)) / KNOB_POOL_CLASS_STEP - 1)
+#define _crena_pool_class_size(cls) (((cls) + 1) * KNOB_POOL_CLASS_STEP)
+
+crena_pool crena_pool_init(crena_arena* arena) {
+  crena_pool ret = {.arena = arena};
+  return ret;
+}
+
+static bool _crena_pool_refill(crena_pool* pool, size_t cls) {
+  size_t csize = _crena_pool_class_size(cls);
+  size_t nobjs = KNOB_POOL_SLAB_SIZE / csize;
+  if (nobjs < KNOB_POOL_CACHE_BATCH) nobjs = KNOB_POOL_CACHE_BATCH;
+
+  char* slab = crena_alloc_aligned(pool->arena, nobjs * csize, KNOB_POOL_CLASS_STEP);
+  if (!slab) return false;
+
+  for (size_t i = 0; i < nobjs - 1; i ++) {
+    ((_crena_pool_node*)(slab + i * csize))->next = (_crena_pool_node*)(slab + (i + 1) * csize);
+  }
+  ((_crena_pool_node*)(slab + (nobjs - 1) * csize))->next = pool->free[cls];
+  pool->free[cls] = (_crena_pool_node*)slab;
+  return true;
+}
+
+// Above the largest class. Sizes are rounded to the class step so a freed
+// block matches later requests and stays aligned like the slabs.
+static void* _crena_pool_big_alloc(crena_pool* pool, size_t size) {
+  size_t bsize = (size + KNOB_POOL_CLASS_STEP - 1) & ~(size_t)(KNOB_POOL_CLASS_STEP - 1);
+  for (_crena_pool_big** it = &pool->big; *it; it = &(*it)->next) {
+    if ((*it)->size != bsize) continue;
+    _crena_pool_big* block = *it;
+    *it = block->next;
+    return block;
+  }
+  return crena_alloc_aligned(pool->arena, bsize, KNOB_POOL_CLASS_STEP);
+}
+
+static void _crena_pool_big_free(crena_pool* pool, void* mem, size_t size) {
+  size_t bsize = (size + KNOB_POOL_CLASS_STEP - 1) & ~(size_t)(KNOB_POOL_CLASS_STEP - 1);
+  crena_arena* arena = pool->arena;
+  if (!(arena->flags & CRENA_ARENA_CONCURRENT) && (char*)mem + bsize == (char*)arena->mem + arena->loc) {
+    crena_dealloc(arena, bsize);
+    return;
   }
+  _crena_pool_big* block = mem;
+  block->size = bsize;
+  block->next = pool->big;
+  pool->big = block;
+}
+
+void* crena_pool_alloc(crena_pool* pool, size_t size) {
+  if (size == 0) size = 1;
+  size_t cls = _crena_pool_class(size);
+  if (cls >= KNOB_POOL_CLASSES) return _crena_pool_big_alloc(pool, size);
+
+  if (!pool->free[cls] && !_crena_pool_refill(pool, cls)) return NULL;
+
+  _crena_pool_node* node = pool->free[cls];
+  pool->free[cls] = node->next;
+  return node;
+}
+
+void crena_pool_free(crena_pool* pool, void* mem, size_t size) {
+  if (!mem) return;
+  if (size == 0) size = 1;
+  size_t cls = _crena_pool_class(size);
+  if (cls >= KNOB_POOL_CLASSES) {
+    _crena_pool_big_free(pool, mem, size);
+    return;
+  }
+
+  _crena_pool_node* node = mem;
+  node->next = pool->free[cls];
+  pool->free[cls] = node;
+}
+
+crena_pool_cache crena_pool_cache_init(crena_pool* pool) {
+  crena_pool_cache ret = {.pool = pool};
+  return ret;
+}
+
+void* crena_pool_cache_alloc(crena_pool_cache* cache, size_t size) {
+  if (size == 0) size = 1;
+  size_t cls = _crena_pool_class(size);
+  crena_pool* pool = cache->pool;
+
+  if (cls >= KNOB_POOL_CLASSES) {
+    _crena_lock(&pool->lock);
+    void* ret = _crena_pool_big_alloc(pool, size);
+    _crena_unlock(&pool->lock);
+    return ret;
+  }
+
+  if (!cache->free[cls]) {
+    // Grab a batch from the shared list in one go
+    _crena_lock(&pool->lock);
+    for (size_t i = 0; i < KNOB_POOL_CACHE_BATCH; i ++) {
+      if (!pool->free[cls] && !_crena_pool_refill(pool, cls)) break;
+      _crena_pool_node* node = pool->free[cls];
+      pool->free[cls] = node->next;
+      node->next = cache->free[cls];
+      cache->free[cls] = node;
+      cache->count[cls]++;
+    }
+    _crena_unlock(&pool->lock);
+    if (!cache->free[cls]) return NULL;
+  }
+
+  _crena_pool_node* node = cache->free[cls];
+  cache->free[cls] = node->next;
+  cache->count[cls]--;
+  return node;
+}
+
+static void _crena_pool_cache_release(crena_pool_cache* cache, size_t cls, size_t keep) {
+  crena_pool* pool = cache->pool;
+  _crena_lock(&pool->lock);
+  while (cache->count[cls] > keep) {
+    _crena_pool_node* node = cache->free[cls];
+    cache->free[cls] = node->next;
+    node->next = pool->free[cls];
+    pool->free[cls] = node;
+    cache->count[cls]--;
+  }
+  _crena_unlock(&pool->lock);
+}
+
+void crena_pool_cache_free(crena_pool_cache* cache, void* mem, size_t size) {
+  if (!mem) return;
+  if (size == 0) size = 1;
+  size_t cls = _crena_pool_class(size);
+  if (cls >= KNOB_POOL_CLASSES) {
+    crena_pool* pool = cache->pool;
+    _crena_lock(&pool->lock);
+    _crena_pool_big_free(pool, mem, size);
+    _crena_unlock(&pool->lock);
+    return;
+  }
+
+  _crena_pool_node* node = mem;
+  node->next = cache->free[cls];
+  cache->free[cls] = node;
+  cache->count[cls]++;
+
+  // Hand half back once we hold two batches so one thread freeing what
+  // another allocates doesn't hoard the whole class
+  if (cache->count[cls] >= 2 * KNOB_POOL_CACHE_BATCH) {
+    _crena_pool_cache_release(cache, cls, KNOB_POOL_CACHE_BATCH);
+  }
+}
+
+void crena_pool_cache_flush(crena_pool_cache* cache) {
+  for (size_t cls = 0; cls < KNOB_POOL_CLASSES; cls ++) {
+    if (cache->count[cls]) _crena_pool_cache_release(cache, cls, 0);
+  }
+}
+
+#define _crena_hm_hdr(hm, esize) ((_crena_hm_header*)((char*)(hm) - 2 * (esize)) - 1)
+#define _crena_hm_entry(hm, esize, i) ((char*)(hm) + (ptrdiff_t)(i) * (ptrdiff_t)(esize))
+#define _crena_hm_meta(dist, h) ((uint16_t)(((dist) << 8) | (((h) >> 56) & 0xff)))
+
+size_t crena_hm_hash_bytes(void const* data, size_t len) {
+  // FNV-1a, finished with a murmur style mix so the top bits are usable
+  uint64_t h = 0xcbf29ce484222325ULL;
+  unsigned char const* p = data;
+  for (size_t i = 0; i < len; i ++) {
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static size_t _crena_hm_hash(_crena_hm_header* hdr, void const* entry) {
+  void const* key = (char const*)entry + hdr->koff;
+  if (hdr->hash) return hdr->hash(key);
+  if (hdr->ksize == sizeof(uint64_t)) {
+    uint64_t h;
+    memcpy(&h, key, sizeof(h));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+  return crena_hm_hash_bytes(key, hdr->ksize);
+}
+
+static bool _crena_hm_eq(_crena_hm_header* hdr, void const* a, void const* b) {
+  a = (char const*)a + hdr->koff;
+  b = (char const*)b + hdr->koff;
+  if (hdr->eq) return hdr->eq(a, b);
+  return memcmp(a, b, hdr->ksize) == 0;
+}
+
+static void _crena_hm_swap(char* a, char* b, size_t n) {
+  for (size_t i = 0; i < n; i ++) {
+    char t = a[i];
+    a[i] = b[i];
+    b[i] = t;
+  }
+}
+
+static void* _crena_hm_alloc(crena_arena* arena, _crena_hm_header* proto, size_t capacity) {
+  size_t esize = proto->esize;
+  size_t entries = sizeof(_crena_hm_header) + 2 * esize;
+  char* mem = crena_alloc(arena, entries + capacity * esize + capacity * sizeof(uint16_t));
+  if (!mem) return NULL;
+
+  void* hm = mem + entries;
+  _crena_hm_header* hdr = _crena_hm_hdr(hm, esize);
+  *hdr = *proto;
+  hdr->count = 0;
+  hdr->capacity = capacity;
+  hdr->meta = (uint16_t*)((char*)hm + capacity * esize);
+  memset(hdr->meta, 0, capacity * sizeof(uint16_t));
+  return hm;
+}
+
+void* _crena_hm_init(crena_arena* arena, size_t esize, size_t koff, size_t ksize,
+                     crena_hm_hash_fn hash, crena_hm_eq_fn eq) {
+  _crena_hm_header proto = {
+    .esize = esize, .koff = koff, .ksize = ksize, .hash = hash, .eq = eq, .arena = arena
+  };
+  return _crena_hm_alloc(arena, &proto, KNOB_HM_MIN_CAPACITY);
+}
+
+// Finds or inserts the entry staged at hm[-1] and returns its slot.
+// Returns capacity if a probe distance outgrew the meta word; the entry
+// left homeless by that is then in the carry at hm[-2].
+static size_t _crena_hm_place(void* hm, _crena_hm_header* hdr, size_t h) {
+  size_t esize = hdr->esize;
+  size_t mask = hdr->capacity - 1;
+  char* carry = _crena_hm_entry(hm, esize, -2);
+  size_t i = h & mask;
+  size_t placed = hdr->capacity;
+  uint16_t meta = _crena_hm_meta(1, h);
+
+  memcpy(carry, _crena_hm_entry(hm, esize, -1), esize);
+  for (;;) {
+    uint16_t cur = hdr->meta[i];
+    if (cur == 0) {
+      memcpy(_crena_hm_entry(hm, esize, i), carry, esize);
+      hdr->meta[i] = meta;
+      hdr->count++;
+      return placed == hdr->capacity ? i : placed;
+    }
+    if (placed == hdr->capacity && cur == meta && _crena_hm_eq(hdr, _crena_hm_entry(hm, esize, i), carry)) {
+      return i;
+    }
+    if ((cur >> 8) < (meta >> 8)) {
+      // Rich slot: take it and carry the displaced entry onwards
+      _crena_hm_swap(_crena_hm_entry(hm, esize, i), carry, esize);
+      hdr->meta[i] = meta;
+      meta = cur;
+      if (placed == hdr->capacity) placed = i;
+    }
+    if ((meta >> 8) == 0xff) return hdr->capacity;
+    meta += 1 << 8;
+    i = (i + 1) & mask;
+  }
+}
+
+static void* _crena_hm_rehash(void* hm, size_t esize, size_t capacity, bool with_carry) {
+  _crena_hm_header* old = _crena_hm_hdr(hm, esize);
+  void* nhm = _crena_hm_alloc(old->arena, old, capacity);
+  if (!nhm) return NULL;
+
+  _crena_hm_header* hdr = _crena_hm_hdr(nhm, esize);
+  for (ptrdiff_t i = with_carry ? -2 : 0; i < (ptrdiff_t)old->capacity; i ++) {
+    if (i == -1 || (i >= 0 && !old->meta[i])) continue;
+    char* entry = _crena_hm_entry(hm, esize, i);
+    memcpy(_crena_hm_entry(nhm, esize, -1), entry, esize);
+    if (_crena_hm_place(nhm, hdr, _crena_hm_hash(hdr, entry)) == capacity) {
+      return _crena_hm_rehash(hm, esize, capacity * 2, with_carry);
+    }
+  }
+  memcpy(_crena_hm_entry(nhm, esize, -1), _crena_hm_entry(hm, esize, -1), esize);
+  return nhm;
+}
+
+void* _crena_hm_reserve(void* hm, size_t esize, size_t n) {
+  _crena_hm_header* hdr = _crena_hm_hdr(hm, esize);
+  size_t needed = hdr->count + n;
+  if (needed * 100 <= hdr->capacity * KNOB_HM_MAX_LOAD_PCT) return hm;
+
+  size_t capacity = hdr->capacity;
+  while (needed * 100 > capacity * KNOB_HM_MAX_LOAD_PCT) capacity *= 2;
+  void* nhm = _crena_hm_rehash(hm, esize, capacity, false);
+  return nhm ? nhm : hm;
+}
+
+void _crena_hm_insert(void** hmp, size_t esize) {
+  void* hm = *hmp;
+  _crena_hm_header* hdr = _crena_hm_hdr(hm, esize);
+  size_t h = _crena_hm_hash(hdr, _crena_hm_entry(hm, esize, -1));
+  size_t i = _crena_hm_place(hm, hdr, h);
+
+  if (i == hdr->capacity) {
+    // A probe run got too long: rebuild bigger, homeless entry included,
+    // then look the staged key back up
+    void* nhm = _crena_hm_rehash(hm, esize, hdr->capacity * 2, true);
+    if (nhm) {
+      hm = nhm;
+      *hmp = nhm;
+      hdr = _crena_hm_hdr(hm, esize);
+      i = _crena_hm_place(hm, hdr, h);
+    } else {
+      i = 0;
+    }
+  }
+  hdr->last = i;
+}
+
+void* _crena_hm_find(void* hm, size_t esize) {
+  _crena_hm_header* hdr = _crena_hm_hdr(hm, esize);
+  char* scratch = _crena_hm_entry(hm, esize, -1);
+  size_t h = _crena_hm_hash(hdr, scratch);
+  size_t mask = hdr->capacity - 1;
+  uint16_t meta = _crena_hm_meta(1, h);
+
+  for (size_t i = h & mask;; i = (i + 1) & mask) {
+    uint16_t cur = hdr->meta[i];
+    // Robin hood invariant: once we are further from home than the
+    // resident, our key can't be further along
+    if ((cur >> 8) < (meta >> 8)) return NULL;
+    if (cur == meta && _crena_hm_eq(hdr, _crena_hm_entry(hm, esize, i), scratch)) {
+      return _crena_hm_entry(hm, esize, i);
+    }
+    if ((meta >> 8) == 0xff) return NULL;
+    meta += 1 << 8;
+  }
+}
+
+bool _crena_hm_del(void* hm, size_t esize) {
+  _crena_hm_header* hdr = _crena_hm_hdr(hm, esize);
+  char* entry = _crena_hm_find(hm, esize);
+  if (!entry) return false;
+
+  // Backward shift the run after us so no tombstones are needed
+  size_t mask = hdr->capacity - 1;
+  size_t i = (entry - (char*)hm) / esize;
+  for (;;) {
+    size_t next = (i + 1) & mask;
+    uint16_t nm = hdr->meta[next];
+    if ((nm >> 8) <= 1) break;
+    memcpy(_crena_hm_entry(hm, esize, i), _crena_hm_entry(hm, esize, next), esize);
+    hdr->meta[i] = nm - (1 << 8);
+    i = next;
+  }
+  hdr->meta[i] = 0;
+  hdr->count--;
+  return true;
+}
+
+size_t _crena_hm_next(void* hm, size_t esize, size_t i) {
+  _crena_hm_header* hdr = _crena_hm_hdr(hm, esize);
+  while (i < hdr->capacity && !hdr->meta[i]) i ++;
+  return i;
 }
 
 #endif
 
 #ifdef CRENA_UT
+#include <pthread.h>
+
+#define UT_THREADS 4
+#define UT_ALLOCS 100000
+
+static void* _crena_ut_concurrent_worker(void* arg) {
+  crena_arena* shared = arg;
+  size_t bad = 0;
+  size_t** mine = malloc(sizeof(size_t*) * UT_ALLOCS);
+  for (size_t i = 0; i < UT_ALLOCS; i ++) {
+    mine[i] = crena_alloc(shared, sizeof(size_t) * 3);
+    mine[i][0] = mine[i][1] = mine[i][2] = (size_t)mine;
+  }
+  for (size_t i = 0; i < UT_ALLOCS; i ++) {
+    if (mine[i][0] != (size_t)mine || mine[i][2] != (size_t)mine) bad ++;
+  }
+  free(mine);
+  return (void*)bad;
+}
+
+static size_t _crena_ut_resident_pages(crena_arena* arena) {
+  size_t page_size = getpagesize();
+  size_t npages = KNOB_MMAP_SIZE / page_size / 64;
+  unsigned char* vec = malloc(npages);
+  size_t resident = 0;
+  if (mincore(arena->mem, npages * page_size, vec) == 0) {
+    for (size_t i = 0; i < npages; i ++) resident += vec[i] & 1;
+  }
+  free(vec);
+  return resident;
+}
 
 void crena_unit_test() {
   int* da;
@@ -232,6 +1388,189 @@ void crena_unit_test() {
 
   printf("If I grab the last: %d\n", crena_da_pop(da));
   printf("What is my new length? %ld\n", crena_da_len(da));
+
+  int more[] = {4, 5, 6, 7, 8};
+  crena_da_append_many(da, more, 5);
+  printf("After append_many: len %ld, last %d\n", crena_da_len(da), da[crena_da_len(da) - 1]);
+
+  crena_sda(int) sda;
+  crena_sda_init(sda, &arena);
+  crena_sda_push(sda, 0);
+  int* first = &crena_sda_at(sda, 0);
+  for (int i = 1; i < 1000; i ++) {
+    crena_sda_push(sda, i);
+  }
+  crena_sda_append_many(sda, more, 5);
+  bool sda_ok = first == &crena_sda_at(sda, 0) && crena_sda_len(sda) == 1005;
+  for (int i = 0; i < 1000; i ++) {
+    if (crena_sda_at(sda, i) != i) sda_ok = false;
+  }
+  printf("Segmented array stable and intact? %s, last %d\n", sda_ok ? "yes" : "no", crena_sda_pop(sda));
+
+  CRa(&arena, char);
+  double* simd;
+  crena_da_init_aligned(simd, &arena, 32);
+  bool aligned_ok = ((size_t)simd & 31) == 0;
+  for (int i = 0; i < 100; i ++) {
+    CRa(&arena, char); // keep the array off the top so growth has to move it
+    crena_da_push(simd, (double)i);
+    aligned_ok = aligned_ok && ((size_t)simd & 31) == 0;
+  }
+  aligned_ok = aligned_ok && simd[99] == 99.0 && ((size_t)CRcl(&arena, int) & (KNOB_CACHE_LINE - 1)) == 0;
+  printf("Over-aligned allocations stay aligned? %s\n", aligned_ok ? "yes" : "no");
+
+  struct { size_t key; size_t value; }* hm;
+  crena_hm_init(hm, &arena);
+  for (size_t i = 0; i < 10000; i ++) {
+    crena_hm_put(hm, i * 7, i);
+  }
+  crena_hm_put(hm, 7, 100);
+  for (size_t i = 0; i < 10000; i += 2) {
+    crena_hm_del(hm, i * 7);
+  }
+  bool hm_ok = crena_hm_len(hm) == 5000 && crena_hm_get(hm, 14) == NULL && crena_hm_get(hm, 7)->value == 100;
+  size_t hm_seen = 0;
+  crena_hm_foreach(hm, i) {
+    hm_ok = hm_ok && (hm[i].key / 7) % 2 == 1;
+    hm_seen ++;
+  }
+  for (size_t i = 3; i < 10000; i += 2) {
+    hm_ok = hm_ok && crena_hm_get(hm, i * 7) && crena_hm_get(hm, i * 7)->value == i;
+  }
+  printf("Hash map consistent? %s, %ld entries, capacity %ld\n", hm_ok && hm_seen == 5000 ? "yes" : "no",
+         crena_hm_len(hm), crena_hm_cap(hm));
+
+  crena_arena persist = crena_init_memfd("crena unit test");
+  typedef struct { crena_rel next; size_t val; } ut_node;
+  ut_node* head = NULL;
+  for (size_t i = 0; i < 1000; i ++) {
+    ut_node* n = CRa(&persist, ut_node);
+    crena_rel_set(&n->next, head);
+    n->val = i;
+    head = n;
+  }
+  crena_set_root(&persist, head);
+  crena_sync(&persist);
+  crena_arena reopened = crena_init_fd(dup(persist.fd));
+  size_t persist_sum = 0;
+  for (ut_node* n = crena_get_root(&reopened); n; n = crena_rel_get(&n->next)) persist_sum += n->val;
+  printf("Persistent arena remapped elsewhere intact? %s\n",
+         reopened.mem != persist.mem && reopened.loc == persist.loc && persist_sum == 999 * 1000 / 2 ? "yes" : "no");
+  crena_free(&reopened, CRENA_FT_ALL);
+  crena_free(&persist, CRENA_FT_ALL);
+
+  crena_arena backed = crena_init_memfd("crena decommit unit test");
+  memset(CRan(&backed, char, 1 << 20), 1, 1 << 20);
+  struct stat before, after;
+  fstat(backed.fd, &before);
+  crena_free(&backed, CRENA_FT_DECOMMIT);
+  fstat(backed.fd, &after);
+  printf("Decommit gives file backed pages back? %s\n",
+         after.st_blocks * 512 <= (blkcnt_t)backed.retain && before.st_blocks * 512 >= 1 << 20 ? "yes" : "no");
+  crena_free(&backed, CRENA_FT_ALL);
+
+  crena_arena state = crena_init_memfd("crena snapshot unit test");
+  size_t nstate = 1 << 20;
+  uint32_t* st = CRan(&state, uint32_t, nstate);
+  for (size_t i = 0; i < nstate; i ++) st[i] = i;
+  crena_snapshot snap = crena_snapshot_take(&state);
+  size_t snap_loc = state.loc;
+  bool snap_ok = snap.gen != 0;
+  for (int round = 0; round < 3; round ++) {
+    for (size_t i = 0; i < nstate; i += 4096) st[i] = 0xdead;
+    CRan(&state, uint32_t, nstate);
+    snap_ok = snap_ok && crena_snapshot_restore(&state, snap) && state.loc == snap_loc;
+    for (size_t i = 0; i < nstate; i += 1024) snap_ok = snap_ok && st[i] == i;
+  }
+  st[5] = 5555;
+  snap = crena_snapshot_take(&state);
+  st[5] = 0;
+  snap_ok = snap_ok && crena_snapshot_restore(&state, snap) && st[5] == 5555 && st[6] == 6;
+  printf("Snapshot restores repeatedly? %s\n", snap_ok ? "yes" : "no");
+  crena_free(&state, CRENA_FT_ALL);
+
+  crena_stats_name(&arena, "unit test");
+
+#ifdef CRENA_STATS
+  // Pretend the table is full rather than creating dozens of arenas
+  size_t stats_count = _crena_stats_count;
+  _crena_stats_count = KNOB_STATS_MAX_ARENAS;
+  char untracked_buf[64];
+  crena_arena untracked = crena_init(untracked_buf, sizeof(untracked_buf));
+  FILE* report = tmpfile();
+  char line[128] = {0};
+  if (report) {
+    crena_stats_report_all(report);
+    rewind(report);
+    while (fgets(line, sizeof(line), report) && strncmp(line, "crena: 1 more", 13) != 0) { }
+    fclose(report);
+  }
+  printf("Arenas past the stats table are counted and reported? %s\n",
+         !untracked.stats && _crena_stats_untracked == 1 && strncmp(line, "crena: 1 more", 13) == 0 ? "yes" : "no");
+  _crena_stats_count = stats_count;
+  _crena_stats_untracked = 0;
+#endif
+
+  crena_pool pool = crena_pool_init(&arena);
+  double* a = CRPa(&pool, double);
+  double* b = CRPa(&pool, double);
+  CRPf(&pool, a);
+  double* c = CRPa(&pool, double);
+  printf("Pool reuses freed slot? %s\n", (a == c && a != b) ? "yes" : "no");
+
+  bool pool_aligned = true;
+  crena_alloc(&arena, 1);
+  for (size_t size = 1; size <= KNOB_POOL_CLASSES * KNOB_POOL_CLASS_STEP; size += 7) {
+    pool_aligned = pool_aligned && (uintptr_t)crena_pool_alloc(&pool, size) % KNOB_POOL_CLASS_STEP == 0;
+  }
+  printf("Pool objects aligned to the class step? %s\n", pool_aligned ? "yes" : "no");
+
+  // A big block on top goes back to the arena, one below something else
+  // is kept for the next request of its size
+  void* big = crena_pool_alloc(&pool, 1000);
+  crena_pool_free(&pool, big, 1000);
+  bool big_back = arena.loc == crena_off_of(&arena, big);
+  void* big1 = crena_pool_alloc(&pool, 1000);
+  crena_alloc(&arena, 8);
+  crena_pool_free(&pool, big1, 1000);
+  size_t loc_kept = arena.loc;
+  bool big_reused = crena_pool_alloc(&pool, 1000) == big1 && arena.loc == loc_kept;
+  printf("Pool frees above the largest class aren't lost? %s\n", big_back && big_reused ? "yes" : "no");
+
+  crena_pool_cache cache = crena_pool_cache_init(&pool);
+  void* d = crena_pool_cache_alloc(&cache, 40);
+  crena_pool_cache_free(&cache, d, 40);
+  printf("Cache reuses freed slot? %s\n", crena_pool_cache_alloc(&cache, 48) == d ? "yes" : "no");
+  crena_pool_cache_flush(&cache);
+
+  crena_arena shared = crena_init_growing();
+  crena_set_concurrent(&shared, true);
+  crena_stats_name(&shared, "concurrent unit test");
+  pthread_t threads[UT_THREADS];
+  for (size_t i = 0; i < UT_THREADS; i ++) {
+    pthread_create(&threads[i], NULL, _crena_ut_concurrent_worker, &shared);
+  }
+  size_t bad = 0;
+  for (size_t i = 0; i < UT_THREADS; i ++) {
+    void* ret;
+    pthread_join(threads[i], &ret);
+    bad += (size_t)ret;
+  }
+  printf("Concurrent allocs overlapping: %ld, loc %ld of %ld\n", bad, shared.loc, (size_t)UT_THREADS * UT_ALLOCS * sizeof(size_t) * 3);
+  crena_set_concurrent(&shared, false);
+  crena_set_retain(&shared, 64 * 1024);
+  size_t page_size = getpagesize();
+  size_t resident_used = _crena_ut_resident_pages(&shared);
+  crena_free(&shared, CRENA_FT_DECOMMIT);
+  size_t resident_freed = _crena_ut_resident_pages(&shared);
+  printf("Decommit keeps only the retained pages? %s\n",
+         resident_used > shared.retain / page_size && resident_freed <= shared.retain / page_size ? "yes" : "no");
+  bool prefaulted = crena_prefault(&shared, 1024 * 1024);
+  size_t resident_prefaulted = _crena_ut_resident_pages(&shared);
+  printf("Prefault makes the whole range resident? %s\n",
+         prefaulted && resident_prefaulted >= 1024 * 1024 / page_size && resident_prefaulted <= shared.siz / page_size
+         ? "yes" : "no");
+  crena_free(&shared, CRENA_FT_ALL);
 }
 
 #endif
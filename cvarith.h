@@ -0,0 +1,517 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cvvec.h"
+
+// Wide unsigned arithmetic for the .arith, .cmp and .shift nodes.
+// Values are arrays of 64-bit limbs, least significant first, like the
+// aval plane of a cv_vec4. The limb kernels:
+//  - add/sub chain the carry through _addcarry_u64/_subborrow_u64 (adc
+//    and sbb) on x86-64,
+//  - mul keeps only the low n limbs like Verilog does. Below
+//    KNOB_ARITH_KARATSUBA limbs it is schoolbook over 128-bit products
+//    skipping the limbs that would be cut off; from there on it is the
+//    full Karatsuba product, splitting in halves until the threshold,
+//  - divmod is Knuth's algorithm D with 128-by-64 bit quotient digits,
+//  - shifts move whole limbs and then bits.
+// mul and divmod take a caller's scratch so nothing is allocated while
+// evaluating. cv_arith_tmp(width) limbs covers the cv_vec4 wrappers,
+// which keep the product or quotient and remainder in front of what the
+// limb functions use.
+// The cv_vec4 functions follow Verilog: any x/z bit in an operand makes
+// the whole result x, a zero divisor too. Compares give x likewise except
+// the case equality ones. Shifts move x/z bits along and give all x for
+// an unknown amount. Operands up to 64 bits take an inline path.
+
+#ifndef KNOB_ARITH_KARATSUBA
+#define KNOB_ARITH_KARATSUBA 8
+#endif
+
+uint64_t cv_limbs_add(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n);
+uint64_t cv_limbs_sub(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n);
+// Low n limbs of x * y. r does not alias the operands.
+void cv_limbs_mul(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n, uint64_t* tmp);
+// False when y is zero. q and m do not alias the operands.
+bool cv_limbs_divmod(uint64_t* q, uint64_t* m, uint64_t const* x, uint64_t const* y, size_t n, uint64_t* tmp);
+int cv_limbs_cmp(uint64_t const* x, uint64_t const* y, size_t n);
+void cv_limbs_shl(uint64_t* r, uint64_t const* x, size_t n, uint64_t amount);
+void cv_limbs_shr(uint64_t* r, uint64_t const* x, size_t n, uint64_t amount);
+// Scratch limbs mul and divmod need at this width
+size_t cv_arith_tmp(uint32_t width);
+
+// Operands have r's width, r may alias them
+void cv_vec4_add(cv_vec4* r, cv_vec4* x, cv_vec4* y);
+void cv_vec4_sub(cv_vec4* r, cv_vec4* x, cv_vec4* y);
+void cv_vec4_mul(cv_vec4* r, cv_vec4* x, cv_vec4* y, uint64_t* tmp);
+void cv_vec4_div(cv_vec4* r, cv_vec4* x, cv_vec4* y, uint64_t* tmp);
+void cv_vec4_mod(cv_vec4* r, cv_vec4* x, cv_vec4* y, uint64_t* tmp);
+cv_bit cv_vec4_ge(cv_vec4* x, cv_vec4* y);
+cv_bit cv_vec4_gt(cv_vec4* x, cv_vec4* y);
+// === : bit for bit, x and z included
+cv_bit cv_vec4_eeq(cv_vec4* x, cv_vec4* y);
+// amount has any width
+void cv_vec4_shl(cv_vec4* r, cv_vec4* x, cv_vec4* amount);
+void cv_vec4_shr(cv_vec4* r, cv_vec4* x, cv_vec4* amount);
+
+#ifdef CVARITH_IMPLEMENTATION
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <x86intrin.h>
+#define _cv_adc(c, x, y, r) _addcarry_u64((c), (x), (y), (unsigned long long*)(r))
+#define _cv_sbb(c, x, y, r) _subborrow_u64((c), (x), (y), (unsigned long long*)(r))
+#else
+static inline unsigned char _cv_adc(unsigned char c, uint64_t x, uint64_t y, uint64_t* r) {
+  uint64_t s;
+  unsigned char o = __builtin_add_overflow(x, y, &s);
+  o |= __builtin_add_overflow(s, (uint64_t)c, r);
+  return o;
+}
+static inline unsigned char _cv_sbb(unsigned char c, uint64_t x, uint64_t y, uint64_t* r) {
+  uint64_t s;
+  unsigned char o = __builtin_sub_overflow(x, y, &s);
+  o |= __builtin_sub_overflow(s, (uint64_t)c, r);
+  return o;
+}
+#endif
+
+typedef unsigned __int128 _cv_u128;
+
+uint64_t cv_limbs_add(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) {
+  unsigned char c = 0;
+  for (size_t i = 0; i < n; i ++) c = _cv_adc(c, x[i], y[i], &r[i]);
+  return c;
+}
+
+uint64_t cv_limbs_sub(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) {
+  unsigned char c = 0;
+  for (size_t i = 0; i < n; i ++) c = _cv_sbb(c, x[i], y[i], &r[i]);
+  return c;
+}
+
+int cv_limbs_cmp(uint64_t const* x, uint64_t const* y, size_t n) {
+  for (size_t i = n; i-- > 0;) {
+    if (x[i] != y[i]) return x[i] < y[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// r[0..rn) += v[0..vn) << (64 * off), carry running off the top
+static void _cv_limbs_add_at(uint64_t* r, size_t rn, size_t off, uint64_t const* v, size_t vn) {
+  unsigned char c = 0;
+  size_t i = 0;
+  for (; i < vn && off + i < rn; i ++) c = _cv_adc(c, r[off + i], v[i], &r[off + i]);
+  for (i += off; c && i < rn; i ++) c = _cv_adc(c, r[i], 0, &r[i]);
+}
+
+// v[0..vn) -= w[0..wn), wn <= vn
+static void _cv_limbs_sub_from(uint64_t* v, size_t vn, uint64_t const* w, size_t wn) {
+  unsigned char c = 0;
+  size_t i = 0;
+  for (; i < wn; i ++) c = _cv_sbb(c, v[i], w[i], &v[i]);
+  for (; c && i < vn; i ++) c = _cv_sbb(c, v[i], 0, &v[i]);
+}
+
+// Full 2n limb product
+static void _cv_limbs_mul_school(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) {
+  memset(r, 0, 2 * n * sizeof(uint64_t));
+  for (size_t i = 0; i < n; i ++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < n; j ++) {
+      _cv_u128 t = (_cv_u128)x[i] * y[j] + r[i + j] + carry;
+      r[i + j] = (uint64_t)t;
+      carry = (uint64_t)(t >> 64);
+    }
+    r[i + n] = carry;
+  }
+}
+
+static size_t _cv_kara_tmp(size_t n) {
+  if (n < KNOB_ARITH_KARATSUBA) return 0;
+  size_t hi = n - n / 2;
+  return 4 * (hi + 1) + _cv_kara_tmp(hi + 1);
+}
+
+// Full 2n limb product: x = x1 B^h + x0, and the middle term comes from
+// (x0 + x1)(y0 + y1) - x0 y0 - x1 y1
+static void _cv_limbs_mul_kara(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n, uint64_t* tmp) {
+  if (n < KNOB_ARITH_KARATSUBA) {
+    _cv_limbs_mul_school(r, x, y, n);
+    return;
+  }
+  size_t h = n / 2, hi = n - h;
+  uint64_t* sx = tmp;
+  uint64_t* sy = sx + hi + 1;
+  uint64_t* z1 = sy + hi + 1;
+  uint64_t* next = z1 + 2 * (hi + 1);
+
+  memcpy(sx, x + h, hi * sizeof(uint64_t));
+  memcpy(sy, y + h, hi * sizeof(uint64_t));
+  sx[hi] = sy[hi] = 0;
+  _cv_limbs_add_at(sx, hi + 1, 0, x, h);
+  _cv_limbs_add_at(sy, hi + 1, 0, y, h);
+  _cv_limbs_mul_kara(z1, sx, sy, hi + 1, next);
+
+  _cv_limbs_mul_kara(r, x, y, h, next);
+  _cv_limbs_mul_kara(r + 2 * h, x + h, y + h, hi, next);
+  _cv_limbs_sub_from(z1, 2 * (hi + 1), r, 2 * h);
+  _cv_limbs_sub_from(z1, 2 * (hi + 1), r + 2 * h, 2 * hi);
+  _cv_limbs_add_at(r, 2 * n, h, z1, 2 * (hi + 1));
+}
+
+void cv_limbs_mul(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n, uint64_t* tmp) {
+  if (n >= KNOB_ARITH_KARATSUBA) {
+    _cv_limbs_mul_kara(tmp, x, y, n, tmp + 2 * n);
+    memcpy(r, tmp, n * sizeof(uint64_t));
+    return;
+  }
+  // Only the products landing in the low n limbs
+  memset(r, 0, n * sizeof(uint64_t));
+  for (size_t i = 0; i < n; i ++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; i + j < n; j ++) {
+      _cv_u128 t = (_cv_u128)x[i] * y[j] + r[i + j] + carry;
+      r[i + j] = (uint64_t)t;
+      carry = (uint64_t)(t >> 64);
+    }
+  }
+}
+
+static size_t _cv_limbs_len(uint64_t const* x, size_t n) {
+  while (n && !x[n - 1]) n --;
+  return n;
+}
+
+bool cv_limbs_divmod(uint64_t* q, uint64_t* m, uint64_t const* x, uint64_t const* y, size_t n, uint64_t* tmp) {
+  size_t yn = _cv_limbs_len(y, n);
+  size_t xn = _cv_limbs_len(x, n);
+  if (!yn) return false;
+  memset(q, 0, n * sizeof(uint64_t));
+  memset(m, 0, n * sizeof(uint64_t));
+
+  if (xn < yn || (xn == yn && cv_limbs_cmp(x, y, xn) < 0)) {
+    memcpy(m, x, n * sizeof(uint64_t));
+    return true;
+  }
+  if (yn == 1) {
+    uint64_t rem = 0;
+    for (size_t i = xn; i-- > 0;) {
+      _cv_u128 t = (_cv_u128)rem << 64 | x[i];
+      q[i] = (uint64_t)(t / y[0]);
+      rem = (uint64_t)(t % y[0]);
+    }
+    m[0] = rem;
+    return true;
+  }
+
+  // Normalize so the divisor's top limb has its top bit set
+  unsigned s = __builtin_clzll(y[yn - 1]);
+  uint64_t* vn = tmp;
+  uint64_t* un = tmp + yn;
+  for (size_t i = yn; i-- > 0;) vn[i] = (y[i] << s) | (s && i ? y[i - 1] >> (64 - s) : 0);
+  un[xn] = s ? x[xn - 1] >> (64 - s) : 0;
+  for (size_t i = xn; i-- > 0;) un[i] = (x[i] << s) | (s && i ? x[i - 1] >> (64 - s) : 0);
+
+  for (size_t j = xn - yn + 1; j-- > 0;) {
+    _cv_u128 num = (_cv_u128)un[j + yn] << 64 | un[j + yn - 1];
+    _cv_u128 qhat = num / vn[yn - 1];
+    _cv_u128 rhat = num % vn[yn - 1];
+    while (qhat >> 64 || qhat * vn[yn - 2] > (rhat << 64 | un[j + yn - 2])) {
+      qhat --;
+      rhat += vn[yn - 1];
+      if (rhat >> 64) break;
+    }
+
+    // un[j..j+yn] -= qhat * vn
+    uint64_t carry = 0;
+    unsigned char borrow = 0;
+    for (size_t i = 0; i < yn; i ++) {
+      _cv_u128 p = qhat * vn[i] + carry;
+      carry = (uint64_t)(p >> 64);
+      borrow = _cv_sbb(borrow, un[i + j], (uint64_t)p, &un[i + j]);
+    }
+    borrow = _cv_sbb(borrow, un[j + yn], carry, &un[j + yn]);
+
+    // One too many, add the divisor back
+    if (borrow) {
+      qhat --;
+      unsigned char c = 0;
+      for (size_t i = 0; i < yn; i ++) c = _cv_adc(c, un[i + j], vn[i], &un[i + j]);
+      un[j + yn] += c;
+    }
+    q[j] = (uint64_t)qhat;
+  }
+
+  for (size_t i = 0; i < yn; i ++) m[i] = (un[i] >> s) | (s ? un[i + 1] << (64 - s) : 0);
+  return true;
+}
+
+void cv_limbs_shl(uint64_t* r, uint64_t const* x, size_t n, uint64_t amount) {
+  size_t ls = amount / 64 < n ? (size_t)(amount / 64) : n;
+  unsigned bs = amount % 64;
+  for (size_t i = n; i-- > 0;) {
+    uint64_t hi = i >= ls ? x[i - ls] << bs : 0;
+    uint64_t lo = bs && i >= ls + 1 ? x[i - ls - 1] >> (64 - bs) : 0;
+    r[i] = hi | lo;
+  }
+}
+
+void cv_limbs_shr(uint64_t* r, uint64_t const* x, size_t n, uint64_t amount) {
+  size_t ls = amount / 64 < n ? (size_t)(amount / 64) : n;
+  unsigned bs = amount % 64;
+  for (size_t i = 0; i < n; i ++) {
+    uint64_t lo = i + ls < n ? x[i + ls] >> bs : 0;
+    uint64_t hi = bs && i + ls + 1 < n ? x[i + ls + 1] << (64 - bs) : 0;
+    r[i] = hi | lo;
+  }
+}
+
+size_t cv_arith_tmp(uint32_t width) {
+  size_t n = CV_WORDS(width);
+  // cv_vec4_mul: n product limbs, then cv_limbs_mul's 2n and Karatsuba's
+  size_t mul = 3 * n + _cv_kara_tmp(n);
+  // _cv_vec4_divmod: q and m, then up to yn + xn + 1 normalized limbs
+  size_t div = 4 * n + 1;
+  return mul > div ? mul : div;
+}
+
+// All x when an operand has x/z
+static bool _cv_arith_unknown(cv_vec4* r, cv_vec4* x, cv_vec4* y) {
+  if (x->flags & y->flags & CV_VEC_2STATE) return false;
+  if (!cv_vec4_has_xz(x) && !cv_vec4_has_xz(y)) return false;
+  cv_vec4_fill(r, CV_BIT_X);
+  return true;
+}
+
+static void _cv_arith_done(cv_vec4* r) {
+  size_t n = CV_WORDS(r->width);
+  cv_vec4_aval(r)[n - 1] &= cv_vec4_top_mask(r->width);
+  memset(cv_vec4_bval(r), 0, n * sizeof(uint64_t));
+  r->flags |= CV_VEC_2STATE;
+}
+
+void cv_vec4_add(cv_vec4* r, cv_vec4* x, cv_vec4* y) {
+  if (_cv_arith_unknown(r, x, y)) return;
+  if (cv_vec4_is_small(r)) r->small.a = x->small.a + y->small.a;
+  else cv_limbs_add(r->words, x->words, y->words, CV_WORDS(r->width));
+  _cv_arith_done(r);
+}
+
+void cv_vec4_sub(cv_vec4* r, cv_vec4* x, cv_vec4* y) {
+  if (_cv_arith_unknown(r, x, y)) return;
+  if (cv_vec4_is_small(r)) r->small.a = x->small.a - y->small.a;
+  else cv_limbs_sub(r->words, x->words, y->words, CV_WORDS(r->width));
+  _cv_arith_done(r);
+}
+
+void cv_vec4_mul(cv_vec4* r, cv_vec4* x, cv_vec4* y, uint64_t* tmp) {
+  if (_cv_arith_unknown(r, x, y)) return;
+  if (cv_vec4_is_small(r)) {
+    r->small.a = x->small.a * y->small.a;
+  } else {
+    // The product goes through tmp so r may alias
+    size_t n = CV_WORDS(r->width);
+    cv_limbs_mul(tmp, x->words, y->words, n, tmp + n);
+    memcpy(r->words, tmp, n * sizeof(uint64_t));
+  }
+  _cv_arith_done(r);
+}
+
+static void _cv_vec4_divmod(cv_vec4* r, cv_vec4* x, cv_vec4* y, uint64_t* tmp, bool want_mod) {
+  if (_cv_arith_unknown(r, x, y)) return;
+  if (cv_vec4_is_small(r)) {
+    if (!y->small.a) {
+      cv_vec4_fill(r, CV_BIT_X);
+      return;
+    }
+    r->small.a = want_mod ? x->small.a % y->small.a : x->small.a / y->small.a;
+    _cv_arith_done(r);
+    return;
+  }
+  size_t n = CV_WORDS(r->width);
+  uint64_t* q = tmp;
+  uint64_t* m = tmp + n;
+  if (!cv_limbs_divmod(q, m, x->words, y->words, n, tmp + 2 * n)) {
+    cv_vec4_fill(r, CV_BIT_X);
+    return;
+  }
+  memcpy(r->words, want_mod ? m : q, n * sizeof(uint64_t));
+  _cv_arith_done(r);
+}
+
+void cv_vec4_div(cv_vec4* r, cv_vec4* x, cv_vec4* y, uint64_t* tmp) {
+  _cv_vec4_divmod(r, x, y, tmp, false);
+}
+
+void cv_vec4_mod(cv_vec4* r, cv_vec4* x, cv_vec4* y, uint64_t* tmp) {
+  _cv_vec4_divmod(r, x, y, tmp, true);
+}
+
+cv_bit cv_vec4_ge(cv_vec4* x, cv_vec4* y) {
+  cv_bit lt = cv_vec4_lt(x, y);
+  return lt == CV_BIT_X ? CV_BIT_X : lt == CV_BIT_1 ? CV_BIT_0 : CV_BIT_1;
+}
+
+cv_bit cv_vec4_gt(cv_vec4* x, cv_vec4* y) {
+  return cv_vec4_lt(y, x);
+}
+
+cv_bit cv_vec4_eeq(cv_vec4* x, cv_vec4* y) {
+  return cv_vec4_identical(x, y) ? CV_BIT_1 : CV_BIT_0;
+}
+
+// The shift amount, or false when unknown. Amounts past 2^64 saturate.
+static bool _cv_shift_amount(cv_vec4* amount, uint64_t* out) {
+  if (cv_vec4_has_xz(amount)) return false;
+  uint64_t* a = cv_vec4_aval(amount);
+  *out = a[0];
+  for (size_t i = 1; i < CV_WORDS(amount->width); i ++) {
+    if (a[i]) *out = UINT64_MAX;
+  }
+  return true;
+}
+
+static void _cv_vec4_shift(cv_vec4* r, cv_vec4* x, cv_vec4* amount, bool left) {
+  uint64_t s;
+  if (!_cv_shift_amount(amount, &s)) {
+    cv_vec4_fill(r, CV_BIT_X);
+    return;
+  }
+  size_t n = CV_WORDS(r->width);
+  uint32_t flags = x->flags;
+  if (cv_vec4_is_small(r)) {
+    uint64_t a = s >= 64 ? 0 : left ? x->small.a << s : x->small.a >> s;
+    uint64_t b = s >= 64 ? 0 : left ? x->small.b << s : x->small.b >> s;
+    r->small.a = a & cv_vec4_top_mask(r->width);
+    r->small.b = b & cv_vec4_top_mask(r->width);
+  } else {
+    void (*shift)(uint64_t*, uint64_t const*, size_t, uint64_t) = left ? cv_limbs_shl : cv_limbs_shr;
+    shift(cv_vec4_aval(r), cv_vec4_aval(x), n, s);
+    shift(cv_vec4_bval(r), cv_vec4_bval(x), n, s);
+    cv_vec4_aval(r)[n - 1] &= cv_vec4_top_mask(r->width);
+    cv_vec4_bval(r)[n - 1] &= cv_vec4_top_mask(r->width);
+  }
+  // Zeros shift in, so a two state value stays one
+  r->flags = flags;
+  if (!(r->flags & CV_VEC_2STATE)) cv_vec4_refresh_2state(r);
+}
+
+void cv_vec4_shl(cv_vec4* r, cv_vec4* x, cv_vec4* amount) {
+  _cv_vec4_shift(r, x, amount, true);
+}
+
+void cv_vec4_shr(cv_vec4* r, cv_vec4* x, cv_vec4* amount) {
+  _cv_vec4_shift(r, x, amount, false);
+}
+
+#endif
+
+#ifdef CVARITH_UT
+
+void cvarith_unit_test() {
+  crena_arena arena = crena_init_growing();
+
+  // 128 bits against the compiler's __int128
+  bool ok128 = true;
+  uint64_t s = 0x243f6a8885a308d3ULL;
+  uint64_t tmp[64];
+  for (size_t i = 0; i < 2000; i ++) {
+    uint64_t w[4];
+    for (size_t k = 0; k < 4; k ++) {
+      s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+      w[k] = s;
+    }
+    if (i % 3 == 0) w[3] = 0;
+    if (i % 5 == 0) w[2] >>= 40;
+    _cv_u128 x = (_cv_u128)w[1] << 64 | w[0];
+    _cv_u128 y = (_cv_u128)w[3] << 64 | w[2];
+    uint64_t r[2], q[2], m[2];
+    cv_limbs_add(r, w, w + 2, 2);
+    ok128 = ok128 && ((_cv_u128)r[1] << 64 | r[0]) == x + y;
+    cv_limbs_sub(r, w, w + 2, 2);
+    ok128 = ok128 && ((_cv_u128)r[1] << 64 | r[0]) == x - y;
+    cv_limbs_mul(r, w, w + 2, 2, tmp);
+    ok128 = ok128 && ((_cv_u128)r[1] << 64 | r[0]) == x * y;
+    if (y && cv_limbs_divmod(q, m, w, w + 2, 2, tmp)) {
+      ok128 = ok128 && ((_cv_u128)q[1] << 64 | q[0]) == x / y && ((_cv_u128)m[1] << 64 | m[0]) == x % y;
+    }
+    unsigned sh = w[2] % 130;
+    cv_limbs_shl(r, w, 2, sh);
+    ok128 = ok128 && ((_cv_u128)r[1] << 64 | r[0]) == (sh < 128 ? x << sh : 0);
+    cv_limbs_shr(r, w, 2, sh);
+    ok128 = ok128 && ((_cv_u128)r[1] << 64 | r[0]) == (sh < 128 ? x >> sh : 0);
+  }
+  printf("128 bit add/sub/mul/div/mod/shift match __int128? %s\n", ok128 ? "yes" : "no");
+
+  // 1024 bits: Karatsuba against schoolbook, and x == q * y + m with m < y
+  enum { N = 16 };
+  uint64_t* ktmp = crena_alloc(&arena, cv_arith_tmp(N * 64) * sizeof(uint64_t));
+  bool kara = true, div = true;
+  for (size_t i = 0; i < 50; i ++) {
+    uint64_t x[N], y[N], full[2 * N], ref[2 * N], q[N], m[N], back[N];
+    for (size_t k = 0; k < N; k ++) {
+      s ^= s << 13; s ^= s >> 7; s ^= s << 17; x[k] = s;
+      s ^= s << 13; s ^= s >> 7; s ^= s << 17; y[k] = s;
+    }
+    if (i % 2) memset(y + 1 + i % N, 0, (N - 1 - i % N) * sizeof(uint64_t));
+    if (i % 7 == 0) x[N - 1] = y[N - 1] = ~0ULL;
+    _cv_limbs_mul_kara(full, x, y, N, ktmp);
+    _cv_limbs_mul_school(ref, x, y, N);
+    kara = kara && memcmp(full, ref, sizeof(full)) == 0;
+
+    div = div && cv_limbs_divmod(q, m, x, y, N, ktmp);
+    cv_limbs_mul(back, q, y, N, ktmp);
+    cv_limbs_add(back, back, m, N);
+    div = div && memcmp(back, x, sizeof(x)) == 0 && cv_limbs_cmp(m, y, N) < 0;
+  }
+  printf("1024 bit Karatsuba matches schoolbook? %s, division checks out? %s\n",
+         kara ? "yes" : "no", div ? "yes" : "no");
+
+  // x/z poisons arithmetic, a zero divisor too, shifts carry x along
+  cv_vec4 a, b, r;
+  cv_vec4_init(&a, 200, &arena);
+  cv_vec4_init(&b, 200, &arena);
+  cv_vec4_init(&r, 200, &arena);
+  cv_vec4_set_u64(&a, 1000);
+  cv_vec4_set_u64(&b, 0);
+  cv_vec4_div(&r, &a, &b, ktmp);
+  bool xs = cv_vec4_get_bit(&r, 0) == CV_BIT_X && cv_vec4_get_bit(&r, 199) == CV_BIT_X;
+  cv_vec4_set_bit(&b, 3, CV_BIT_Z);
+  cv_vec4_add(&r, &a, &b);
+  xs = xs && cv_vec4_get_bit(&r, 100) == CV_BIT_X && cv_vec4_ge(&a, &b) == CV_BIT_X;
+  cv_vec4 amount;
+  cv_vec4_init(&amount, 8, &arena);
+  cv_vec4_set_u64(&amount, 130);
+  cv_vec4_shl(&r, &b, &amount);
+  xs = xs && cv_vec4_get_bit(&r, 133) == CV_BIT_Z && cv_vec4_get_bit(&r, 3) == CV_BIT_0;
+  printf("x/z and divide by zero give x, shifts move z along? %s\n", xs ? "yes" : "no");
+
+  // The wrappers stay inside cv_arith_tmp(width): a canary right after it
+  bool fits = true;
+  uint32_t widths[] = { 128, 192, 512, 1024, 1000 };
+  for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i ++) {
+    size_t nt = cv_arith_tmp(widths[i]);
+    uint64_t* t = crena_alloc(&arena, (nt + 1) * sizeof(uint64_t));
+    t[nt] = 0x5ca1ab1e5ca1ab1eULL;
+    cv_vec4 p, q, o;
+    cv_vec4_init(&p, widths[i], &arena);
+    cv_vec4_init(&q, widths[i], &arena);
+    cv_vec4_init(&o, widths[i], &arena);
+    cv_vec4_set_u64(&p, 0);
+    cv_vec4_set_u64(&q, 0x1234567);
+    for (uint32_t k = 0; k < widths[i]; k += 3) cv_vec4_set_bit(&p, k, CV_BIT_1);
+    for (uint32_t k = 64; k < widths[i] - 1; k += 5) cv_vec4_set_bit(&q, k, CV_BIT_1);
+    cv_vec4_mul(&o, &p, &q, t);
+    cv_vec4_div(&o, &p, &q, t);
+    cv_vec4_mod(&o, &p, &q, t);
+    fits = fits && t[nt] == 0x5ca1ab1e5ca1ab1eULL;
+  }
+  printf("mul/div/mod keep within cv_arith_tmp? %s\n", fits ? "yes" : "no");
+
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "crena.h"
+#include "cvvec.h"
+#include "cvnet.h"
+
+// Native code for an elaborated netlist.
+// cv_jit_compile writes the levelized net out as one C function that walks
+// the dirty bitset slot by slot like cv_net_settle does, with every node's
+// operation, inputs, widths and fanout bits spelled out as constants.
+// It is built with the system cc into a shared object, dlopen'ed and hung
+// on the net's `compiled` hook, so later settles run without interpreting
+// ops. Values are reached as fixed offsets into the node array and use the
+// same four state formulas as cvvec, so results, evaluation and change
+// counts stay identical to the interpreter.
+// The objects are cached under a directory by the hash of the generated
+// source, which covers the whole design and the node layout; a rerun of
+// the same design loads the cached object without compiling.
+// The default cache is per user, $XDG_CACHE_HOME/cvp-jit or
+// ~/.cache/cvp-jit, created 0700. Since a cached object gets run, the
+// directory and the object must be ours and writable by nobody else, or
+// nothing is loaded.
+// Only nets that are levelized, loop free, at most 64 bits wide and made
+// of the gate ops are compiled; anything else stays interpreted.
+
+#ifndef KNOB_JIT_CC
+#define KNOB_JIT_CC "cc"
+#endif
+
+#ifndef KNOB_JIT_CFLAGS
+#define KNOB_JIT_CFLAGS "-O2"
+#endif
+
+#ifndef KNOB_JIT_CACHE_NAME
+#define KNOB_JIT_CACHE_NAME "cvp-jit"
+#endif
+
+typedef struct {
+  void* handle;
+  uint64_t hash;
+  bool cached;
+} cv_jit;
+
+// Fails, leaving the net interpreted, when the net is not supported or cc
+// or dlopen fails, or the cache is not private. dir NULL is the per user
+// KNOB_JIT_CACHE_NAME directory.
+bool cv_jit_compile(cv_jit* jit, cv_net* net, char const* dir);
+void cv_jit_release(cv_jit* jit, cv_net* net);
+
+#ifdef CVJIT_IMPLEMENTATION
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static bool _cv_jit_supported(cv_net* net) {
+  if (net->mode != CV_EVAL_LEVELIZED || !net->level_start || net->par) return false;
+  // The generated settle does not mark domains for flops or watches
+  if (crena_da_len(net->domains)) return false;
+  for (size_t i = 0; i < cv_net_len(net); i ++) {
+    cv_node* node = cv_net_node(net, i);
+    if (node->level == CV_NO_LEVEL || node->value.width > 64) return false;
+    if (node->op == CV_OP_FUSED || node->op == CV_OP_NONE || node->op == CV_OP_VAR || node->op == CV_OP_CONST) continue;
+    if (!_cv_op_evaluates(node->op)) return false;
+  }
+  return true;
+}
+
+// Input k of an op at the given width into x<k>a/x<k>b. src is "V(id)" or
+// a step's locals, or NULL when unconnected.
+static void _cv_jit_emit_in(FILE* out, uint32_t k, char const* a, char const* b, uint32_t src_width, uint32_t width) {
+  uint64_t m = cv_vec4_top_mask(width);
+  if (!a) {
+    fprintf(out, "      uint64_t x%ua = 0x%llxULL, x%ub = 0x%llxULL;\n", k, (unsigned long long)m, k, (unsigned long long)m);
+  } else if (src_width > width) {
+    fprintf(out, "      uint64_t x%ua = %s & 0x%llxULL, x%ub = %s & 0x%llxULL;\n",
+            k, a, (unsigned long long)m, k, b, (unsigned long long)m);
+  } else {
+    fprintf(out, "      uint64_t x%ua = %s, x%ub = %s;\n", k, a, k, b);
+  }
+}
+
+// a/b = op(x0..), the same word formulas as cvvec
+static void _cv_jit_emit_op(FILE* out, cv_op op, uint32_t n_in, uint32_t width) {
+  unsigned long long m = cv_vec4_top_mask(width);
+  fprintf(out, "      a = x0a; b = x0b;\n");
+  switch (op) {
+  case CV_OP_BUF:
+    fprintf(out, "      a |= b;\n");
+    break;
+  case CV_OP_NOT:
+    fprintf(out, "      a = (~a | b) & 0x%llxULL;\n", m);
+    break;
+  case CV_OP_AND:
+  case CV_OP_NAND:
+    for (uint32_t k = 1; k < n_in; k ++) {
+      fprintf(out, "      { uint64_t t = (a | b) & (x%ua | x%ub); b = t & (b | x%ub); a = t; }\n", k, k, k);
+    }
+    if (op == CV_OP_NAND) fprintf(out, "      a = (~a | b) & 0x%llxULL;\n", m);
+    break;
+  case CV_OP_OR:
+  case CV_OP_NOR:
+    for (uint32_t k = 1; k < n_in; k ++) {
+      fprintf(out, "      { uint64_t t = a | b | x%ua | x%ub; b = t & ~((a & ~b) | (x%ua & ~x%ub)); a = t; }\n", k, k, k, k);
+    }
+    if (op == CV_OP_NOR) fprintf(out, "      a = (~a | b) & 0x%llxULL;\n", m);
+    break;
+  case CV_OP_XOR:
+  case CV_OP_XNOR:
+    for (uint32_t k = 1; k < n_in; k ++) fprintf(out, "      b |= x%ub; a = (a ^ x%ua) | b;\n", k, k);
+    if (op == CV_OP_XNOR) fprintf(out, "      a = (~a | b) & 0x%llxULL;\n", m);
+    break;
+  case CV_OP_MUXZ:
+    if (n_in < 2) {
+      fprintf(out, "      a = b = 0x%llxULL;\n", m);
+      break;
+    }
+    if (n_in > 2) fprintf(out, "      if (!(x2b & 1) && (x2a & 1)) { a = x1a; b = x1b; }\n      else if (x2b & 1)");
+    else fprintf(out, "     ");
+    fprintf(out, " { uint64_t g = ~x0b & ~x1b & ~(x0a ^ x1a); a = (~g | x0a) & 0x%llxULL; b = ~g & 0x%llxULL; }\n", m, m);
+    break;
+  default:
+    break;
+  }
+}
+
+static void _cv_jit_emit_node(FILE* out, cv_net* net, cv_node_id id) {
+  cv_node* node = cv_net_node(net, id);
+  uint32_t width = node->value.width;
+  char a[64], b[64];
+
+  if (node->fuse) {
+    cv_fuse* f = node->fuse;
+    size_t n = crena_da_len(f->steps);
+    for (size_t s = 0; s + 1 < n; s ++) fprintf(out, "      uint64_t s%zua, s%zub;\n", s, s);
+    for (size_t s = 0; s < n; s ++) {
+      cv_fuse_step* st = &f->steps[s];
+      fprintf(out, "      {\n");
+      for (uint32_t k = 0; k < st->n_in; k ++) {
+        uint32_t ref = st->in[k];
+        uint32_t src_width;
+        if (ref & CV_FUSE_STEP) {
+          snprintf(a, sizeof(a), "s%ua", ref & ~CV_FUSE_STEP);
+          snprintf(b, sizeof(b), "s%ub", ref & ~CV_FUSE_STEP);
+          src_width = f->steps[ref & ~CV_FUSE_STEP].width;
+        } else if (f->in[ref] == CV_NODE_NONE) {
+          _cv_jit_emit_in(out, k, NULL, NULL, 0, st->width);
+          continue;
+        } else {
+          snprintf(a, sizeof(a), "V(%u)->a", f->in[ref]);
+          snprintf(b, sizeof(b), "V(%u)->b", f->in[ref]);
+          src_width = cv_net_node(net, f->in[ref])->value.width;
+        }
+        _cv_jit_emit_in(out, k, a, b, src_width, st->width);
+      }
+      _cv_jit_emit_op(out, st->op, st->n_in, st->width);
+      if (s + 1 < n) fprintf(out, "      s%zua = a; s%zub = b;\n", s, s);
+      fprintf(out, "      }\n");
+    }
+    return;
+  }
+
+  uint32_t n_in = node->n_in ? node->n_in : 1;
+  for (uint32_t k = 0; k < n_in; k ++) {
+    cv_node_id src = node->in[k];
+    if (src == CV_NODE_NONE) {
+      _cv_jit_emit_in(out, k, NULL, NULL, 0, width);
+      continue;
+    }
+    snprintf(a, sizeof(a), "V(%u)->a", src);
+    snprintf(b, sizeof(b), "V(%u)->b", src);
+    _cv_jit_emit_in(out, k, a, b, cv_net_node(net, src)->value.width, width);
+  }
+  _cv_jit_emit_op(out, node->op, n_in, width);
+}
+
+static char* _cv_jit_source(cv_net* net, size_t* len) {
+  char* src = NULL;
+  FILE* out = open_memstream(&src, len);
+  if (!out) return NULL;
+
+  fprintf(out, "#include <stdint.h>\n#include <stddef.h>\n\n");
+  fprintf(out, "typedef struct { uint32_t width, flags; uint64_t a, b; } cv_jv;\n");
+  fprintf(out, "#define V(id) ((cv_jv*)(nodes + (size_t)(id) * %zu + %zu))\n\n",
+          sizeof(cv_node), offsetof(cv_node, value));
+  fprintf(out, "void cvjit_settle(char* nodes, uint64_t* d, size_t* counts) {\n");
+  fprintf(out, "  size_t evals = 0, two_state = 0, changes = 0;\n");
+
+  uint32_t lo = net->level_start[1], hi = net->level_start[net->n_levels];
+  for (uint32_t w = lo / 64; w < CV_WORDS(hi); w ++) {
+    fprintf(out, "  if (d[%u]) {\n", w);
+    for (uint32_t slot = w * 64 > lo ? w * 64 : lo; slot < hi && slot < (w + 1) * 64; slot ++) {
+      cv_node_id id = net->slot_node[slot];
+      cv_node* node = cv_net_node(net, id);
+      fprintf(out, "    if (d[%u] & 0x%llxULL) {\n      uint64_t a, b;\n", w, 1ULL << (slot % 64));
+      _cv_jit_emit_node(out, net, id);
+      fprintf(out, "      cv_jv* o = V(%u);\n", id);
+      fprintf(out, "      evals ++;\n      if (!b) two_state ++;\n");
+      fprintf(out, "      if (a != o->a || b != o->b) {\n");
+      fprintf(out, "        o->a = a; o->b = b;\n");
+      fprintf(out, "        o->flags = b ? o->flags & ~%uu : o->flags | %uu;\n", CV_VEC_2STATE, CV_VEC_2STATE);
+      fprintf(out, "        changes ++;\n");
+      for (size_t f = 0; f < crena_da_len(node->fanout); f ++) {
+        uint32_t to = net->slot_of[node->fanout[f]];
+        fprintf(out, "        d[%u] |= 0x%llxULL;\n", to / 64, 1ULL << (to % 64));
+      }
+      fprintf(out, "      }\n    }\n");
+    }
+    fprintf(out, "    d[%u] = 0;\n  }\n", w);
+  }
+
+  fprintf(out, "  counts[0] += evals;\n  counts[1] += two_state;\n  counts[2] += changes;\n}\n");
+  fclose(out);
+  return src;
+}
+
+// FNV-1a
+static uint64_t _cv_jit_hash(char const* s, size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i ++) h = (h ^ (uint8_t)s[i]) * 0x100000001b3ULL;
+  return h;
+}
+
+// The paths are the cache dir plus our own names, which the quotes keep
+// in one argument unless the dir itself holds a quote
+static bool _cv_jit_cc(char const* c_path, char const* so_path) {
+  if (strchr(c_path, '\'') || strchr(so_path, '\'')) return false;
+  char cmd[3 * 4096];
+  snprintf(cmd, sizeof(cmd), "%s %s -shared -fPIC -o '%s' '%s'", KNOB_JIT_CC, KNOB_JIT_CFLAGS, so_path, c_path);
+  return system(cmd) == 0;
+}
+
+// Ours, not a symlink, and not writable by group or others
+static bool _cv_jit_private(char const* path, bool is_dir) {
+  struct stat st;
+  if (lstat(path, &st) != 0) return false;
+  if (is_dir ? !S_ISDIR(st.st_mode) : !S_ISREG(st.st_mode)) return false;
+  return st.st_uid == geteuid() && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// $XDG_CACHE_HOME/<name>, or ~/.cache/<name> with ~/.cache made if needed
+static bool _cv_jit_default_dir(char* out, size_t size) {
+  char const* xdg = getenv("XDG_CACHE_HOME");
+  char const* home = getenv("HOME");
+  int n;
+  if (xdg && *xdg == '/') {
+    n = snprintf(out, size, "%s/%s", xdg, KNOB_JIT_CACHE_NAME);
+  } else if (home && *home == '/') {
+    n = snprintf(out, size, "%s/.cache", home);
+    if (n < 0 || (size_t)n >= size || (mkdir(out, 0700) != 0 && errno != EEXIST)) return false;
+    n = snprintf(out, size, "%s/.cache/%s", home, KNOB_JIT_CACHE_NAME);
+  } else {
+    return false;
+  }
+  return n >= 0 && (size_t)n < size;
+}
+
+bool cv_jit_compile(cv_jit* jit, cv_net* net, char const* dir) {
+  *jit = (cv_jit){0};
+  if (!_cv_jit_supported(net)) return false;
+  char dir_buf[2048];
+  if (!dir) {
+    if (!_cv_jit_default_dir(dir_buf, sizeof(dir_buf))) return false;
+    dir = dir_buf;
+  }
+  if (mkdir(dir, 0700) != 0 && errno != EEXIST) return false;
+  if (!_cv_jit_private(dir, true)) return false;
+
+  size_t len;
+  char* src = _cv_jit_source(net, &len);
+  if (!src) return false;
+  jit->hash = _cv_jit_hash(src, len);
+
+  char so_path[4096], c_path[4096], tmp_path[4096];
+  snprintf(so_path, sizeof(so_path), "%s/cvjit-%016llx.so", dir, (unsigned long long)jit->hash);
+  jit->cached = access(so_path, R_OK) == 0;
+  if (!jit->cached) {
+    // Built under a private name and renamed, so concurrent runs never
+    // load a half written object
+    snprintf(c_path, sizeof(c_path), "%s/cvjit-%016llx.%d.c", dir, (unsigned long long)jit->hash, (int)getpid());
+    snprintf(tmp_path, sizeof(tmp_path), "%s/cvjit-%016llx.%d.so", dir, (unsigned long long)jit->hash, (int)getpid());
+    FILE* f = fopen(c_path, "w");
+    bool ok = f && fwrite(src, 1, len, f) == len;
+    if (f) ok = fclose(f) == 0 && ok;
+    ok = ok && _cv_jit_cc(c_path, tmp_path) && rename(tmp_path, so_path) == 0;
+    unlink(c_path);
+    if (!ok) {
+      unlink(tmp_path);
+      free(src);
+      return false;
+    }
+  }
+  free(src);
+
+  if (!_cv_jit_private(so_path, false)) return false;
+  jit->handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+  if (!jit->handle) return false;
+  cv_net_compiled fn;
+  *(void**)&fn = dlsym(jit->handle, "cvjit_settle");
+  if (!fn) {
+    dlclose(jit->handle);
+    jit->handle = NULL;
+    return false;
+  }
+  net->compiled = fn;
+  return true;
+}
+
+void cv_jit_release(cv_jit* jit, cv_net* net) {
+  if (!jit->handle) return;
+  net->compiled = NULL;
+  dlclose(jit->handle);
+  jit->handle = NULL;
+}
+
+#endif
+
+#ifdef CVJIT_UT
+
+void cvjit_unit_test() {
+  crena_arena arena = crena_init_growing();
+  cv_net interp, native;
+  cv_node_id in_vars[4], nat_vars[4];
+  _cvnet_ut_build(&interp, &arena, CV_EVAL_LEVELIZED, true, in_vars);
+  _cvnet_ut_build(&native, &arena, CV_EVAL_LEVELIZED, true, nat_vars);
+
+  char dir[] = "/tmp/cvjit-ut-XXXXXX";
+  cv_jit jit, again;
+  bool ok = mkdtemp(dir) && cv_jit_compile(&jit, &native, dir);
+  printf("Compiled netlist %016llx? %s\n", (unsigned long long)jit.hash, ok ? "yes" : "no");
+
+  size_t in_base = interp.ctx.n_evals, nat_base = native.ctx.n_evals;
+  bool same = true;
+  uint64_t x = 0x6a09e667f3bcc908ULL;
+  for (size_t step = 0; ok && step < 200; step ++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    cv_vec4 v;
+    cv_vec4_init(&v, 8, &arena);
+    cv_vec4_set_u64(&v, x >> 32);
+    if (step % 16 == 5) cv_vec4_set_bit(&v, (x >> 8) % 8, CV_BIT_X);
+    if (step % 16 == 9) cv_vec4_set_bit(&v, (x >> 8) % 8, CV_BIT_Z);
+    cv_net_set(&interp, in_vars[x % 4], &v);
+    cv_net_set(&native, nat_vars[x % 4], &v);
+    cv_net_settle(&interp);
+    cv_net_settle(&native);
+    for (size_t i = 0; i < cv_net_len(&interp); i ++) {
+      cv_vec4* iv = &cv_net_node(&interp, i)->value;
+      cv_vec4* nv = &cv_net_node(&native, i)->value;
+      same = same && cv_vec4_identical(iv, nv) && iv->flags == nv->flags;
+    }
+  }
+  printf("Compiled values match interpreted? %s, same evaluations? %s\n", ok && same ? "yes" : "no",
+         interp.ctx.n_evals - in_base == native.ctx.n_evals - nat_base ? "yes" : "no");
+
+  // The same design again comes out of the cache
+  cv_net rebuilt;
+  cv_node_id rb_vars[4];
+  _cvnet_ut_build(&rebuilt, &arena, CV_EVAL_LEVELIZED, true, rb_vars);
+  bool cached = ok && cv_jit_compile(&again, &rebuilt, dir) && again.cached && again.hash == jit.hash;
+  printf("Same design loads from the cache? %s\n", cached ? "yes" : "no");
+  cv_jit_release(&again, &rebuilt);
+
+  // Someone else could have written a group writable object or one in a
+  // shared directory, neither is loaded
+  char so_path[4096];
+  snprintf(so_path, sizeof(so_path), "%s/cvjit-%016llx.so", dir, (unsigned long long)jit.hash);
+  chmod(so_path, 0664);
+  bool refused = !cv_jit_compile(&again, &rebuilt, dir);
+  chmod(so_path, 0755);
+  chmod(dir, 0777);
+  refused = refused && !cv_jit_compile(&again, &rebuilt, dir);
+  chmod(dir, 0700);
+  printf("Objects others could write are not loaded? %s\n", ok && refused ? "yes" : "no");
+  cv_jit_release(&jit, &native);
+
+  unlink(so_path);
+  rmdir(dir);
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
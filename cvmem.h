@@ -0,0 +1,216 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crena.h"
+#include "cvvec.h"
+
+// Verilog memories (.array). A word is its two planes, 2 * CV_WORDS(width)
+// u64s, stored xor'ed with the array's default (x, or 0 for two state
+// arrays), so all zero bytes read back as the default and a fresh array
+// needs no initialising pass.
+// Arrays up to KNOB_MEM_DENSE_BYTES come from the arena. Bigger ones
+// reserve their whole footprint as a MAP_NORESERVE anonymous mapping:
+// the kernel backs a page on its first write, and reads of untouched
+// words hit the shared zero page, so a full size DRAM model costs only
+// the pages the simulation actually writes.
+// Addresses outside the array read as the default and drop writes.
+
+#ifndef KNOB_MEM_DENSE_BYTES
+#define KNOB_MEM_DENSE_BYTES (1UL << 20)
+#endif
+
+typedef enum {
+  CV_MEM_AUTO,
+  CV_MEM_DENSE,
+  CV_MEM_SPARSE,
+} cv_mem_storage;
+
+typedef struct {
+  uint32_t width;
+  uint32_t stride;
+  int64_t first;
+  uint64_t n_words;
+  cv_bit fill;
+  bool sparse;
+  uint64_t* words;
+  size_t bytes;
+  size_t n_writes;
+} cv_mem;
+
+// Words first..last (either order) of width bits. False when the
+// footprint does not fit the address space or the reservation fails.
+bool cv_mem_init(cv_mem* m, uint32_t width, int64_t first, int64_t last, cv_bit fill,
+                 cv_mem_storage storage, crena_arena* arena);
+void cv_mem_release(cv_mem* m);
+// out takes the word at its own width, truncated or zero extended
+void cv_mem_read(cv_mem* m, int64_t addr, cv_vec4* out);
+void cv_mem_write(cv_mem* m, int64_t addr, cv_vec4* value);
+// Bytes backed by memory right now
+size_t cv_mem_resident(cv_mem* m);
+void cv_mem_report(cv_mem* m, char const* name, FILE* out);
+
+#ifdef CVMEM_IMPLEMENTATION
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool cv_mem_init(cv_mem* m, uint32_t width, int64_t first, int64_t last, cv_bit fill,
+                 cv_mem_storage storage, crena_arena* arena) {
+  *m = (cv_mem){0};
+  m->width = width ? width : 1;
+  m->stride = 2 * CV_WORDS(m->width);
+  m->first = first < last ? first : last;
+  // In unsigned, so first..last spanning all of int64 does not overflow
+  m->n_words = (first < last ? (uint64_t)last - (uint64_t)first : (uint64_t)first - (uint64_t)last) + 1;
+  m->fill = fill;
+  if (m->n_words == 0 || m->n_words > SIZE_MAX / (m->stride * sizeof(uint64_t))) return false;
+  m->bytes = m->n_words * m->stride * sizeof(uint64_t);
+  m->sparse = storage == CV_MEM_SPARSE || (storage == CV_MEM_AUTO && m->bytes > KNOB_MEM_DENSE_BYTES);
+  if (m->sparse) {
+    void* p = mmap(NULL, m->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return false;
+    m->words = p;
+  } else {
+    m->words = crena_alloc_aligned(arena, m->bytes, 64);
+    memset(m->words, 0, m->bytes);
+  }
+  return true;
+}
+
+void cv_mem_release(cv_mem* m) {
+  if (m->sparse && m->words) munmap(m->words, m->bytes);
+  m->words = NULL;
+}
+
+static uint64_t* _cv_mem_word(cv_mem* m, int64_t addr) {
+  if (addr < m->first || (uint64_t)(addr - m->first) >= m->n_words) return NULL;
+  return m->words + (uint64_t)(addr - m->first) * m->stride;
+}
+
+void cv_mem_read(cv_mem* m, int64_t addr, cv_vec4* out) {
+  uint64_t* w = _cv_mem_word(m, addr);
+  if (!w) {
+    cv_vec4_fill(out, m->fill);
+    return;
+  }
+  size_t n = m->stride / 2;
+  size_t on = CV_WORDS(out->width);
+  uint64_t fa = (m->fill & 1) ? ~0ULL : 0;
+  uint64_t fb = (m->fill & 2) ? ~0ULL : 0;
+  uint64_t* a = cv_vec4_aval(out);
+  uint64_t* b = cv_vec4_bval(out);
+  for (size_t i = 0; i < on; i ++) {
+    // Bits past the word's width are zero extension
+    uint64_t mask = i < n - 1 ? ~0ULL : i == n - 1 ? cv_vec4_top_mask(m->width) : 0;
+    a[i] = i < n ? (w[i] ^ fa) & mask : 0;
+    b[i] = i < n ? (w[n + i] ^ fb) & mask : 0;
+  }
+  a[on - 1] &= cv_vec4_top_mask(out->width);
+  b[on - 1] &= cv_vec4_top_mask(out->width);
+  cv_vec4_refresh_2state(out);
+}
+
+void cv_mem_write(cv_mem* m, int64_t addr, cv_vec4* value) {
+  uint64_t* w = _cv_mem_word(m, addr);
+  if (!w) return;
+  size_t n = m->stride / 2;
+  size_t vn = CV_WORDS(value->width);
+  uint64_t fa = (m->fill & 1) ? ~0ULL : 0;
+  uint64_t fb = (m->fill & 2) ? ~0ULL : 0;
+  uint64_t* a = cv_vec4_aval(value);
+  uint64_t* b = cv_vec4_bval(value);
+  for (size_t i = 0; i < n; i ++) {
+    uint64_t mask = i == n - 1 ? cv_vec4_top_mask(m->width) : ~0ULL;
+    w[i] = ((i < vn ? a[i] : 0) & mask) ^ fa;
+    w[n + i] = ((i < vn ? b[i] : 0) & mask) ^ fb;
+  }
+  m->n_writes ++;
+}
+
+size_t cv_mem_resident(cv_mem* m) {
+  if (!m->sparse) return m->bytes;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t n_pages = (m->bytes + page - 1) / page;
+  size_t resident = 0;
+  unsigned char vec[4096];
+  for (size_t p = 0; p < n_pages; p += sizeof(vec)) {
+    size_t chunk = n_pages - p < sizeof(vec) ? n_pages - p : sizeof(vec);
+    if (mincore((char*)m->words + p * page, chunk * page, vec) != 0) break;
+    for (size_t i = 0; i < chunk; i ++) resident += vec[i] & 1;
+  }
+  return resident * page;
+}
+
+void cv_mem_report(cv_mem* m, char const* name, FILE* out) {
+  fprintf(out, "array %s: %llu words of %u bits, %s, %zu writes, %zu of %zu KiB resident\n", name,
+          (unsigned long long)m->n_words, m->width, m->sparse ? "sparse" : "dense", m->n_writes,
+          cv_mem_resident(m) / 1024, m->bytes / 1024);
+}
+
+#endif
+
+#ifdef CVMEM_UT
+
+void cvmem_unit_test() {
+  crena_arena arena = crena_init_growing();
+
+  // A small four state array reads x until written, out of range too
+  cv_mem small;
+  cv_mem_init(&small, 12, 15, 0, CV_BIT_X, CV_MEM_AUTO, &arena);
+  cv_vec4 v, r;
+  cv_vec4_init(&v, 12, &arena);
+  cv_vec4_init(&r, 12, &arena);
+  cv_vec4_set_str(&v, "10zx01010011", 12);
+  cv_mem_write(&small, 7, &v);
+  cv_mem_write(&small, 16, &v);
+  char s[16], t[16], u[16];
+  cv_mem_read(&small, 7, &r);
+  cv_vec4_to_str(&r, s);
+  cv_mem_read(&small, 6, &r);
+  cv_vec4_to_str(&r, t);
+  cv_mem_read(&small, 16, &r);
+  cv_vec4_to_str(&r, u);
+  printf("Dense array reads back %s, x untouched, x out of range? %s\n", s,
+         !small.sparse && strcmp(s, "10zx01010011") == 0 && strcmp(t, "xxxxxxxxxxxx") == 0 &&
+         strcmp(u, "xxxxxxxxxxxx") == 0 ? "yes" : "no");
+
+  // 2^28 words of 100 bits is 8 GiB of address space; a thousand
+  // scattered writes must only back a thousand pages or so
+  cv_mem big;
+  bool reserved = cv_mem_init(&big, 100, 0, (1LL << 28) - 1, CV_BIT_0, CV_MEM_AUTO, &arena);
+  bool sparse_ok = reserved && big.sparse;
+  if (reserved) {
+    cv_vec4 w, back;
+    cv_vec4_init(&w, 100, &arena);
+    cv_vec4_init(&back, 100, &arena);
+    uint64_t x = 0x853c49e6748fea9bULL;
+    for (size_t i = 0; i < 1000; i ++) {
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      cv_vec4_set_u64(&w, x);
+      cv_vec4_set_bit(&w, 99, CV_BIT_1);
+      cv_mem_write(&big, (int64_t)(x >> 36), &w);
+      cv_mem_read(&big, (int64_t)(x >> 36), &back);
+      sparse_ok = sparse_ok && cv_vec4_identical(&w, &back);
+    }
+    cv_mem_read(&big, 12345, &back);
+    sparse_ok = sparse_ok && !cv_vec4_has_xz(&back) && cv_vec4_aval(&back)[0] == 0;
+    sparse_ok = sparse_ok && cv_mem_resident(&big) <= 1100 * (size_t)sysconf(_SC_PAGESIZE);
+    cv_mem huge;
+    sparse_ok = sparse_ok && !cv_mem_init(&huge, 64, 0, (1LL << 62), CV_BIT_0, CV_MEM_AUTO, &arena) &&
+                !cv_mem_init(&huge, 8, INT64_MIN, INT64_MAX, CV_BIT_0, CV_MEM_AUTO, &arena);
+    printf("Sparse array of %zu MiB keeps %zu KiB resident after 1000 writes? %s\n",
+           big.bytes >> 20, cv_mem_resident(&big) >> 10, sparse_ok ? "yes" : "no");
+    cv_mem_release(&big);
+  } else {
+    printf("Sparse array reserved? no\n");
+  }
+
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
@@ -0,0 +1,2142 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "crena.h"
+#include "cvvec.h"
+#include "cvarith.h"
+#include "cvstrength.h"
+
+// Netlist of the structural part of a vvp module: vars, nets, constants
+// and functors, each node holding its current value.
+// Nodes are added first and connected afterwards, since vvp refers to
+// labels before they are declared. Evaluation has two modes:
+//  - event driven: a changed node queues its fanout, which is evaluated in
+//    FIFO order. Reconvergent paths make nodes evaluate several times per
+//    delta while their inputs glitch.
+//  - levelized: cv_net_elaborate sorts the zero-delay functor graph into
+//    levels once and numbers the nodes by level, then by index, into
+//    slots. Dirty nodes are bits of a bitset over the slots, and a settle
+//    is one upward scan of it: fanout always lands on a later slot, so
+//    each node evaluates at most once, and the nodes of a level go in
+//    index order. Nodes on a combinational loop get no level and fall
+//    back to the event queue.
+// In both modes a node only schedules its fanout when its value changed.
+// A levelized net can also settle on several threads (cv_net_set_threads).
+// Each level is then one parallel round: the nodes are partitioned over
+// the workers, each with its own dirty bitset over the slots. A worker
+// evaluates its dirty nodes of the round's level and posts fanout owned
+// by others into per worker mailboxes. A barrier
+// ends the round, the owners take in their mailboxes, and a second
+// barrier agrees on the next dirty level. A node still evaluates exactly
+// once with the same inputs as in serial mode, so values are identical.
+// The barriers spin since rounds are short, but between settles the
+// workers sleep on a condition variable until the next settle bumps the
+// start generation, so no core stays busy while nothing settles.
+// Loop nodes stay with the calling thread between parallel sweeps.
+// Elaboration first fuses functors whose only reader is another functor
+// into it (KNOB_NET_FUSE). The reader becomes a FUSED node running a
+// short program of steps over the union of their inputs, and the absorbed
+// node is left as NONE. Chains and trees of iverilog's split up 4 input
+// gates collapse into one node with one event and one fanout list.
+// Flip-flops (DFF: d, clock, enable, async) are sources like vars, so
+// feedback through them is no loop. Elaboration groups them into clock
+// domains by clock node and edge, plus a level domain per async
+// set/clear node. A domain's trigger changing marks it; after the
+// combinational sweep every marked domain that saw its edge samples the
+// D of all its flops, and only then are all Q committed, so a register
+// file or shift chain updates as one nonblocking batch. Latches (LATCH:
+// d, enable) are ordinary nodes holding their value while the enable is
+// low; an enable edge touches all of them and the level sweep takes
+// them together.
+// Watches (cv_net_watch) join the same domains to report an edge or any
+// change of a node to the net's on_event hook, which is how vvp's edge
+// .event functors wake threads. Watched nodes are never fused or folded
+// away.
+// Arithmetic, compare and shift nodes (ADD .. SHR: a, b) evaluate with
+// the cvarith.h kernels. Compares take both inputs at the wider of their
+// widths and give one bit, a shift keeps its amount at its own width.
+// Multiply driven nets (RESOLV, up to four drivers) resolve per bit by
+// strength with the cvstrength.h codes. A driver contributes its value
+// at its node's drive strengths, or the codes of a RESOLV feeding it, so
+// vvp's chained resolvers keep per bit strengths. All z drivers are
+// skipped and a single active one is taken over without folding. A node
+// whose strengths changed counts as changed even if its value did not.
+// Part selects, concatenations, repeats and substitutions are VIEW
+// nodes: a list of segments, each a run of bits taken from an input or a
+// constant fill, copied with the cvvec bit range kernels. Elaboration
+// (along with fusion) folds a view read by another view into its reader's segments, so a
+// chain of slices reads its sources directly, and a view left with no
+// reader is dropped (NONE). Only views read by other nodes keep their
+// bits in a vector.
+// A levelized, loop free net can also settle through native code that
+// cvjit.h generates for it: the `compiled` hook takes over the scan of the
+// serial dirty bitset with the same evaluations and counters.
+// cv_lanes runs a levelized, loop free net in two states for many
+// stimuli at once: every bit of a node is a row of n_lanes bits, one lane
+// per independent run, and each node is evaluated with the cvvec two
+// state word kernels over all its rows, 64 lanes per word and AVX2 over
+// groups of 256.
+
+#ifndef KNOB_NET_LEVELIZE
+#define KNOB_NET_LEVELIZE 1
+#endif
+
+#ifndef KNOB_NET_FUSE
+#define KNOB_NET_FUSE 1
+#endif
+
+#ifndef KNOB_NET_FUSE_MAX_STEPS
+#define KNOB_NET_FUSE_MAX_STEPS 16
+#endif
+
+#ifndef KNOB_NET_FUSE_MAX_IN
+#define KNOB_NET_FUSE_MAX_IN 16
+#endif
+
+#ifndef KNOB_NET_VIEW_MAX_SEGS
+#define KNOB_NET_VIEW_MAX_SEGS 64
+#endif
+
+#ifndef KNOB_NET_BARRIER_SPINS
+#define KNOB_NET_BARRIER_SPINS 4096
+#endif
+
+#define CV_NODE_MAX_IN 4
+#define CV_NODE_NONE UINT32_MAX
+#define CV_NO_LEVEL UINT32_MAX
+
+#define X_CV_NODE_OPS() \
+  XCVOP(VAR), \
+  XCVOP(CONST), \
+  XCVOP(NET), \
+  XCVOP(BUF), \
+  XCVOP(BUFZ), \
+  XCVOP(NOT), \
+  XCVOP(AND), \
+  XCVOP(NAND), \
+  XCVOP(OR), \
+  XCVOP(NOR), \
+  XCVOP(XOR), \
+  XCVOP(XNOR), \
+  XCVOP(MUXZ), \
+  XCVOP(LATCH), \
+  XCVOP(DFF), \
+  XCVOP(ADD), \
+  XCVOP(SUB), \
+  XCVOP(MUL), \
+  XCVOP(DIV), \
+  XCVOP(MOD), \
+  XCVOP(EQ), \
+  XCVOP(NE), \
+  XCVOP(EEQ), \
+  XCVOP(NEE), \
+  XCVOP(GE), \
+  XCVOP(GT), \
+  XCVOP(SHL), \
+  XCVOP(SHR), \
+  XCVOP(RESOLV), \
+  XCVOP(VIEW), \
+  XCVOP(FUSED), \
+  XCVOP(NONE)
+
+#define XCVOP(o) CV_OP_##o
+
+typedef enum {
+  X_CV_NODE_OPS(),
+  CV_OP_COUNT
+} cv_op;
+
+#undef XCVOP
+
+typedef uint32_t cv_node_id;
+
+typedef enum {
+  CV_EVAL_EVENT,
+  CV_EVAL_LEVELIZED,
+} cv_eval_mode;
+
+// Step inputs index the fused node's inputs, or an earlier step's result
+// when CV_FUSE_STEP is set
+#define CV_FUSE_STEP 0x80000000u
+
+typedef struct {
+  cv_op op;
+  uint32_t width;
+  uint32_t n_in;
+  uint32_t in[CV_NODE_MAX_IN];
+} cv_fuse_step;
+
+typedef struct {
+  cv_node_id* in;
+  cv_fuse_step* steps;
+  cv_vec4* vals;
+} cv_fuse;
+
+typedef struct {
+  cv_op op;
+  uint32_t n_in;
+  cv_node_id in[CV_NODE_MAX_IN];
+  cv_fuse* fuse;
+  cv_node_id* fanout;
+  uint32_t level;
+  uint16_t part;
+  bool queued;
+  bool watched;
+  // 0 and 1 strengths the node drives a RESOLV with
+  cv_sc drive;
+  uint32_t domain;
+  // Index into net->resolvs for RESOLV, net->views for VIEW
+  uint32_t ext;
+  cv_vec4 value;
+} cv_node;
+
+typedef enum {
+  CV_EDGE_POS,
+  CV_EDGE_NEG,
+  CV_EDGE_LEVEL,
+  // Watches only: either edge, and any change of any bit
+  CV_EDGE_BOTH,
+  CV_EDGE_ANY,
+} cv_edge;
+
+typedef enum {
+  CV_ASYNC_NONE,
+  CV_ASYNC_CLEAR,
+  CV_ASYNC_SET,
+} cv_async;
+
+typedef struct {
+  cv_node_id node;
+  cv_edge edge;
+  cv_async async;
+  cv_vec4 sample;
+} cv_flop;
+
+// Flops sharing a trigger node and edge. Domains on the same trigger are
+// chained through next, starting at the trigger's node->domain.
+typedef struct {
+  cv_node_id trigger;
+  cv_edge edge;
+  cv_bit last;
+  bool pending;
+  uint32_t next;
+  uint32_t* flops;
+  // Tags passed to on_event when the domain fires
+  uint32_t* events;
+} cv_domain;
+
+typedef struct {
+  cv_node_id node;
+  cv_edge edge;
+  uint32_t event;
+} cv_watch;
+
+typedef void (*cv_net_event_fn)(void* ctx, uint32_t event);
+
+// Per bit codes of a resolved net. A width of 0 at creation is taken from
+// the widest driver during elaboration.
+typedef struct {
+  cv_node_id node;
+  cv_resolv_kind kind;
+  bool sized;
+  cv_sc* codes;
+} cv_resolv;
+
+#define CV_VIEW_FILL UINT32_MAX
+
+// width bits of input port from bit src, or of fill when port is
+// CV_VIEW_FILL. dst is where the run lands in the view.
+typedef struct {
+  uint32_t port;
+  uint32_t src;
+  uint32_t dst;
+  uint32_t width;
+  cv_bit fill;
+} cv_view_seg;
+
+typedef struct {
+  cv_view_seg* segs;
+} cv_view;
+
+#define cv_node_in(node, k) ((node)->fuse ? (node)->fuse->in[k] : (node)->in[k])
+
+#define CV_EVAL_SLOTS (1 + CV_NODE_MAX_IN)
+
+typedef struct {
+  cv_vec4 scratch[CV_EVAL_SLOTS];
+  uint64_t* scratch_words[CV_EVAL_SLOTS];
+  uint64_t* arith_tmp;
+  cv_sc* sc_acc;
+  cv_sc* sc_in;
+  size_t n_evals;
+  size_t n_2state;
+  size_t n_changes;
+} cv_eval_ctx;
+
+typedef struct {
+  uint32_t count;
+  uint32_t gen;
+  uint32_t n;
+} cv_barrier;
+
+struct _cv_net;
+
+// Settles the dirty bitset over the node array, adding evaluations, two
+// state results and changes to counts[0..2]
+typedef void (*cv_net_compiled)(char* nodes, uint64_t* dirty, size_t* counts);
+
+typedef struct {
+  struct _cv_net* net;
+  uint32_t index;
+  crena_arena arena;
+  cv_eval_ctx ctx;
+  uint64_t* dirty;
+  cv_node_id** outbox;
+  cv_node_id* deferred;
+  uint32_t next_level;
+  pthread_t thread;
+} cv_worker;
+
+typedef struct {
+  uint32_t n_workers;
+  cv_worker* workers;
+  cv_barrier barrier;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  uint32_t start;
+  bool stop;
+  size_t n_cut;
+  size_t n_rounds;
+} cv_par;
+
+typedef struct _cv_net {
+  crena_arena* arena;
+  cv_node* nodes;
+  cv_eval_mode mode;
+  bool fuse;
+  size_t n_fused;
+  uint32_t n_levels;
+  uint32_t* level_start;
+  cv_node_id* slot_node;
+  uint32_t* slot_of;
+  uint64_t* dirty;
+  size_t first_dirty;
+  cv_node_id* queue;
+  size_t queue_head;
+  uint32_t max_width;
+  cv_eval_ctx ctx;
+  cv_par* par;
+  cv_net_compiled compiled;
+  cv_flop* flops;
+  cv_domain* domains;
+  uint32_t* fired;
+  cv_watch* watches;
+  cv_net_event_fn on_event;
+  void* event_ctx;
+  bool domains_pending;
+  size_t n_edges;
+  size_t n_flop_updates;
+  cv_resolv* resolvs;
+  cv_view* views;
+  size_t n_views_folded;
+  size_t n_settles;
+} cv_net;
+
+#define cv_net_node(net, id) (&(net)->nodes[id])
+#define cv_net_len(net) crena_da_len((net)->nodes)
+
+extern char const* CV_OP_NAMES[];
+
+cv_op cv_op_from_name(char const* name, size_t len);
+void cv_net_init(cv_net* net, crena_arena* arena);
+cv_node_id cv_net_add(cv_net* net, cv_op op, uint32_t width);
+void cv_net_connect(cv_net* net, cv_node_id id, uint32_t port, cv_node_id src);
+// A flop to connect as d, clock, enable, async. Unconnected enable and
+// async are always on and never asserted.
+cv_node_id cv_net_add_dff(cv_net* net, uint32_t width, cv_edge edge, cv_async async);
+// A net resolving its drivers, width 0 to size it by them
+cv_node_id cv_net_add_resolv(cv_net* net, uint32_t width, cv_resolv_kind kind);
+// A view's segments go in order from bit 0 and cover its width. Bits
+// past the end of an input read as x.
+cv_node_id cv_net_add_view(cv_net* net, uint32_t width);
+void cv_net_view_seg(cv_net* net, cv_node_id id, uint32_t port, uint32_t src, uint32_t width);
+void cv_net_view_fill(cv_net* net, cv_node_id id, uint32_t width, cv_bit bit);
+// Reports event to on_event on the node's edge (POS, NEG, BOTH on bit 0)
+// or on any change (ANY), from settles after elaboration
+void cv_net_watch(cv_net* net, cv_node_id id, cv_edge edge, uint32_t event);
+// Sorts into levels when levelized, then settles the initial values
+bool cv_net_elaborate(cv_net* net);
+// Drives a var, the change is propagated on the next settle
+void cv_net_set(cv_net* net, cv_node_id id, cv_vec4* value);
+void cv_net_touch(cv_net* net, cv_node_id id);
+void cv_net_settle(cv_net* net);
+// Partitions a levelized, elaborated net over n threads, the caller being
+// one of them. n <= 1 goes back to serial.
+bool cv_net_set_threads(cv_net* net, uint32_t n);
+void cv_net_report(cv_net* net, FILE* out);
+
+typedef struct {
+  cv_net* net;
+  uint32_t n_lanes;
+  uint32_t group;
+  size_t* offset;
+  uint64_t* bits;
+  size_t* step_offset;
+  uint64_t* scratch[CV_NODE_MAX_IN];
+  cv_node_id* order;
+  size_t n_order;
+  size_t n_evals;
+} cv_lanes;
+
+// Words of the given bit of a node, one bit per lane
+#define cv_lanes_row(l, id, bit) (&(l)->bits[(l)->offset[id] + (size_t)(bit) * (l)->group])
+
+// Fails if the net has loops, x/z constants, open inputs or ops without a
+// two state kernel. n_lanes is a multiple of 64.
+bool cv_lanes_init(cv_lanes* l, cv_net* net, uint32_t n_lanes, crena_arena* arena);
+void cv_lanes_set(cv_lanes* l, cv_node_id id, uint32_t lane, uint64_t value);
+uint64_t cv_lanes_get(cv_lanes* l, cv_node_id id, uint32_t lane);
+void cv_lanes_eval(cv_lanes* l);
+
+#ifdef CVNET_IMPLEMENTATION
+
+#define XCVOP(o) #o
+
+char const* CV_OP_NAMES[] = {
+  X_CV_NODE_OPS()
+};
+
+#undef XCVOP
+
+cv_op cv_op_from_name(char const* name, size_t len) {
+  for (size_t i = 0; i < CV_OP_COUNT; i ++) {
+    if (strlen(CV_OP_NAMES[i]) == len && memcmp(CV_OP_NAMES[i], name, len) == 0) return (cv_op)i;
+  }
+  return CV_OP_COUNT;
+}
+
+void cv_net_init(cv_net* net, crena_arena* arena) {
+  *net = (cv_net){0};
+  net->arena = arena;
+  net->mode = KNOB_NET_LEVELIZE ? CV_EVAL_LEVELIZED : CV_EVAL_EVENT;
+  net->fuse = KNOB_NET_FUSE;
+  crena_da_init(net->nodes, arena);
+  crena_da_init(net->queue, arena);
+  crena_da_init(net->flops, arena);
+  crena_da_init(net->domains, arena);
+  crena_da_init(net->fired, arena);
+  crena_da_init(net->watches, arena);
+  crena_da_init(net->resolvs, arena);
+  crena_da_init(net->views, arena);
+  cv_sc_init_tables();
+}
+
+cv_node_id cv_net_add(cv_net* net, cv_op op, uint32_t width) {
+  cv_node node = {
+    .op = op,
+    .level = CV_NO_LEVEL,
+    .drive = CV_DRIVE_STRONG,
+    .domain = CV_NODE_NONE,
+    .ext = CV_NODE_NONE,
+  };
+  for (size_t i = 0; i < CV_NODE_MAX_IN; i ++) node.in[i] = CV_NODE_NONE;
+  crena_da_init(node.fanout, net->arena);
+  cv_vec4_init(&node.value, width ? width : 1, net->arena);
+  crena_da_push(net->nodes, node);
+  return (cv_node_id)(crena_da_len(net->nodes) - 1);
+}
+
+void cv_net_connect(cv_net* net, cv_node_id id, uint32_t port, cv_node_id src) {
+  cv_node* node = cv_net_node(net, id);
+  node->in[port] = src;
+  if (port >= node->n_in) node->n_in = port + 1;
+  if (src != CV_NODE_NONE) crena_da_push(cv_net_node(net, src)->fanout, id);
+}
+
+cv_node_id cv_net_add_dff(cv_net* net, uint32_t width, cv_edge edge, cv_async async) {
+  cv_node_id id = cv_net_add(net, CV_OP_DFF, width);
+  cv_flop flop = { .node = id, .edge = edge, .async = async };
+  cv_vec4_init(&flop.sample, cv_net_node(net, id)->value.width, net->arena);
+  crena_da_push(net->flops, flop);
+  return id;
+}
+
+cv_node_id cv_net_add_resolv(cv_net* net, uint32_t width, cv_resolv_kind kind) {
+  cv_node_id id = cv_net_add(net, CV_OP_RESOLV, width);
+  cv_net_node(net, id)->ext = (uint32_t)crena_da_len(net->resolvs);
+  cv_resolv r = { .node = id, .kind = kind, .sized = width != 0 };
+  crena_da_push(net->resolvs, r);
+  return id;
+}
+
+cv_node_id cv_net_add_view(cv_net* net, uint32_t width) {
+  cv_node_id id = cv_net_add(net, CV_OP_VIEW, width);
+  cv_net_node(net, id)->ext = (uint32_t)crena_da_len(net->views);
+  cv_view v;
+  crena_da_init(v.segs, net->arena);
+  crena_da_push(net->views, v);
+  return id;
+}
+
+// Appends, merging with the previous run when they continue each other
+static void _cv_view_push(cv_view_seg** segs, cv_view_seg seg) {
+  size_t n = crena_da_len(*segs);
+  seg.dst = n ? (*segs)[n - 1].dst + (*segs)[n - 1].width : 0;
+  if (!seg.width) return;
+  if (n) {
+    cv_view_seg* last = &(*segs)[n - 1];
+    bool same = last->port == seg.port &&
+                (seg.port == CV_VIEW_FILL ? last->fill == seg.fill : last->src + last->width == seg.src);
+    if (same) {
+      last->width += seg.width;
+      return;
+    }
+  }
+  crena_da_push(*segs, seg);
+}
+
+void cv_net_view_seg(cv_net* net, cv_node_id id, uint32_t port, uint32_t src, uint32_t width) {
+  cv_view* v = &net->views[cv_net_node(net, id)->ext];
+  _cv_view_push(&v->segs, (cv_view_seg){ .port = port, .src = src, .width = width });
+}
+
+void cv_net_view_fill(cv_net* net, cv_node_id id, uint32_t width, cv_bit bit) {
+  cv_view* v = &net->views[cv_net_node(net, id)->ext];
+  _cv_view_push(&v->segs, (cv_view_seg){ .port = CV_VIEW_FILL, .width = width, .fill = bit });
+}
+
+static bool _cv_net_is_source(cv_node* node) {
+  return node->op == CV_OP_VAR || node->op == CV_OP_CONST || node->op == CV_OP_NONE || node->op == CV_OP_DFF;
+}
+
+// Kahn's algorithm over the non-source nodes. Whatever is left with
+// pending inputs sits on a loop and keeps CV_NO_LEVEL.
+static void _cv_net_levelize(cv_net* net) {
+  size_t n = cv_net_len(net);
+  uint32_t* pending = crena_alloc(net->arena, n * sizeof(uint32_t));
+  cv_node_id* ready;
+  crena_da_init(ready, net->arena);
+
+  for (size_t i = 0; i < n; i ++) {
+    cv_node* node = cv_net_node(net, i);
+    pending[i] = 0;
+    if (_cv_net_is_source(node)) {
+      node->level = 0;
+      continue;
+    }
+    node->level = CV_NO_LEVEL;
+    for (uint32_t k = 0; k < node->n_in; k ++) {
+      if (cv_node_in(node, k) != CV_NODE_NONE && !_cv_net_is_source(cv_net_node(net, cv_node_in(node, k)))) pending[i] ++;
+    }
+    if (!pending[i]) crena_da_push(ready, (cv_node_id)i);
+  }
+
+  net->n_levels = 1;
+  for (size_t r = 0; r < crena_da_len(ready); r ++) {
+    cv_node* node = cv_net_node(net, ready[r]);
+    uint32_t level = 0;
+    for (uint32_t k = 0; k < node->n_in; k ++) {
+      if (cv_node_in(node, k) == CV_NODE_NONE) continue;
+      uint32_t l = cv_net_node(net, cv_node_in(node, k))->level;
+      if (l > level) level = l;
+    }
+    node->level = level + 1;
+    if (node->level + 1 > net->n_levels) net->n_levels = node->level + 1;
+    for (size_t f = 0; f < crena_da_len(node->fanout); f ++) {
+      if (--pending[node->fanout[f]] == 0) crena_da_push(ready, node->fanout[f]);
+    }
+  }
+
+  // Counting sort into slots, level l at slot_node[level_start[l]..level_start[l + 1])
+  uint32_t* start = crena_alloc(net->arena, (net->n_levels + 1) * sizeof(uint32_t));
+  memset(start, 0, (net->n_levels + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < n; i ++) {
+    cv_node* node = cv_net_node(net, i);
+    if (node->level != CV_NO_LEVEL) start[node->level + 1] ++;
+  }
+  for (uint32_t l = 0; l < net->n_levels; l ++) start[l + 1] += start[l];
+  net->slot_node = crena_alloc(net->arena, (start[net->n_levels] + 1) * sizeof(cv_node_id));
+  net->slot_of = crena_alloc(net->arena, n * sizeof(uint32_t));
+  for (size_t i = 0; i < n; i ++) {
+    cv_node* node = cv_net_node(net, i);
+    net->slot_of[i] = node->level == CV_NO_LEVEL ? CV_NODE_NONE : start[node->level] ++;
+    if (node->level != CV_NO_LEVEL) net->slot_node[net->slot_of[i]] = (cv_node_id)i;
+  }
+  for (uint32_t l = net->n_levels; l > 0; l --) start[l] = start[l - 1];
+  start[0] = 0;
+  net->level_start = start;
+
+  size_t words = CV_WORDS(start[net->n_levels]);
+  net->dirty = crena_alloc(net->arena, (words + 1) * sizeof(uint64_t));
+  memset(net->dirty, 0, (words + 1) * sizeof(uint64_t));
+  net->first_dirty = words;
+}
+
+static void _cv_eval_ctx_init(cv_eval_ctx* ctx, crena_arena* arena, uint32_t max_width) {
+  *ctx = (cv_eval_ctx){0};
+  for (size_t s = 0; s < CV_EVAL_SLOTS; s ++) {
+    ctx->scratch_words[s] = crena_alloc_aligned(arena, 2 * CV_WORDS(max_width) * sizeof(uint64_t), 32);
+  }
+  ctx->arith_tmp = crena_alloc(arena, cv_arith_tmp(max_width) * sizeof(uint64_t));
+  ctx->sc_acc = crena_alloc(arena, max_width);
+  ctx->sc_in = crena_alloc(arena, max_width);
+}
+
+static void _cv_net_fuse(cv_net* net);
+static void _cv_net_fold_views(cv_net* net);
+
+static uint32_t _cv_net_domain(cv_net* net, cv_node_id trigger, cv_edge edge) {
+  cv_node* node = cv_net_node(net, trigger);
+  for (uint32_t d = node->domain; d != CV_NODE_NONE; d = net->domains[d].next) {
+    if (net->domains[d].edge == edge) return d;
+  }
+  cv_domain domain = {
+    .trigger = trigger,
+    .edge = edge,
+    .last = cv_vec4_get_bit(&node->value, 0),
+    .next = node->domain,
+  };
+  crena_da_init(domain.flops, net->arena);
+  crena_da_init(domain.events, net->arena);
+  crena_da_push(net->domains, domain);
+  node->domain = (uint32_t)(crena_da_len(net->domains) - 1);
+  return node->domain;
+}
+
+static void _cv_net_group_flops(cv_net* net) {
+  for (size_t i = 0; i < crena_da_len(net->flops); i ++) {
+    cv_flop* f = &net->flops[i];
+    cv_node* node = cv_net_node(net, f->node);
+    if (node->in[1] != CV_NODE_NONE) {
+      uint32_t d = _cv_net_domain(net, node->in[1], f->edge);
+      crena_da_push(net->domains[d].flops, (uint32_t)i);
+    }
+    if (f->async != CV_ASYNC_NONE && node->in[3] != CV_NODE_NONE) {
+      uint32_t d = _cv_net_domain(net, node->in[3], CV_EDGE_LEVEL);
+      crena_da_push(net->domains[d].flops, (uint32_t)i);
+    }
+  }
+}
+
+void cv_net_watch(cv_net* net, cv_node_id id, cv_edge edge, uint32_t event) {
+  cv_net_node(net, id)->watched = true;
+  crena_da_push(net->watches, ((cv_watch){ .node = id, .edge = edge, .event = event }));
+}
+
+static void _cv_net_group_watches(cv_net* net) {
+  for (size_t i = 0; i < crena_da_len(net->watches); i ++) {
+    cv_watch* w = &net->watches[i];
+    uint32_t d = _cv_net_domain(net, w->node, w->edge);
+    crena_da_push(net->domains[d].events, w->event);
+  }
+}
+
+// Unsized resolvers take the widest driver, passing again while a
+// resolver feeding another one was still growing
+static void _cv_net_size_resolvs(cv_net* net) {
+  for (bool grew = true; grew;) {
+    grew = false;
+    for (size_t i = 0; i < crena_da_len(net->resolvs); i ++) {
+      cv_resolv* rv = &net->resolvs[i];
+      cv_node* node = cv_net_node(net, rv->node);
+      if (rv->sized) continue;
+      uint32_t width = node->value.width;
+      for (uint32_t k = 0; k < node->n_in; k ++) {
+        if (node->in[k] == CV_NODE_NONE) continue;
+        uint32_t w = cv_net_node(net, node->in[k])->value.width;
+        if (w > width) width = w;
+      }
+      if (width == node->value.width) continue;
+      cv_vec4_init(&node->value, width, net->arena);
+      grew = true;
+    }
+  }
+  for (size_t i = 0; i < crena_da_len(net->resolvs); i ++) {
+    cv_resolv* rv = &net->resolvs[i];
+    uint32_t width = cv_net_node(net, rv->node)->value.width;
+    rv->codes = crena_alloc(net->arena, width);
+    memset(rv->codes, 0, width);
+  }
+}
+
+bool cv_net_elaborate(cv_net* net) {
+  _cv_net_size_resolvs(net);
+  _cv_net_fold_views(net);
+  if (net->fuse) _cv_net_fuse(net);
+  net->max_width = 64;
+  for (size_t i = 0; i < cv_net_len(net); i ++) {
+    uint32_t w = cv_net_node(net, i)->value.width;
+    if (w > net->max_width) net->max_width = w;
+  }
+  _cv_eval_ctx_init(&net->ctx, net->arena, net->max_width);
+
+  if (net->mode == CV_EVAL_LEVELIZED) _cv_net_levelize(net);
+  _cv_net_group_flops(net);
+  _cv_net_group_watches(net);
+
+  for (size_t i = 0; i < cv_net_len(net); i ++) {
+    if (!_cv_net_is_source(cv_net_node(net, i))) cv_net_touch(net, (cv_node_id)i);
+  }
+  cv_net_settle(net);
+  return true;
+}
+
+void cv_net_touch(cv_net* net, cv_node_id id) {
+  cv_node* node = cv_net_node(net, id);
+  if (_cv_net_is_source(node)) return;
+  if (net->mode == CV_EVAL_LEVELIZED && node->level != CV_NO_LEVEL) {
+    uint32_t slot = net->slot_of[id];
+    uint64_t* dirty = net->par ? net->par->workers[node->part].dirty : net->dirty;
+    dirty[slot / 64] |= 1ULL << (slot % 64);
+    if (!net->par && slot / 64 < net->first_dirty) net->first_dirty = slot / 64;
+  } else if (!node->queued) {
+    node->queued = true;
+    crena_da_push(net->queue, id);
+  }
+}
+
+// Marks the domains the node triggers. Workers may do this concurrently,
+// the flags are only read after the sweep.
+static void _cv_net_arm(cv_net* net, cv_node* node) {
+  for (uint32_t d = node->domain; d != CV_NODE_NONE; d = net->domains[d].next) {
+    __atomic_store_n(&net->domains[d].pending, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&net->domains_pending, true, __ATOMIC_RELAXED);
+  }
+}
+
+static void _cv_net_changed(cv_net* net, cv_node* node) {
+  net->ctx.n_changes ++;
+  for (size_t f = 0; f < crena_da_len(node->fanout); f ++) cv_net_touch(net, node->fanout[f]);
+  _cv_net_arm(net, node);
+}
+
+void cv_net_set(cv_net* net, cv_node_id id, cv_vec4* value) {
+  cv_node* node = cv_net_node(net, id);
+  if (value->width == node->value.width && cv_vec4_identical(&node->value, value)) return;
+  cv_vec4_assign(&node->value, value);
+  cv_vec4_refresh_2state(&node->value);
+  _cv_net_changed(net, node);
+}
+
+static cv_vec4* _cv_net_scratch(cv_eval_ctx* ctx, size_t slot, uint32_t width) {
+  cv_vec4* v = &ctx->scratch[slot];
+  v->width = width;
+  v->flags = 0;
+  if (width > 64) v->words = ctx->scratch_words[slot];
+  return v;
+}
+
+static cv_vec4* _cv_net_value(cv_net* net, cv_node_id id) {
+  return id == CV_NODE_NONE ? NULL : &cv_net_node(net, id)->value;
+}
+
+// An input at the given width, x when unconnected
+static cv_vec4* _cv_net_resolve(cv_eval_ctx* ctx, cv_vec4* src, uint32_t width, size_t slot) {
+  if (src && src->width == width) return src;
+  cv_vec4* v = _cv_net_scratch(ctx, slot, width);
+  if (src) cv_vec4_assign(v, src);
+  else cv_vec4_fill(v, CV_BIT_X);
+  return v;
+}
+
+static bool _cv_op_evaluates(cv_op op) {
+  return op >= CV_OP_NET && op <= CV_OP_MUXZ;
+}
+
+// r = op(in...) with every input already at r's width. r does not alias
+// the inputs.
+static void _cv_eval_op(cv_op op, cv_vec4* r, cv_vec4** in, uint32_t n_in) {
+  cv_vec4_copy(r, in[0]);
+
+  switch (op) {
+  case CV_OP_NET:
+  case CV_OP_BUFZ:
+    break;
+  case CV_OP_BUF:
+    cv_vec4_buf(r, r);
+    break;
+  case CV_OP_NOT:
+    cv_vec4_not(r, r);
+    break;
+  case CV_OP_AND:
+  case CV_OP_NAND:
+    for (uint32_t k = 1; k < n_in; k ++) cv_vec4_and(r, r, in[k]);
+    if (op == CV_OP_NAND) cv_vec4_not(r, r);
+    break;
+  case CV_OP_OR:
+  case CV_OP_NOR:
+    for (uint32_t k = 1; k < n_in; k ++) cv_vec4_or(r, r, in[k]);
+    if (op == CV_OP_NOR) cv_vec4_not(r, r);
+    break;
+  case CV_OP_XOR:
+  case CV_OP_XNOR:
+    for (uint32_t k = 1; k < n_in; k ++) cv_vec4_xor(r, r, in[k]);
+    if (op == CV_OP_XNOR) cv_vec4_not(r, r);
+    break;
+  case CV_OP_MUXZ:
+    if (n_in < 2) cv_vec4_fill(r, CV_BIT_X);
+    else cv_vec4_mux1(r, n_in > 2 ? cv_vec4_get_bit(in[2], 0) : CV_BIT_X, r, in[1]);
+    break;
+  default:
+    break;
+  }
+
+  // Two state results came off the fast path already marked, an x/z
+  // result gets its mark back as soon as the x/z is gone
+  if (!(r->flags & CV_VEC_2STATE)) cv_vec4_refresh_2state(r);
+}
+
+static bool _cv_op_arith(cv_op op) {
+  return op >= CV_OP_ADD && op <= CV_OP_SHR;
+}
+
+static void _cv_net_eval_arith(cv_net* net, cv_eval_ctx* ctx, cv_node* node, cv_vec4* r) {
+  cv_vec4* a = _cv_net_value(net, node->in[0]);
+  cv_vec4* b = _cv_net_value(net, node->in[1]);
+  cv_op op = node->op;
+
+  if (op == CV_OP_SHL || op == CV_OP_SHR) {
+    a = _cv_net_resolve(ctx, a, r->width, 1);
+    if (!b) cv_vec4_fill(r, CV_BIT_X);
+    else if (op == CV_OP_SHL) cv_vec4_shl(r, a, b);
+    else cv_vec4_shr(r, a, b);
+    return;
+  }
+
+  if (op >= CV_OP_EQ) {
+    uint32_t w = 1;
+    if (a && a->width > w) w = a->width;
+    if (b && b->width > w) w = b->width;
+    a = _cv_net_resolve(ctx, a, w, 1);
+    b = _cv_net_resolve(ctx, b, w, 2);
+    cv_bit bit = CV_BIT_X;
+    switch (op) {
+    case CV_OP_EQ: bit = cv_vec4_eq(a, b); break;
+    case CV_OP_NE: bit = cv_vec4_eq(a, b); if (bit != CV_BIT_X) bit ^= 1; break;
+    case CV_OP_EEQ: bit = cv_vec4_eeq(a, b); break;
+    case CV_OP_NEE: bit = cv_vec4_eeq(a, b) ^ 1; break;
+    case CV_OP_GE: bit = cv_vec4_ge(a, b); break;
+    case CV_OP_GT: bit = cv_vec4_gt(a, b); break;
+    default: break;
+    }
+    cv_vec4_fill(r, CV_BIT_0);
+    cv_vec4_set_bit(r, 0, bit);
+    if (!(r->flags & CV_VEC_2STATE)) cv_vec4_refresh_2state(r);
+    return;
+  }
+
+  a = _cv_net_resolve(ctx, a, r->width, 1);
+  b = _cv_net_resolve(ctx, b, r->width, 2);
+  switch (op) {
+  case CV_OP_ADD: cv_vec4_add(r, a, b); break;
+  case CV_OP_SUB: cv_vec4_sub(r, a, b); break;
+  case CV_OP_MUL: cv_vec4_mul(r, a, b, ctx->arith_tmp); break;
+  case CV_OP_DIV: cv_vec4_div(r, a, b, ctx->arith_tmp); break;
+  case CV_OP_MOD: cv_vec4_mod(r, a, b, ctx->arith_tmp); break;
+  default: break;
+  }
+}
+
+static bool _cv_vec4_all_z(cv_vec4* v) {
+  size_t n = CV_WORDS(v->width);
+  uint64_t* a = cv_vec4_aval(v);
+  uint64_t* b = cv_vec4_bval(v);
+  for (size_t i = 0; i + 1 < n; i ++) {
+    if (a[i] || ~b[i]) return false;
+  }
+  return !a[n - 1] && b[n - 1] == cv_vec4_top_mask(v->width);
+}
+
+// Folds the active drivers' codes into r, true when the strengths changed
+static bool _cv_net_eval_resolv(cv_net* net, cv_eval_ctx* ctx, cv_node* node, cv_vec4* r) {
+  cv_resolv* rv = &net->resolvs[node->ext];
+  uint32_t width = r->width;
+  cv_sc* acc = ctx->sc_acc;
+  uint32_t n_active = 0;
+  for (uint32_t k = 0; k < node->n_in; k ++) {
+    if (node->in[k] == CV_NODE_NONE) continue;
+    cv_node* src = cv_net_node(net, node->in[k]);
+    if (_cv_vec4_all_z(&src->value)) continue;
+    // The first one lands in acc directly, so one driver needs no fold
+    cv_sc* codes = n_active ? ctx->sc_in : acc;
+    if (src->op == CV_OP_RESOLV && src->value.width == width) {
+      memcpy(codes, net->resolvs[src->ext].codes, width);
+    } else {
+      cv_sc_encode(codes, _cv_net_resolve(ctx, &src->value, width, 1), src->drive);
+    }
+    if (n_active ++) cv_sc_resolve(rv->kind, acc, codes, width);
+  }
+  if (!n_active) memset(acc, 0, width);
+
+  cv_sc_decode(r, acc, rv->kind);
+  if (memcmp(acc, rv->codes, width) == 0) return false;
+  memcpy(rv->codes, acc, width);
+  return true;
+}
+
+static void _cv_net_eval_view(cv_net* net, cv_node* node, cv_vec4* r) {
+  cv_view* v = &net->views[node->ext];
+  for (size_t i = 0; i < crena_da_len(v->segs); i ++) {
+    cv_view_seg* sg = &v->segs[i];
+    if (sg->port == CV_VIEW_FILL) cv_vec4_fill_bits(r, sg->dst, sg->width, sg->fill);
+    else cv_vec4_copy_bits(r, sg->dst, &cv_net_node(net, node->in[sg->port])->value, sg->src, sg->width);
+  }
+  // Scratch words come from wider nodes too
+  size_t n = CV_WORDS(r->width);
+  cv_vec4_aval(r)[n - 1] &= cv_vec4_top_mask(r->width);
+  cv_vec4_bval(r)[n - 1] &= cv_vec4_top_mask(r->width);
+  cv_vec4_refresh_2state(r);
+}
+
+static void _cv_net_eval_fused(cv_net* net, cv_eval_ctx* ctx, cv_node* node, cv_vec4* r) {
+  cv_fuse* f = node->fuse;
+  size_t n = crena_da_len(f->steps);
+  for (size_t s = 0; s < n; s ++) {
+    cv_fuse_step* st = &f->steps[s];
+    cv_vec4* in[CV_NODE_MAX_IN];
+    for (uint32_t k = 0; k < st->n_in; k ++) {
+      uint32_t ref = st->in[k];
+      cv_vec4* src = (ref & CV_FUSE_STEP) ? &f->vals[ref & ~CV_FUSE_STEP] : _cv_net_value(net, f->in[ref]);
+      in[k] = _cv_net_resolve(ctx, src, st->width, 1 + k);
+    }
+    _cv_eval_op(st->op, s + 1 == n ? r : &f->vals[s], in, st->n_in);
+  }
+}
+
+static bool _cv_net_eval(cv_net* net, cv_eval_ctx* ctx, cv_node* node) {
+  uint32_t width = node->value.width;
+  cv_vec4* r = _cv_net_scratch(ctx, 0, width);
+  bool restrength = false;
+
+  if (node->fuse) {
+    _cv_net_eval_fused(net, ctx, node, r);
+  } else if (node->op == CV_OP_LATCH) {
+    // Follows d while enabled, merges with the held value on x/z
+    cv_vec4* en = _cv_net_value(net, node->in[1]);
+    cv_vec4* d = _cv_net_resolve(ctx, _cv_net_value(net, node->in[0]), width, 1);
+    cv_vec4_mux1(r, en ? cv_vec4_get_bit(en, 0) : CV_BIT_X, &node->value, d);
+    if (!(r->flags & CV_VEC_2STATE)) cv_vec4_refresh_2state(r);
+  } else if (_cv_op_arith(node->op)) {
+    _cv_net_eval_arith(net, ctx, node, r);
+  } else if (node->op == CV_OP_RESOLV) {
+    restrength = _cv_net_eval_resolv(net, ctx, node, r);
+  } else if (node->op == CV_OP_VIEW) {
+    _cv_net_eval_view(net, node, r);
+  } else if (_cv_op_evaluates(node->op)) {
+    cv_vec4* in[CV_NODE_MAX_IN];
+    uint32_t n_in = node->n_in ? node->n_in : 1;
+    for (uint32_t k = 0; k < n_in; k ++) {
+      in[k] = _cv_net_resolve(ctx, _cv_net_value(net, node->in[k]), width, 1 + k);
+    }
+    _cv_eval_op(node->op, r, in, n_in);
+  } else {
+    return false;
+  }
+
+  ctx->n_evals ++;
+  if (r->flags & CV_VEC_2STATE) ctx->n_2state ++;
+  if (cv_vec4_identical(r, &node->value)) return restrength;
+  cv_vec4_copy(&node->value, r);
+  return true;
+}
+
+// Fusion
+
+static bool _cv_net_fusible(cv_node* node) {
+  return node->fuse || (node->op >= CV_OP_BUF && node->op <= CV_OP_MUXZ);
+}
+
+// A plain node as a one step program
+static cv_fuse* _cv_net_fuse_of(cv_net* net, cv_node* node) {
+  if (node->fuse) return node->fuse;
+  cv_fuse* f = crena_alloc(net->arena, sizeof(cv_fuse));
+  *f = (cv_fuse){0};
+  crena_da_init(f->in, net->arena);
+  crena_da_init(f->steps, net->arena);
+  cv_fuse_step st = { .op = node->op, .width = node->value.width, .n_in = node->n_in };
+  for (uint32_t k = 0; k < node->n_in; k ++) {
+    st.in[k] = k;
+    crena_da_push(f->in, node->in[k]);
+  }
+  crena_da_push(f->steps, st);
+  node->fuse = f;
+  node->op = CV_OP_FUSED;
+  return f;
+}
+
+static uint32_t _cv_fuse_add_in(cv_node_id** in, cv_node_id id) {
+  for (size_t i = 0; i < crena_da_len(*in); i ++) {
+    if ((*in)[i] == id) return (uint32_t)i;
+  }
+  crena_da_push(*in, id);
+  return (uint32_t)(crena_da_len(*in) - 1);
+}
+
+static void _cv_fanout_remove(cv_node* src, cv_node_id id) {
+  size_t kept = 0;
+  for (size_t i = 0; i < crena_da_len(src->fanout); i ++) {
+    if (src->fanout[i] != id) src->fanout[kept++] = src->fanout[i];
+  }
+  crena_da_header(src->fanout)->count = kept;
+}
+
+// Absorbs a into b, a's only reader. b's steps follow a's and its reads
+// of a become reads of a's last step.
+static bool _cv_net_fuse_into(cv_net* net, cv_node_id a_id, cv_node_id b_id) {
+  cv_node* a = cv_net_node(net, a_id);
+  cv_node* b = cv_net_node(net, b_id);
+  size_t na = a->fuse ? crena_da_len(a->fuse->steps) : 1;
+  size_t nb = b->fuse ? crena_da_len(b->fuse->steps) : 1;
+  if (na + nb > KNOB_NET_FUSE_MAX_STEPS) return false;
+  for (uint32_t k = 0; k < a->n_in; k ++) {
+    if (cv_node_in(a, k) == b_id) return false;
+  }
+
+  cv_fuse* fa = _cv_net_fuse_of(net, a);
+  cv_fuse* fb = _cv_net_fuse_of(net, b);
+  cv_node_id* in;
+  crena_da_init(in, net->arena);
+  uint32_t amap[KNOB_NET_FUSE_MAX_IN * KNOB_NET_FUSE_MAX_STEPS];
+  uint32_t bmap[KNOB_NET_FUSE_MAX_IN * KNOB_NET_FUSE_MAX_STEPS];
+  for (size_t i = 0; i < crena_da_len(fb->in); i ++) {
+    bmap[i] = fb->in[i] == a_id ? (CV_FUSE_STEP | (uint32_t)(na - 1)) : _cv_fuse_add_in(&in, fb->in[i]);
+  }
+  for (size_t i = 0; i < crena_da_len(fa->in); i ++) amap[i] = _cv_fuse_add_in(&in, fa->in[i]);
+  if (crena_da_len(in) > KNOB_NET_FUSE_MAX_IN) return false;
+
+  cv_fuse_step* steps;
+  crena_da_init(steps, net->arena);
+  for (size_t s = 0; s < na; s ++) {
+    cv_fuse_step st = fa->steps[s];
+    for (uint32_t k = 0; k < st.n_in; k ++) {
+      if (!(st.in[k] & CV_FUSE_STEP)) st.in[k] = amap[st.in[k]];
+    }
+    crena_da_push(steps, st);
+  }
+  for (size_t s = 0; s < nb; s ++) {
+    cv_fuse_step st = fb->steps[s];
+    for (uint32_t k = 0; k < st.n_in; k ++) {
+      st.in[k] = (st.in[k] & CV_FUSE_STEP) ? (st.in[k] + (uint32_t)na) : bmap[st.in[k]];
+    }
+    crena_da_push(steps, st);
+  }
+
+  // One fanout entry per input slot, as cv_net_connect keeps them
+  for (size_t i = 0; i < crena_da_len(fa->in); i ++) {
+    if (fa->in[i] != CV_NODE_NONE) _cv_fanout_remove(cv_net_node(net, fa->in[i]), a_id);
+  }
+  for (size_t i = 0; i < crena_da_len(fb->in); i ++) {
+    if (fb->in[i] != CV_NODE_NONE && fb->in[i] != a_id) _cv_fanout_remove(cv_net_node(net, fb->in[i]), b_id);
+  }
+  for (size_t i = 0; i < crena_da_len(in); i ++) {
+    if (in[i] != CV_NODE_NONE) crena_da_push(cv_net_node(net, in[i])->fanout, b_id);
+  }
+
+  fb->in = in;
+  fb->steps = steps;
+  b->n_in = (uint32_t)crena_da_len(in);
+  a->fuse = NULL;
+  a->op = CV_OP_NONE;
+  a->n_in = 0;
+  crena_da_header(a->fanout)->count = 0;
+  return true;
+}
+
+static void _cv_net_fuse(cv_net* net) {
+  bool more = true;
+  while (more) {
+    more = false;
+    for (size_t i = 0; i < cv_net_len(net); i ++) {
+      cv_node* a = cv_net_node(net, i);
+      if (!_cv_net_fusible(a) || a->watched || crena_da_len(a->fanout) != 1) continue;
+      cv_node_id b = a->fanout[0];
+      if (b == i || !_cv_net_fusible(cv_net_node(net, b))) continue;
+      if (_cv_net_fuse_into(net, (cv_node_id)i, b)) {
+        net->n_fused ++;
+        more = true;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < cv_net_len(net); i ++) {
+    cv_fuse* f = cv_net_node(net, i)->fuse;
+    if (!f) continue;
+    f->vals = crena_alloc(net->arena, crena_da_len(f->steps) * sizeof(cv_vec4));
+    for (size_t s = 0; s < crena_da_len(f->steps); s ++) cv_vec4_init(&f->vals[s], f->steps[s].width, net->arena);
+  }
+}
+
+// Views
+
+// Runs past the end of an input, or from no input, become x fills
+static void _cv_net_clip_view(cv_net* net, cv_node* node) {
+  cv_view* v = &net->views[node->ext];
+  cv_view_seg* segs;
+  crena_da_init(segs, net->arena);
+  for (size_t i = 0; i < crena_da_len(v->segs); i ++) {
+    cv_view_seg sg = v->segs[i];
+    if (sg.port == CV_VIEW_FILL) {
+      _cv_view_push(&segs, sg);
+      continue;
+    }
+    cv_node_id src = sg.port < node->n_in ? node->in[sg.port] : CV_NODE_NONE;
+    uint32_t have = src == CV_NODE_NONE ? 0 : cv_net_node(net, src)->value.width;
+    uint32_t in = sg.src >= have ? 0 : have - sg.src < sg.width ? have - sg.src : sg.width;
+    cv_view_seg part = sg;
+    part.width = in;
+    _cv_view_push(&segs, part);
+    _cv_view_push(&segs, (cv_view_seg){ .port = CV_VIEW_FILL, .width = sg.width - in, .fill = CV_BIT_X });
+  }
+  v->segs = segs;
+}
+
+// Rewrites a's reads of port k, a view b, into reads of b's inputs. False
+// when that needs too many inputs or segments.
+static bool _cv_net_fold_view(cv_net* net, cv_node_id a_id, uint32_t k) {
+  cv_node* a = cv_net_node(net, a_id);
+  cv_node_id b_id = a->in[k];
+  cv_node* b = cv_net_node(net, b_id);
+  cv_view* va = &net->views[a->ext];
+  cv_view* vb = &net->views[b->ext];
+  for (uint32_t j = 0; j < b->n_in; j ++) {
+    if (b->in[j] == a_id) return false;
+  }
+
+  cv_node_id* in;
+  crena_da_init(in, net->arena);
+  cv_view_seg* segs;
+  crena_da_init(segs, net->arena);
+  for (size_t i = 0; i < crena_da_len(va->segs); i ++) {
+    cv_view_seg sg = va->segs[i];
+    if (sg.port != k) {
+      if (sg.port != CV_VIEW_FILL) sg.port = _cv_fuse_add_in(&in, a->in[sg.port]);
+      _cv_view_push(&segs, sg);
+      continue;
+    }
+    for (size_t j = 0; j < crena_da_len(vb->segs); j ++) {
+      cv_view_seg bs = vb->segs[j];
+      uint32_t lo = sg.src > bs.dst ? sg.src : bs.dst;
+      uint32_t hi = sg.src + sg.width < bs.dst + bs.width ? sg.src + sg.width : bs.dst + bs.width;
+      if (lo >= hi) continue;
+      cv_view_seg run = { .port = CV_VIEW_FILL, .src = bs.src + (lo - bs.dst), .width = hi - lo, .fill = bs.fill };
+      if (bs.port != CV_VIEW_FILL) run.port = _cv_fuse_add_in(&in, b->in[bs.port]);
+      _cv_view_push(&segs, run);
+    }
+  }
+  if (crena_da_len(in) > CV_NODE_MAX_IN || crena_da_len(segs) > KNOB_NET_VIEW_MAX_SEGS) return false;
+
+  for (uint32_t j = 0; j < a->n_in; j ++) {
+    if (a->in[j] != CV_NODE_NONE) _cv_fanout_remove(cv_net_node(net, a->in[j]), a_id);
+  }
+  for (uint32_t j = 0; j < CV_NODE_MAX_IN; j ++) a->in[j] = CV_NODE_NONE;
+  a->n_in = 0;
+  for (size_t j = 0; j < crena_da_len(in); j ++) cv_net_connect(net, a_id, (uint32_t)j, in[j]);
+  va->segs = segs;
+
+  // Nothing reads b's bits any more
+  if (!crena_da_len(b->fanout)) {
+    for (uint32_t j = 0; j < b->n_in; j ++) {
+      if (b->in[j] != CV_NODE_NONE) _cv_fanout_remove(cv_net_node(net, b->in[j]), b_id);
+    }
+    b->op = CV_OP_NONE;
+    b->n_in = 0;
+    net->n_views_folded ++;
+  }
+  return true;
+}
+
+static void _cv_net_fold_views(cv_net* net) {
+  for (size_t i = 0; i < cv_net_len(net); i ++) {
+    if (cv_net_node(net, i)->op == CV_OP_VIEW) _cv_net_clip_view(net, cv_net_node(net, i));
+  }
+  if (!net->fuse) return;
+  bool more = true;
+  while (more) {
+    more = false;
+    for (size_t i = 0; i < cv_net_len(net); i ++) {
+      cv_node* a = cv_net_node(net, i);
+      if (a->op != CV_OP_VIEW) continue;
+      for (uint32_t k = 0; k < a->n_in; k ++) {
+        cv_node_id b = a->in[k];
+        if (b == CV_NODE_NONE || b == i || cv_net_node(net, b)->op != CV_OP_VIEW || cv_net_node(net, b)->watched) continue;
+        if (_cv_net_fold_view(net, (cv_node_id)i, k)) {
+          more = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+static bool _cv_domain_fires(cv_domain* d, cv_bit now) {
+  switch (d->edge) {
+  case CV_EDGE_POS: return now == CV_BIT_1 && d->last != CV_BIT_1;
+  case CV_EDGE_NEG: return now == CV_BIT_0 && d->last != CV_BIT_0;
+  // vvp's edge: 0 to anything, anything to 1, and likewise down
+  case CV_EDGE_BOTH: return now != d->last && (d->last == CV_BIT_0 || d->last == CV_BIT_1 || now == CV_BIT_0 || now == CV_BIT_1);
+  // Marked only by a change
+  case CV_EDGE_ANY: return true;
+  default: return now == CV_BIT_1;
+  }
+}
+
+// Runs the marked domains whose edge came: samples the flops of all of
+// them first, then commits. False when no flop was sampled.
+static bool _cv_net_clock(cv_net* net) {
+  if (!net->domains_pending) return false;
+  net->domains_pending = false;
+
+  crena_da_header(net->fired)->count = 0;
+  for (size_t i = 0; i < crena_da_len(net->domains); i ++) {
+    cv_domain* d = &net->domains[i];
+    if (!d->pending) continue;
+    d->pending = false;
+    cv_bit now = cv_vec4_get_bit(&cv_net_node(net, d->trigger)->value, 0);
+    bool fires = _cv_domain_fires(d, now);
+    d->last = now;
+    if (!fires) continue;
+    net->n_edges ++;
+    for (size_t k = 0; net->on_event && k < crena_da_len(d->events); k ++) net->on_event(net->event_ctx, d->events[k]);
+
+    for (size_t k = 0; k < crena_da_len(d->flops); k ++) {
+      cv_flop* f = &net->flops[d->flops[k]];
+      cv_node* node = cv_net_node(net, f->node);
+      if (d->edge == CV_EDGE_LEVEL) {
+        cv_vec4_fill(&f->sample, f->async == CV_ASYNC_SET ? CV_BIT_1 : CV_BIT_0);
+      } else {
+        // An asserted async input wins over the clock, a clock enable
+        // that is not 1 holds
+        cv_vec4* async = _cv_net_value(net, node->in[3]);
+        cv_vec4* ce = _cv_net_value(net, node->in[2]);
+        if (f->async != CV_ASYNC_NONE && async && cv_vec4_get_bit(async, 0) == CV_BIT_1) continue;
+        if (ce && cv_vec4_get_bit(ce, 0) != CV_BIT_1) continue;
+        cv_vec4* dv = _cv_net_value(net, node->in[0]);
+        if (dv) cv_vec4_assign(&f->sample, dv);
+        else cv_vec4_fill(&f->sample, CV_BIT_X);
+      }
+      crena_da_push(net->fired, d->flops[k]);
+    }
+  }
+
+  for (size_t i = 0; i < crena_da_len(net->fired); i ++) {
+    cv_flop* f = &net->flops[net->fired[i]];
+    cv_node* node = cv_net_node(net, f->node);
+    net->n_flop_updates ++;
+    if (cv_vec4_identical(&node->value, &f->sample)) continue;
+    cv_vec4_copy(&node->value, &f->sample);
+    cv_vec4_refresh_2state(&node->value);
+    _cv_net_changed(net, node);
+  }
+  return crena_da_len(net->fired) > 0;
+}
+
+static void _cv_net_settle_parallel(cv_net* net);
+
+void cv_net_settle(cv_net* net) {
+  net->n_settles ++;
+  if (net->par) {
+    _cv_net_settle_parallel(net);
+    return;
+  }
+
+  bool more = true;
+  while (more) {
+    more = false;
+
+    // Fanout always sits on a later slot, so one upward scan is enough.
+    // Bits set in the current word are picked up by rereading it.
+    size_t words = net->level_start ? CV_WORDS(net->level_start[net->n_levels]) : 0;
+    if (net->compiled && net->first_dirty < words) {
+      size_t counts[3] = {0};
+      net->compiled((char*)net->nodes, net->dirty, counts);
+      net->ctx.n_evals += counts[0];
+      net->ctx.n_2state += counts[1];
+      net->ctx.n_changes += counts[2];
+      net->first_dirty = words;
+    }
+    for (size_t w = net->first_dirty; w < words; w ++) {
+      while (net->dirty[w]) {
+        uint32_t slot = (uint32_t)(w * 64 + __builtin_ctzll(net->dirty[w]));
+        net->dirty[w] &= net->dirty[w] - 1;
+        cv_node* node = cv_net_node(net, net->slot_node[slot]);
+        if (_cv_net_eval(net, &net->ctx, node)) _cv_net_changed(net, node);
+      }
+    }
+    net->first_dirty = words;
+
+    while (net->queue_head < crena_da_len(net->queue)) {
+      cv_node* node = cv_net_node(net, net->queue[net->queue_head++]);
+      node->queued = false;
+      if (_cv_net_eval(net, &net->ctx, node)) _cv_net_changed(net, node);
+      if (net->first_dirty < words) more = true;
+    }
+    net->queue_head = 0;
+    crena_da_header(net->queue)->count = 0;
+
+    if (_cv_net_clock(net)) more = true;
+  }
+}
+
+static void _cv_barrier_wait(cv_barrier* b) {
+  uint32_t gen = __atomic_load_n(&b->gen, __ATOMIC_ACQUIRE);
+  if (__atomic_add_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == b->n) {
+    __atomic_store_n(&b->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->gen, gen + 1, __ATOMIC_RELEASE);
+    return;
+  }
+  for (size_t spins = 0; __atomic_load_n(&b->gen, __ATOMIC_ACQUIRE) == gen; spins ++) {
+    if (spins > KNOB_NET_BARRIER_SPINS) sched_yield();
+  }
+}
+
+// Greedy partitioning, one level at a time since every level is a round.
+// Nodes weigh 1 + fanout. Each goes to the partition holding most of its
+// inputs while that partition has room on this level, otherwise to the
+// least loaded one, which keeps cones together and cuts few edges.
+static void _cv_net_partition(cv_net* net, uint32_t k) {
+  uint32_t* start = net->level_start;
+  cv_node_id* order = net->slot_node;
+  size_t* load = crena_alloc(net->arena, k * sizeof(size_t));
+  size_t* votes = crena_alloc(net->arena, k * sizeof(size_t));
+  for (size_t i = 0; i < cv_net_len(net); i ++) cv_net_node(net, i)->part = 0;
+
+  net->par->n_cut = 0;
+  for (uint32_t l = 1; l < net->n_levels; l ++) {
+    size_t total = 0;
+    for (size_t i = start[l]; i < start[l + 1]; i ++) total += 1 + crena_da_len(cv_net_node(net, order[i])->fanout);
+    size_t room = total / k + total / (8 * k) + 1;
+    memset(load, 0, k * sizeof(size_t));
+
+    for (size_t i = start[l]; i < start[l + 1]; i ++) {
+      cv_node* node = cv_net_node(net, order[i]);
+      size_t weight = 1 + crena_da_len(node->fanout);
+      memset(votes, 0, k * sizeof(size_t));
+      for (uint32_t p = 0; p < node->n_in; p ++) {
+        if (cv_node_in(node, p) == CV_NODE_NONE) continue;
+        cv_node* src = cv_net_node(net, cv_node_in(node, p));
+        if (src->level != 0) votes[src->part] ++;
+      }
+      uint32_t best = 0;
+      for (uint32_t w = 1; w < k; w ++) {
+        if (load[w] < load[best]) best = w;
+      }
+      for (uint32_t w = 0; w < k; w ++) {
+        if (votes[w] > votes[best] && load[w] + weight <= room) best = w;
+      }
+      node->part = (uint16_t)best;
+      load[best] += weight;
+    }
+
+    for (size_t i = start[l]; i < start[l + 1]; i ++) {
+      cv_node* node = cv_net_node(net, order[i]);
+      for (uint32_t p = 0; p < node->n_in; p ++) {
+        if (cv_node_in(node, p) == CV_NODE_NONE) continue;
+        cv_node* src = cv_net_node(net, cv_node_in(node, p));
+        if (src->level != 0 && src->part != node->part) net->par->n_cut ++;
+      }
+    }
+  }
+}
+
+// Level of the worker's first dirty slot from level `from` on
+static uint32_t _cv_worker_next_level(cv_worker* w, uint32_t from) {
+  cv_net* net = w->net;
+  uint32_t lo = net->level_start[from];
+  for (size_t i = lo / 64; i < CV_WORDS(net->level_start[net->n_levels]); i ++) {
+    uint64_t bits = w->dirty[i];
+    if (i == lo / 64) bits &= ~0ULL << (lo % 64);
+    if (bits) return cv_net_node(net, net->slot_node[i * 64 + __builtin_ctzll(bits)])->level;
+  }
+  return net->n_levels;
+}
+
+static uint32_t _cv_par_level(cv_par* par) {
+  uint32_t level = UINT32_MAX;
+  for (uint32_t w = 0; w < par->n_workers; w ++) {
+    if (par->workers[w].next_level < level) level = par->workers[w].next_level;
+  }
+  return level;
+}
+
+static void _cv_worker_take(cv_worker* w, cv_node_id id) {
+  uint32_t slot = w->net->slot_of[id];
+  w->dirty[slot / 64] |= 1ULL << (slot % 64);
+}
+
+// Runs on every worker, the calling thread being worker 0. Between the
+// two barriers of a round a worker only writes its own nodes, lists and
+// outboxes, and reads values of lower levels, which are final.
+static void _cv_worker_sweep(cv_worker* w) {
+  cv_net* net = w->net;
+  cv_par* par = net->par;
+
+  for (uint32_t level = _cv_par_level(par); level < net->n_levels; level = _cv_par_level(par)) {
+    // Fanout lands on later levels, outside the masked slots of this one
+    uint32_t lo = net->level_start[level], hi = net->level_start[level + 1];
+    for (size_t i = lo / 64; i < CV_WORDS(hi); i ++) {
+      uint64_t mask = ~0ULL;
+      if (i == lo / 64) mask &= ~0ULL << (lo % 64);
+      if (i == hi / 64) mask &= (1ULL << (hi % 64)) - 1;
+      uint64_t bits = w->dirty[i] & mask;
+      w->dirty[i] &= ~mask;
+      for (; bits; bits &= bits - 1) {
+        cv_node* node = cv_net_node(net, net->slot_node[i * 64 + __builtin_ctzll(bits)]);
+        if (!_cv_net_eval(net, &w->ctx, node)) continue;
+
+        w->ctx.n_changes ++;
+        _cv_net_arm(net, node);
+        for (size_t f = 0; f < crena_da_len(node->fanout); f ++) {
+          cv_node_id id = node->fanout[f];
+          cv_node* out = cv_net_node(net, id);
+          if (out->level == CV_NO_LEVEL) crena_da_push(w->deferred, id);
+          else if (out->part == w->index) _cv_worker_take(w, id);
+          else crena_da_push(w->outbox[out->part], id);
+        }
+      }
+    }
+    _cv_barrier_wait(&par->barrier);
+
+    for (uint32_t src = 0; src < par->n_workers; src ++) {
+      cv_node_id* box = par->workers[src].outbox[w->index];
+      for (size_t i = 0; i < crena_da_len(box); i ++) _cv_worker_take(w, box[i]);
+      crena_da_header(box)->count = 0;
+    }
+    w->next_level = _cv_worker_next_level(w, level + 1);
+    if (w->index == 0) par->n_rounds ++;
+    _cv_barrier_wait(&par->barrier);
+  }
+}
+
+static void* _cv_worker_main(void* arg) {
+  cv_worker* w = arg;
+  cv_par* par = w->net->par;
+  uint32_t seen = 0;
+  while (1) {
+    pthread_mutex_lock(&par->lock);
+    while (par->start == seen && !par->stop) pthread_cond_wait(&par->wake, &par->lock);
+    seen = par->start;
+    bool stop = par->stop;
+    pthread_mutex_unlock(&par->lock);
+    if (stop) break;
+    _cv_worker_sweep(w);
+    _cv_barrier_wait(&par->barrier);
+  }
+  return NULL;
+}
+
+// Wakes the parked workers for one sweep
+static void _cv_par_start(cv_par* par) {
+  pthread_mutex_lock(&par->lock);
+  par->start ++;
+  pthread_cond_broadcast(&par->wake);
+  pthread_mutex_unlock(&par->lock);
+}
+
+static void _cv_net_settle_parallel(cv_net* net) {
+  cv_par* par = net->par;
+  while (1) {
+    for (uint32_t i = 0; i < par->n_workers; i ++) {
+      par->workers[i].next_level = _cv_worker_next_level(&par->workers[i], 0);
+    }
+    if (_cv_par_level(par) < net->n_levels) {
+      _cv_par_start(par);
+      _cv_worker_sweep(&par->workers[0]);
+      _cv_barrier_wait(&par->barrier);
+
+      // Deferred loop nodes in worker order, then the workers' counters
+      for (uint32_t i = 0; i < par->n_workers; i ++) {
+        cv_worker* w = &par->workers[i];
+        for (size_t d = 0; d < crena_da_len(w->deferred); d ++) cv_net_touch(net, w->deferred[d]);
+        crena_da_header(w->deferred)->count = 0;
+        net->ctx.n_evals += w->ctx.n_evals;
+        net->ctx.n_2state += w->ctx.n_2state;
+        net->ctx.n_changes += w->ctx.n_changes;
+        w->ctx.n_evals = 0;
+        w->ctx.n_2state = 0;
+        w->ctx.n_changes = 0;
+      }
+    }
+    if (_cv_net_clock(net)) continue;
+    if (net->queue_head == crena_da_len(net->queue)) break;
+
+    while (net->queue_head < crena_da_len(net->queue)) {
+      cv_node* node = cv_net_node(net, net->queue[net->queue_head++]);
+      node->queued = false;
+      if (_cv_net_eval(net, &net->ctx, node)) _cv_net_changed(net, node);
+    }
+    net->queue_head = 0;
+    crena_da_header(net->queue)->count = 0;
+  }
+}
+
+static void _cv_net_stop_threads(cv_net* net) {
+  cv_par* par = net->par;
+  if (!par) return;
+  pthread_mutex_lock(&par->lock);
+  par->stop = true;
+  pthread_cond_broadcast(&par->wake);
+  pthread_mutex_unlock(&par->lock);
+  for (uint32_t i = 1; i < par->n_workers; i ++) pthread_join(par->workers[i].thread, NULL);
+  pthread_cond_destroy(&par->wake);
+  pthread_mutex_destroy(&par->lock);
+  for (uint32_t i = 0; i < par->n_workers; i ++) crena_free(&par->workers[i].arena, CRENA_FT_ALL);
+  net->par = NULL;
+}
+
+bool cv_net_set_threads(cv_net* net, uint32_t n) {
+  _cv_net_stop_threads(net);
+  if (n <= 1) return true;
+  if (net->mode != CV_EVAL_LEVELIZED || !net->level_start || n > UINT16_MAX) return false;
+
+  cv_par* par = crena_alloc(net->arena, sizeof(cv_par));
+  *par = (cv_par){ .n_workers = n, .barrier = { .n = n } };
+  pthread_mutex_init(&par->lock, NULL);
+  pthread_cond_init(&par->wake, NULL);
+  par->workers = crena_alloc(net->arena, n * sizeof(cv_worker));
+  net->par = par;
+  _cv_net_partition(net, n);
+  size_t words = CV_WORDS(net->level_start[net->n_levels]);
+
+  for (uint32_t i = 0; i < n; i ++) {
+    cv_worker* w = &par->workers[i];
+    *w = (cv_worker){ .net = net, .index = i, .arena = crena_init_growing() };
+    _cv_eval_ctx_init(&w->ctx, &w->arena, net->max_width);
+    w->dirty = crena_alloc(&w->arena, (words + 1) * sizeof(uint64_t));
+    memset(w->dirty, 0, (words + 1) * sizeof(uint64_t));
+    crena_da_init(w->outbox, &w->arena);
+    for (uint32_t o = 0; o < n; o ++) {
+      cv_node_id* box;
+      crena_da_init(box, &w->arena);
+      crena_da_push(w->outbox, box);
+    }
+    crena_da_init(w->deferred, &w->arena);
+  }
+
+  // Work already pending on the serial bitset moves to the owners
+  for (size_t i = 0; i < words; i ++) {
+    for (; net->dirty[i]; net->dirty[i] &= net->dirty[i] - 1) {
+      cv_net_touch(net, net->slot_node[i * 64 + __builtin_ctzll(net->dirty[i])]);
+    }
+  }
+  net->first_dirty = words;
+
+  for (uint32_t i = 1; i < n; i ++) {
+    pthread_create(&par->workers[i].thread, NULL, _cv_worker_main, &par->workers[i]);
+  }
+  return true;
+}
+
+static bool _cv_lanes_supported(cv_op op) {
+  switch (op) {
+  case CV_OP_VAR: case CV_OP_CONST: case CV_OP_NET: case CV_OP_BUF: case CV_OP_BUFZ:
+  case CV_OP_NOT: case CV_OP_AND: case CV_OP_NAND: case CV_OP_OR: case CV_OP_NOR:
+  case CV_OP_XOR: case CV_OP_XNOR: case CV_OP_MUXZ: case CV_OP_FUSED: case CV_OP_NONE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool cv_lanes_init(cv_lanes* l, cv_net* net, uint32_t n_lanes, crena_arena* arena) {
+  if (net->mode != CV_EVAL_LEVELIZED || !net->level_start) return false;
+  if (n_lanes == 0 || n_lanes % 64) return false;
+
+  size_t n = cv_net_len(net);
+  *l = (cv_lanes){ .net = net, .n_lanes = n_lanes, .group = n_lanes / 64 };
+  l->offset = crena_alloc(arena, n * sizeof(size_t));
+  l->step_offset = crena_alloc(arena, n * sizeof(size_t));
+  size_t total = 0;
+  for (size_t i = 0; i < n; i ++) {
+    cv_node* node = cv_net_node(net, i);
+    if (node->level == CV_NO_LEVEL || !_cv_lanes_supported(node->op)) return false;
+    if (node->op == CV_OP_CONST && cv_vec4_has_xz(&node->value)) return false;
+    uint32_t used = node->op == CV_OP_MUXZ ? 3 : node->n_in;
+    for (uint32_t k = 0; k < used; k ++) {
+      if (cv_node_in(node, k) == CV_NODE_NONE) return false;
+    }
+    l->offset[i] = total;
+    total += (size_t)node->value.width * l->group;
+    // Fused nodes keep rows for every step but the last
+    l->step_offset[i] = total;
+    if (node->fuse) {
+      for (size_t st = 0; st + 1 < crena_da_len(node->fuse->steps); st ++) {
+        total += (size_t)node->fuse->steps[st].width * l->group;
+      }
+    }
+  }
+
+  l->bits = crena_alloc_aligned(arena, total * sizeof(uint64_t), 32);
+  memset(l->bits, 0, total * sizeof(uint64_t));
+  for (size_t k = 0; k < CV_NODE_MAX_IN; k ++) {
+    l->scratch[k] = crena_alloc_aligned(arena, (size_t)net->max_width * l->group * sizeof(uint64_t), 32);
+  }
+
+  // Constants are the same in every lane
+  for (size_t i = 0; i < n; i ++) {
+    cv_node* node = cv_net_node(net, i);
+    if (node->op != CV_OP_CONST) continue;
+    for (uint32_t b = 0; b < node->value.width; b ++) {
+      uint64_t fill = cv_vec4_get_bit(&node->value, b) == CV_BIT_1 ? ~0ULL : 0;
+      for (uint32_t g = 0; g < l->group; g ++) cv_lanes_row(l, i, b)[g] = fill;
+    }
+  }
+
+  // Non source nodes in slot order
+  l->order = net->slot_node + net->level_start[1];
+  l->n_order = net->level_start[net->n_levels] - net->level_start[1];
+  return true;
+}
+
+void cv_lanes_set(cv_lanes* l, cv_node_id id, uint32_t lane, uint64_t value) {
+  uint32_t width = cv_net_node(l->net, id)->value.width;
+  uint64_t m = 1ULL << (lane % 64);
+  for (uint32_t b = 0; b < width; b ++) {
+    uint64_t* w = &cv_lanes_row(l, id, b)[lane / 64];
+    *w = (b < 64 && (value >> b) & 1) ? (*w | m) : (*w & ~m);
+  }
+}
+
+uint64_t cv_lanes_get(cv_lanes* l, cv_node_id id, uint32_t lane) {
+  uint32_t width = cv_net_node(l->net, id)->value.width;
+  uint64_t value = 0;
+  for (uint32_t b = 0; b < width && b < 64; b ++) {
+    value |= ((cv_lanes_row(l, id, b)[lane / 64] >> (lane % 64)) & 1) << b;
+  }
+  return value;
+}
+
+// Rows at the given width, zero extended or truncated
+static uint64_t const* _cv_lanes_resolve(cv_lanes* l, uint64_t const* rows, uint32_t src_width, uint32_t width, size_t slot) {
+  if (src_width == width) return rows;
+  size_t have = (size_t)(src_width < width ? src_width : width) * l->group;
+  size_t want = (size_t)width * l->group;
+  memcpy(l->scratch[slot], rows, have * sizeof(uint64_t));
+  memset(l->scratch[slot] + have, 0, (want - have) * sizeof(uint64_t));
+  return l->scratch[slot];
+}
+
+static void _cv_lanes_op(cv_lanes* l, cv_op op, uint64_t* r, uint64_t const** in, uint32_t n_in, uint32_t width) {
+  size_t n = (size_t)width * l->group;
+  memcpy(r, in[0], n * sizeof(uint64_t));
+
+  switch (op) {
+  case CV_OP_NOT:
+    cv_w2_not(r, r, n);
+    break;
+  case CV_OP_AND:
+  case CV_OP_NAND:
+    for (uint32_t k = 1; k < n_in; k ++) cv_w2_and(r, r, in[k], n);
+    if (op == CV_OP_NAND) cv_w2_not(r, r, n);
+    break;
+  case CV_OP_OR:
+  case CV_OP_NOR:
+    for (uint32_t k = 1; k < n_in; k ++) cv_w2_or(r, r, in[k], n);
+    if (op == CV_OP_NOR) cv_w2_not(r, r, n);
+    break;
+  case CV_OP_XOR:
+  case CV_OP_XNOR:
+    for (uint32_t k = 1; k < n_in; k ++) cv_w2_xor(r, r, in[k], n);
+    if (op == CV_OP_XNOR) cv_w2_not(r, r, n);
+    break;
+  case CV_OP_MUXZ:
+    // Row 0 of the select drives every bit
+    for (uint32_t b = 0; b < width; b ++) {
+      size_t o = (size_t)b * l->group;
+      cv_w2_mux(r + o, in[2], r + o, in[1] + o, l->group);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static void _cv_lanes_eval_fused(cv_lanes* l, cv_node_id id, cv_node* node) {
+  cv_fuse* f = node->fuse;
+  size_t n = crena_da_len(f->steps);
+  size_t rows[KNOB_NET_FUSE_MAX_STEPS];
+  size_t off = l->step_offset[id];
+  for (size_t s = 0; s < n; s ++) {
+    cv_fuse_step* st = &f->steps[s];
+    uint64_t const* in[CV_NODE_MAX_IN];
+    for (uint32_t k = 0; k < st->n_in; k ++) {
+      uint32_t ref = st->in[k];
+      if (ref & CV_FUSE_STEP) {
+        uint32_t j = ref & ~CV_FUSE_STEP;
+        in[k] = _cv_lanes_resolve(l, &l->bits[rows[j]], f->steps[j].width, st->width, k);
+      } else {
+        cv_node_id src = f->in[ref];
+        in[k] = _cv_lanes_resolve(l, cv_lanes_row(l, src, 0), cv_net_node(l->net, src)->value.width, st->width, k);
+      }
+    }
+    rows[s] = s + 1 == n ? l->offset[id] : off;
+    if (s + 1 < n) off += (size_t)st->width * l->group;
+    _cv_lanes_op(l, st->op, &l->bits[rows[s]], in, st->n_in, st->width);
+  }
+}
+
+void cv_lanes_eval(cv_lanes* l) {
+  cv_net* net = l->net;
+  for (size_t i = 0; i < l->n_order; i ++) {
+    cv_node_id id = l->order[i];
+    cv_node* node = cv_net_node(net, id);
+    if (node->fuse) {
+      _cv_lanes_eval_fused(l, id, node);
+      continue;
+    }
+    uint64_t const* in[CV_NODE_MAX_IN];
+    for (uint32_t k = 0; k < node->n_in; k ++) {
+      cv_node_id src = node->in[k];
+      in[k] = _cv_lanes_resolve(l, cv_lanes_row(l, src, 0), cv_net_node(net, src)->value.width, node->value.width, k);
+    }
+    _cv_lanes_op(l, node->op, cv_lanes_row(l, id, 0), in, node->n_in, node->value.width);
+  }
+  l->n_evals += l->n_order;
+}
+
+void cv_net_report(cv_net* net, FILE* out) {
+  fprintf(out, "netlist %zu nodes (%zu fused away), %s, %u levels, %zu evals (%zu two state), %zu changes, %zu settles\n",
+          cv_net_len(net), net->n_fused, net->mode == CV_EVAL_LEVELIZED ? "levelized" : "event driven",
+          net->n_levels, net->ctx.n_evals, net->ctx.n_2state, net->ctx.n_changes, net->n_settles);
+  if (crena_da_len(net->flops)) {
+    fprintf(out, "  %zu flops in %zu domains, %zu edges, %zu flop updates\n",
+            crena_da_len(net->flops), crena_da_len(net->domains), net->n_edges, net->n_flop_updates);
+  }
+  if (crena_da_len(net->resolvs)) fprintf(out, "  %zu resolved nets\n", crena_da_len(net->resolvs));
+  if (crena_da_len(net->views)) {
+    fprintf(out, "  %zu views, %zu folded into their readers\n", crena_da_len(net->views), net->n_views_folded);
+  }
+  if (net->par) {
+    fprintf(out, "  %u threads, %zu cut edges, %zu parallel rounds\n",
+            net->par->n_workers, net->par->n_cut, net->par->n_rounds);
+  }
+}
+
+#endif
+
+#ifdef CVNET_UT
+
+#include <time.h>
+
+// Random reconvergent DAG over a few vars, built the same way in both modes
+static void _cvnet_ut_build(cv_net* net, crena_arena* arena, cv_eval_mode mode, bool fuse, cv_node_id* vars) {
+  cv_net_init(net, arena);
+  net->mode = mode;
+  net->fuse = fuse;
+  for (size_t i = 0; i < 4; i ++) vars[i] = cv_net_add(net, CV_OP_VAR, 8);
+
+  static cv_op const ops[] = {CV_OP_AND, CV_OP_OR, CV_OP_XOR, CV_OP_NAND, CV_OP_NOT, CV_OP_BUF, CV_OP_MUXZ};
+  uint64_t x = 0x2545f4914f6cdd1dULL;
+  for (size_t i = 4; i < 300; i ++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    cv_op op = ops[x % (sizeof(ops) / sizeof(ops[0]))];
+    cv_node_id id = cv_net_add(net, op, 8);
+    uint32_t n_in = op == CV_OP_NOT || op == CV_OP_BUF ? 1 : op == CV_OP_MUXZ ? 3 : 2;
+    for (uint32_t k = 0; k < n_in; k ++) {
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      // Mostly recent nodes for deep paths, sometimes far back for reconvergence
+      size_t back = (x >> 8) % 4 ? 1 + (x >> 16) % 3 : 1 + (x >> 16) % i;
+      cv_net_connect(net, id, k, (cv_node_id)(back > i ? 0 : i - back));
+    }
+  }
+  cv_net_elaborate(net);
+}
+
+// Part selects of part selects into a concat, a repeat, a substitute,
+// a part/pv and a select running off the end. out gets the NETs reading
+// them.
+static void _cvnet_ut_views(cv_net* net, crena_arena* arena, bool fuse, cv_node_id* vars, cv_node_id* out) {
+  cv_net_init(net, arena);
+  net->fuse = fuse;
+  vars[0] = cv_net_add(net, CV_OP_VAR, 16);
+  vars[1] = cv_net_add(net, CV_OP_VAR, 8);
+  cv_node_id p1 = cv_net_add_view(net, 8);
+  cv_net_view_seg(net, p1, 0, 4, 8);
+  cv_net_connect(net, p1, 0, vars[0]);
+  cv_node_id p2 = cv_net_add_view(net, 4);
+  cv_net_view_seg(net, p2, 0, 2, 4);
+  cv_net_connect(net, p2, 0, p1);
+  cv_node_id cat = cv_net_add_view(net, 12);
+  cv_net_view_seg(net, cat, 0, 0, 4);
+  cv_net_view_seg(net, cat, 1, 0, 8);
+  cv_net_connect(net, cat, 0, p2);
+  cv_net_connect(net, cat, 1, vars[1]);
+  cv_node_id rep = cv_net_add_view(net, 12);
+  for (size_t i = 0; i < 3; i ++) cv_net_view_seg(net, rep, 0, 0, 4);
+  cv_net_connect(net, rep, 0, p2);
+  cv_node_id sub = cv_net_add_view(net, 16);
+  cv_net_view_seg(net, sub, 0, 0, 8);
+  cv_net_view_seg(net, sub, 1, 0, 4);
+  cv_net_view_seg(net, sub, 0, 12, 4);
+  cv_net_connect(net, sub, 0, vars[0]);
+  cv_net_connect(net, sub, 1, p2);
+  cv_node_id pv = cv_net_add_view(net, 20);
+  cv_net_view_fill(net, pv, 10, CV_BIT_Z);
+  cv_net_view_seg(net, pv, 0, 0, 8);
+  cv_net_view_fill(net, pv, 2, CV_BIT_Z);
+  cv_net_connect(net, pv, 0, p1);
+  cv_node_id oob = cv_net_add_view(net, 8);
+  cv_net_view_seg(net, oob, 0, 12, 8);
+  cv_net_connect(net, oob, 0, vars[0]);
+  cv_node_id keep = cv_net_add(net, CV_OP_AND, 8);
+  cv_net_connect(net, keep, 0, p1);
+  cv_net_connect(net, keep, 1, p1);
+  cv_node_id views[] = {cat, rep, sub, pv, oob, keep};
+  for (size_t i = 0; i < 6; i ++) {
+    out[i] = cv_net_add(net, CV_OP_NET, cv_net_node(net, views[i])->value.width);
+    cv_net_connect(net, out[i], 0, views[i]);
+  }
+  cv_net_elaborate(net);
+}
+
+void cvnet_unit_test() {
+  crena_arena arena = crena_init_growing();
+  cv_net event, level, threaded;
+  cv_node_id ev_vars[4], lv_vars[4], th_vars[4];
+  _cvnet_ut_build(&event, &arena, CV_EVAL_EVENT, false, ev_vars);
+  _cvnet_ut_build(&level, &arena, CV_EVAL_LEVELIZED, true, lv_vars);
+  _cvnet_ut_build(&threaded, &arena, CV_EVAL_LEVELIZED, true, th_vars);
+  cv_net_set_threads(&threaded, 4);
+  size_t ev_base = event.ctx.n_evals, lv_base = level.ctx.n_evals;
+
+  bool same = true, same_threaded = true;
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+  for (size_t step = 0; step < 200; step ++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    cv_vec4 v;
+    cv_vec4_init(&v, 8, &arena);
+    cv_vec4_set_u64(&v, x >> 32);
+    if (step % 16 == 5) cv_vec4_set_bit(&v, (x >> 8) % 8, CV_BIT_X);
+    cv_net_set(&event, ev_vars[x % 4], &v);
+    cv_net_set(&level, lv_vars[x % 4], &v);
+    cv_net_set(&threaded, th_vars[x % 4], &v);
+    cv_net_settle(&event);
+    cv_net_settle(&level);
+    cv_net_settle(&threaded);
+    // Functors absorbed by fusion no longer hold a value
+    for (size_t i = 0; i < cv_net_len(&event); i ++) {
+      if (cv_net_node(&level, i)->op == CV_OP_NONE) continue;
+      same = same && cv_vec4_identical(&cv_net_node(&event, i)->value, &cv_net_node(&level, i)->value);
+      same_threaded = same_threaded && cv_vec4_identical(&cv_net_node(&threaded, i)->value, &cv_net_node(&level, i)->value);
+    }
+  }
+  printf("Fused %zu functors, values match unfused? %s\n", level.n_fused, same ? "yes" : "no");
+  printf("Two state fast path taken? %s (%zu of %zu evals)\n", level.ctx.n_2state ? "yes" : "no",
+         level.ctx.n_2state, level.ctx.n_evals);
+  printf("4 threads match serial? %s, same evaluations? %s, %zu cut edges\n", same_threaded ? "yes" : "no",
+         threaded.ctx.n_evals == level.ctx.n_evals ? "yes" : "no", threaded.par->n_cut);
+
+  // Between settles the three helpers sleep instead of spinning
+  struct timespec c0, c1, nap = { .tv_nsec = 50 * 1000 * 1000 };
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c0);
+  nanosleep(&nap, NULL);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c1);
+  double idle_ms = (c1.tv_sec - c0.tv_sec) * 1e3 + (c1.tv_nsec - c0.tv_nsec) / 1e6;
+  printf("Idle workers park between settles? %s (%.2f ms CPU over 50 ms)\n", idle_ms < 10 ? "yes" : "no", idle_ms);
+  cv_net_set_threads(&threaded, 1);
+  printf("Levelized needs fewer evaluations? %s (%zu vs %zu)\n",
+         level.ctx.n_evals - lv_base < event.ctx.n_evals - ev_base ? "yes" : "no",
+         level.ctx.n_evals - lv_base, event.ctx.n_evals - ev_base);
+
+  // 256 stimuli in one pass must match 256 serial four state runs
+  cv_lanes lanes;
+  bool lanes_ok = cv_lanes_init(&lanes, &level, 256, &arena);
+  uint64_t stim[256][4];
+  for (uint32_t lane = 0; lane < 256; lane ++) {
+    for (size_t v = 0; v < 4; v ++) {
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      stim[lane][v] = x & 0xff;
+      cv_lanes_set(&lanes, lv_vars[v], lane, stim[lane][v]);
+    }
+  }
+  cv_lanes_eval(&lanes);
+  for (uint32_t lane = 0; lanes_ok && lane < 256; lane ++) {
+    for (size_t v = 0; v < 4; v ++) {
+      cv_vec4 val;
+      cv_vec4_init(&val, 8, &arena);
+      cv_vec4_set_u64(&val, stim[lane][v]);
+      cv_net_set(&level, lv_vars[v], &val);
+    }
+    cv_net_settle(&level);
+    for (size_t i = 0; i < cv_net_len(&level); i ++) {
+      if (cv_net_node(&level, i)->op == CV_OP_NONE) continue;
+      cv_vec4* val = &cv_net_node(&level, i)->value;
+      lanes_ok = lanes_ok && !cv_vec4_has_xz(val) && val->small.a == cv_lanes_get(&lanes, i, lane);
+    }
+  }
+  printf("256 lanes match serial runs? %s\n", lanes_ok ? "yes" : "no");
+
+  // A change masked by a 0 stops at the gate that masks it
+  cv_net mask;
+  cv_net_init(&mask, &arena);
+  mask.fuse = false;
+  cv_node_id ma = cv_net_add(&mask, CV_OP_VAR, 1);
+  cv_node_id mb = cv_net_add(&mask, CV_OP_VAR, 1);
+  cv_node_id mg = cv_net_add(&mask, CV_OP_AND, 1);
+  cv_node_id mn = cv_net_add(&mask, CV_OP_NOT, 1);
+  cv_net_connect(&mask, mg, 0, ma);
+  cv_net_connect(&mask, mg, 1, mb);
+  cv_net_connect(&mask, mn, 0, mg);
+  cv_vec4 bit;
+  cv_vec4_init(&bit, 1, &arena);
+  cv_vec4_set_u64(&bit, 0);
+  cv_net_set(&mask, ma, &bit);
+  cv_net_set(&mask, mb, &bit);
+  cv_net_elaborate(&mask);
+  size_t mask_base = mask.ctx.n_evals;
+  cv_vec4_set_u64(&bit, 1);
+  cv_net_set(&mask, ma, &bit);
+  cv_net_settle(&mask);
+  printf("Masked change evaluates only the masking gate? %s\n",
+         mask.ctx.n_evals - mask_base == 1 && cv_vec4_get_bit(&cv_net_node(&mask, mn)->value, 0) == CV_BIT_1 ? "yes" : "no");
+
+  // An 8 flop shift register with async clear, a negedge flop and a
+  // latch, serial and on 2 threads
+  bool shift_ok = true, latch_ok = true;
+  size_t shift_edges = 0;
+  for (uint32_t threads = 1; threads <= 2; threads ++) {
+    cv_net seq;
+    cv_net_init(&seq, &arena);
+    cv_node_id clk = cv_net_add(&seq, CV_OP_VAR, 1);
+    cv_node_id din = cv_net_add(&seq, CV_OP_VAR, 1);
+    cv_node_id rst = cv_net_add(&seq, CV_OP_VAR, 1);
+    cv_node_id q[8];
+    for (size_t i = 0; i < 8; i ++) {
+      q[i] = cv_net_add_dff(&seq, 1, CV_EDGE_POS, CV_ASYNC_CLEAR);
+      cv_net_connect(&seq, q[i], 0, i ? q[i - 1] : din);
+      cv_net_connect(&seq, q[i], 1, clk);
+      cv_net_connect(&seq, q[i], 3, rst);
+    }
+    cv_node_id neg = cv_net_add_dff(&seq, 1, CV_EDGE_NEG, CV_ASYNC_NONE);
+    cv_net_connect(&seq, neg, 0, q[7]);
+    cv_net_connect(&seq, neg, 1, clk);
+    cv_node_id lat = cv_net_add(&seq, CV_OP_LATCH, 1);
+    cv_net_connect(&seq, lat, 0, din);
+    cv_net_connect(&seq, lat, 1, clk);
+
+    cv_vec4 b;
+    cv_vec4_init(&b, 1, &arena);
+    cv_vec4_set_u64(&b, 0);
+    cv_net_set(&seq, clk, &b);
+    cv_net_set(&seq, din, &b);
+    cv_net_set(&seq, rst, &b);
+    cv_net_elaborate(&seq);
+    cv_net_set_threads(&seq, threads);
+
+    uint64_t reg = 0, sent = 0;
+    for (size_t cycle = 0; cycle < 24; cycle ++) {
+      uint64_t bit = (0xb2c5a3ULL >> cycle) & 1;
+      cv_vec4_set_u64(&b, bit);
+      cv_net_set(&seq, din, &b);
+      cv_net_settle(&seq);
+      cv_vec4_set_u64(&b, 1);
+      cv_net_set(&seq, clk, &b);
+      cv_net_settle(&seq);
+      reg = (reg << 1 | bit) & 0xff;
+      sent ++;
+      latch_ok = latch_ok && cv_vec4_get_bit(&cv_net_node(&seq, lat)->value, 0) == (cv_bit)bit;
+      cv_vec4_set_u64(&b, 0);
+      cv_net_set(&seq, clk, &b);
+      cv_vec4_set_u64(&b, !bit);
+      cv_net_set(&seq, din, &b);
+      cv_net_settle(&seq);
+      // The latch holds while clk is low
+      latch_ok = latch_ok && cv_vec4_get_bit(&cv_net_node(&seq, lat)->value, 0) == (cv_bit)bit;
+      for (size_t i = 0; i < 8; i ++) {
+        cv_bit want = i < sent ? (cv_bit)((reg >> i) & 1) : CV_BIT_X;
+        shift_ok = shift_ok && cv_vec4_get_bit(&cv_net_node(&seq, q[i])->value, 0) == want;
+      }
+      shift_ok = shift_ok && cv_vec4_get_bit(&cv_net_node(&seq, neg)->value, 0) == (sent >= 8 ? (cv_bit)((reg >> 7) & 1) : CV_BIT_X);
+    }
+
+    // Clear wins over the clock while asserted
+    cv_vec4_set_u64(&b, 1);
+    cv_net_set(&seq, rst, &b);
+    cv_net_settle(&seq);
+    cv_net_set(&seq, clk, &b);
+    cv_net_set(&seq, din, &b);
+    cv_net_settle(&seq);
+    for (size_t i = 0; i < 8; i ++) shift_ok = shift_ok && cv_vec4_get_bit(&cv_net_node(&seq, q[i])->value, 0) == CV_BIT_0;
+    shift_edges = seq.n_edges;
+    cv_net_set_threads(&seq, 1);
+  }
+  printf("Shift register clocks as one batch per edge? %s (%zu edges), latch follows and holds? %s\n",
+         shift_ok ? "yes" : "no", shift_edges, latch_ok ? "yes" : "no");
+
+  // A loop keeps working through the event queue
+  cv_net loop;
+  cv_net_init(&loop, &arena);
+  cv_node_id a = cv_net_add(&loop, CV_OP_VAR, 1);
+  cv_node_id g = cv_net_add(&loop, CV_OP_OR, 1);
+  cv_node_id b = cv_net_add(&loop, CV_OP_BUFZ, 1);
+  cv_net_connect(&loop, g, 0, a);
+  cv_net_connect(&loop, g, 1, b);
+  cv_net_connect(&loop, b, 0, g);
+  cv_net_elaborate(&loop);
+  cv_vec4 one;
+  cv_vec4_init(&one, 1, &arena);
+  cv_vec4_set_u64(&one, 1);
+  cv_net_set(&loop, a, &one);
+  cv_net_settle(&loop);
+  printf("Latched loop settles to 1? %s\n", cv_vec4_get_bit(&cv_net_node(&loop, b)->value, 0) == CV_BIT_1 ? "yes" : "no");
+
+  // 200 bit sum and product, compared against a narrower operand
+  cv_net ar;
+  cv_net_init(&ar, &arena);
+  cv_node_id ax = cv_net_add(&ar, CV_OP_VAR, 200);
+  cv_node_id ay = cv_net_add(&ar, CV_OP_VAR, 200);
+  cv_node_id k = cv_net_add(&ar, CV_OP_CONST, 8);
+  cv_node_id sum = cv_net_add(&ar, CV_OP_ADD, 200);
+  cv_node_id prod = cv_net_add(&ar, CV_OP_MUL, 200);
+  cv_node_id gt = cv_net_add(&ar, CV_OP_GT, 1);
+  cv_node_id shl = cv_net_add(&ar, CV_OP_SHL, 200);
+  cv_net_connect(&ar, sum, 0, ax);
+  cv_net_connect(&ar, sum, 1, ay);
+  cv_net_connect(&ar, prod, 0, sum);
+  cv_net_connect(&ar, prod, 1, sum);
+  cv_net_connect(&ar, gt, 0, sum);
+  cv_net_connect(&ar, gt, 1, k);
+  cv_net_connect(&ar, shl, 0, sum);
+  cv_net_connect(&ar, shl, 1, k);
+  cv_vec4_set_u64(&cv_net_node(&ar, k)->value, 100);
+  cv_net_elaborate(&ar);
+  cv_vec4 wide;
+  cv_vec4_init(&wide, 200, &arena);
+  cv_vec4_set_u64(&wide, ~0ULL);
+  cv_net_set(&ar, ax, &wide);
+  cv_vec4_set_u64(&wide, 1);
+  cv_net_set(&ar, ay, &wide);
+  cv_net_settle(&ar);
+  // (2^64)^2 = 2^128 and 2^64 << 100 = 2^164
+  uint64_t* pa = cv_vec4_aval(&cv_net_node(&ar, prod)->value);
+  uint64_t* sa = cv_vec4_aval(&cv_net_node(&ar, shl)->value);
+  bool arith_ok = pa[0] == 0 && pa[1] == 0 && pa[2] == 1 && sa[2] == 1ULL << 36 &&
+                  cv_vec4_get_bit(&cv_net_node(&ar, sum)->value, 64) == CV_BIT_1 &&
+                  cv_vec4_get_bit(&cv_net_node(&ar, gt)->value, 0) == CV_BIT_1;
+  cv_vec4_set_bit(&wide, 150, CV_BIT_X);
+  cv_net_set(&ar, ay, &wide);
+  cv_net_settle(&ar);
+  arith_ok = arith_ok && cv_vec4_get_bit(&cv_net_node(&ar, prod)->value, 0) == CV_BIT_X &&
+             cv_vec4_get_bit(&cv_net_node(&ar, gt)->value, 0) == CV_BIT_X;
+  printf("Wide arithmetic nodes settle, x poisons them? %s\n", arith_ok ? "yes" : "no");
+
+  // Layouts that need the most scratch: a two limb divisor through Knuth D,
+  // and a product wide enough for Karatsuba
+  cv_net dm;
+  cv_net_init(&dm, &arena);
+  cv_node_id dx = cv_net_add(&dm, CV_OP_VAR, 128);
+  cv_node_id dy = cv_net_add(&dm, CV_OP_VAR, 128);
+  cv_node_id quo = cv_net_add(&dm, CV_OP_DIV, 128);
+  cv_node_id rem = cv_net_add(&dm, CV_OP_MOD, 128);
+  cv_node_id kx = cv_net_add(&dm, CV_OP_VAR, 1024);
+  cv_node_id ksq = cv_net_add(&dm, CV_OP_MUL, 1024);
+  cv_net_connect(&dm, quo, 0, dx);
+  cv_net_connect(&dm, quo, 1, dy);
+  cv_net_connect(&dm, rem, 0, dx);
+  cv_net_connect(&dm, rem, 1, dy);
+  cv_net_connect(&dm, ksq, 0, kx);
+  cv_net_connect(&dm, ksq, 1, kx);
+  cv_net_elaborate(&dm);
+  cv_vec4 d128, d1024;
+  cv_vec4_init(&d128, 128, &arena);
+  cv_vec4_init(&d1024, 1024, &arena);
+  cv_vec4_set_u64(&d128, 0x0123456789abcdefULL);
+  cv_vec4_aval(&d128)[1] = 0xfedcba9876543210ULL;
+  cv_net_set(&dm, dx, &d128);
+  cv_vec4_set_u64(&d128, 0xdeadbeefULL);
+  cv_vec4_aval(&d128)[1] = 3;
+  cv_net_set(&dm, dy, &d128);
+  // (2^512 + 1)^2 = 2^1024 + 2^513 + 1, the top term cut off
+  cv_vec4_set_u64(&d1024, 1);
+  cv_vec4_set_bit(&d1024, 512, CV_BIT_1);
+  cv_net_set(&dm, kx, &d1024);
+  cv_net_settle(&dm);
+  _cv_u128 nx = (_cv_u128)0xfedcba9876543210ULL << 64 | 0x0123456789abcdefULL;
+  _cv_u128 ny = (_cv_u128)3 << 64 | 0xdeadbeefULL;
+  uint64_t* qa = cv_vec4_aval(&cv_net_node(&dm, quo)->value);
+  uint64_t* ra = cv_vec4_aval(&cv_net_node(&dm, rem)->value);
+  uint64_t* ka = cv_vec4_aval(&cv_net_node(&dm, ksq)->value);
+  bool big_ok = ((_cv_u128)qa[1] << 64 | qa[0]) == nx / ny && ((_cv_u128)ra[1] << 64 | ra[0]) == nx % ny;
+  for (size_t i = 0; i < 16; i ++) big_ok = big_ok && ka[i] == (i == 0 ? 1 : i == 8 ? 2 : 0);
+  printf("128 bit div/mod and 1024 bit mul nodes within their scratch? %s\n", big_ok ? "yes" : "no");
+
+  // Five drivers on a tri1 bus through vvp style chained resolvers: a
+  // pull 0, and a strong driver at a time while the others float
+  cv_net bus;
+  cv_net_init(&bus, &arena);
+  cv_node_id drv[5];
+  for (size_t i = 0; i < 5; i ++) drv[i] = cv_net_add(&bus, CV_OP_VAR, 8);
+  cv_net_node(&bus, drv[4])->drive = CV_SC(CV_STRENGTH_PULL, CV_STRENGTH_PULL);
+  cv_node_id lo = cv_net_add_resolv(&bus, 0, CV_RESOLV_TRI);
+  cv_node_id top = cv_net_add_resolv(&bus, 0, CV_RESOLV_TRI1);
+  for (uint32_t i = 0; i < 4; i ++) cv_net_connect(&bus, lo, i, drv[i]);
+  cv_net_connect(&bus, top, 0, lo);
+  cv_net_connect(&bus, top, 1, drv[4]);
+  cv_vec4 byte;
+  cv_vec4_init(&byte, 8, &arena);
+  cv_vec4_fill(&byte, CV_BIT_Z);
+  for (size_t i = 0; i < 5; i ++) cv_net_set(&bus, drv[i], &byte);
+  cv_net_elaborate(&bus);
+  char out[4][16];
+  cv_vec4_to_str(&cv_net_node(&bus, top)->value, out[0]);
+  cv_vec4_set_str(&byte, "zzzz0000", 8);
+  cv_net_set(&bus, drv[4], &byte);
+  cv_vec4_set_str(&byte, "1z1z1z1z", 8);
+  cv_net_set(&bus, drv[2], &byte);
+  cv_net_settle(&bus);
+  cv_vec4_to_str(&cv_net_node(&bus, top)->value, out[1]);
+  cv_vec4_set_str(&byte, "0000zzzz", 8);
+  cv_net_set(&bus, drv[1], &byte);
+  cv_net_settle(&bus);
+  cv_vec4_to_str(&cv_net_node(&bus, top)->value, out[2]);
+  printf("Resolved bus floats, pulls and fights: %s %s %s? %s\n", out[0], out[1], out[2],
+         strcmp(out[0], "11111111") == 0 && strcmp(out[1], "11111010") == 0 &&
+         strcmp(out[2], "x0x01010") == 0 ? "yes" : "no");
+
+  // Folded views against unfolded ones and against the bits by hand
+  cv_net folded, plain;
+  cv_node_id fv[2], pvars[2], fo[6], po[6];
+  _cvnet_ut_views(&folded, &arena, true, fv, fo);
+  _cvnet_ut_views(&plain, &arena, false, pvars, po);
+  cv_vec4 w16, w8;
+  cv_vec4_init(&w16, 16, &arena);
+  cv_vec4_init(&w8, 8, &arena);
+  bool views_same = true;
+  for (size_t step = 0; step < 100; step ++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    cv_vec4_set_u64(&w16, x & 0xffff);
+    cv_vec4_set_u64(&w8, (x >> 16) & 0xff);
+    if (step % 8 == 3) cv_vec4_set_bit(&w16, (x >> 24) % 16, CV_BIT_Z);
+    cv_net_set(&folded, fv[step % 2], step % 2 ? &w8 : &w16);
+    cv_net_set(&plain, pvars[step % 2], step % 2 ? &w8 : &w16);
+    cv_net_settle(&folded);
+    cv_net_settle(&plain);
+    for (size_t i = 0; i < 6; i ++) {
+      views_same = views_same && cv_vec4_identical(&cv_net_node(&folded, fo[i])->value, &cv_net_node(&plain, po[i])->value);
+    }
+  }
+  cv_vec4_set_u64(&w16, 0xabcd);
+  cv_vec4_set_u64(&w8, 0x5a);
+  cv_net_set(&folded, fv[0], &w16);
+  cv_net_set(&folded, fv[1], &w8);
+  cv_net_settle(&folded);
+  char pvs[24], oobs[12];
+  cv_vec4_to_str(&cv_net_node(&folded, fo[3])->value, pvs);
+  cv_vec4_to_str(&cv_net_node(&folded, fo[4])->value, oobs);
+  // a[9:6] = f
+  bool views_ok = cv_vec4_aval(&cv_net_node(&folded, fo[0])->value)[0] == 0x5af &&
+                  cv_vec4_aval(&cv_net_node(&folded, fo[1])->value)[0] == 0xfff &&
+                  cv_vec4_aval(&cv_net_node(&folded, fo[2])->value)[0] == 0xafcd &&
+                  strcmp(pvs, "zz10111100zzzzzzzzzz") == 0 && strcmp(oobs, "xxxx1010") == 0;
+  printf("Folded views match unfolded? %s, bits by hand? %s, %zu of %zu views folded away\n",
+         views_same ? "yes" : "no", views_ok ? "yes" : "no", folded.n_views_folded, crena_da_len(folded.views));
+
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
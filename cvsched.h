@@ -0,0 +1,366 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "crena.h"
+
+// Event scheduler for the simulation kernel.
+// Every time step runs the Verilog stratified event queue: active events
+// run until none are left, then the inactive (#0) events become active,
+// then the nonblocking assignment updates, and finally the monitor region
+// ($monitor/$strobe, read only) once the step has settled.
+// Future events go into a hierarchical timing wheel: KNOB_WHEEL_LEVELS
+// levels of KNOB_WHEEL_SLOTS slots, level L covering 256^L ticks per slot,
+// with an occupancy bitmap per level so finding the next time is a few
+// word scans. An event sits at the level of the highest byte where its
+// time differs from now and is cascaded down when now reaches its slot.
+// Events further out than the wheel spans go to a binary heap and move
+// into the wheel once they come in range. Times are in ticks of the
+// module's vpi_time_precision.
+
+#define KNOB_WHEEL_BITS 8
+#define KNOB_WHEEL_SLOTS (1 << KNOB_WHEEL_BITS)
+#define KNOB_WHEEL_LEVELS 4
+
+typedef uint64_t cv_time;
+
+typedef enum {
+  CV_REGION_ACTIVE,
+  CV_REGION_INACTIVE,
+  CV_REGION_NBA,
+  CV_REGION_MONITOR,
+  CV_REGION_COUNT
+} cv_region;
+
+struct _cv_sched;
+struct _cv_event;
+
+typedef void (*cv_event_fn)(struct _cv_sched* sched, struct _cv_event* ev);
+
+typedef struct _cv_event {
+  struct _cv_event* next;
+  cv_time time;
+  cv_event_fn fn;
+  void* ctx;
+  uint64_t arg;
+  cv_region region;
+} cv_event;
+
+typedef struct {
+  cv_event* head;
+  cv_event* tail;
+} cv_event_list;
+
+typedef struct _cv_sched {
+  cv_time now;
+  int32_t precision;
+  bool finished;
+  cv_event_list regions[CV_REGION_COUNT];
+  cv_event_list wheel[KNOB_WHEEL_LEVELS][KNOB_WHEEL_SLOTS];
+  uint64_t occupied[KNOB_WHEEL_LEVELS][KNOB_WHEEL_SLOTS / 64];
+  cv_event** far;
+  crena_pool pool;
+  crena_arena* arena;
+  size_t n_events;
+  size_t n_deltas;
+  size_t n_steps;
+  size_t n_cascades;
+} cv_sched;
+
+void cv_sched_init(cv_sched* sched, crena_arena* arena, int32_t precision);
+cv_event* cv_sched_schedule(cv_sched* sched, cv_time delay, cv_region region,
+                            cv_event_fn fn, void* ctx, uint64_t arg);
+void cv_sched_run(cv_sched* sched, cv_time until);
+void cv_sched_finish(cv_sched* sched);
+cv_time cv_sched_ticks(cv_sched* sched, uint64_t value, int32_t units);
+void cv_sched_report(cv_sched* sched, FILE* out);
+
+#ifdef CVSCHED_IMPLEMENTATION
+
+static void _cv_list_push(cv_event_list* list, cv_event* ev) {
+  ev->next = NULL;
+  if (list->tail) {
+    list->tail->next = ev;
+  } else {
+    list->head = ev;
+  }
+  list->tail = ev;
+}
+
+static void _cv_list_splice(cv_event_list* dst, cv_event_list* src) {
+  if (!src->head) return;
+  if (dst->tail) {
+    dst->tail->next = src->head;
+  } else {
+    dst->head = src->head;
+  }
+  dst->tail = src->tail;
+  src->head = src->tail = NULL;
+}
+
+void cv_sched_init(cv_sched* sched, crena_arena* arena, int32_t precision) {
+  memset(sched, 0, sizeof(*sched));
+  sched->arena = arena;
+  sched->precision = precision;
+  sched->pool = crena_pool_init(arena);
+  crena_da_init(sched->far, arena);
+}
+
+void cv_sched_finish(cv_sched* sched) {
+  sched->finished = true;
+}
+
+// Scale a delay given in 10^units seconds to simulation ticks
+cv_time cv_sched_ticks(cv_sched* sched, uint64_t value, int32_t units) {
+  for (int32_t e = units; e > sched->precision; e --) value *= 10;
+  return value;
+}
+
+static void _cv_far_push(cv_sched* sched, cv_event* ev) {
+  crena_da_push(sched->far, ev);
+  cv_event** heap = sched->far;
+  size_t i = crena_da_len(heap) - 1;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (heap[parent]->time <= heap[i]->time) break;
+    cv_event* t = heap[parent];
+    heap[parent] = heap[i];
+    heap[i] = t;
+    i = parent;
+  }
+}
+
+static cv_event* _cv_far_pop(cv_sched* sched) {
+  cv_event** heap = sched->far;
+  cv_event* top = heap[0];
+  cv_event* last = crena_da_pop(heap);
+  size_t n = crena_da_len(heap);
+  if (n == 0) return top;
+
+  heap[0] = last;
+  size_t i = 0;
+  for (;;) {
+    size_t l = 2 * i + 1;
+    size_t r = l + 1;
+    size_t m = i;
+    if (l < n && heap[l]->time < heap[m]->time) m = l;
+    if (r < n && heap[r]->time < heap[m]->time) m = r;
+    if (m == i) break;
+    cv_event* t = heap[m];
+    heap[m] = heap[i];
+    heap[i] = t;
+    i = m;
+  }
+  return top;
+}
+
+static void _cv_sched_insert(cv_sched* sched, cv_event* ev) {
+  cv_time diff = ev->time ^ sched->now;
+  if (diff == 0) {
+    _cv_list_push(&sched->regions[ev->region], ev);
+    return;
+  }
+
+  size_t level = (63 - __builtin_clzll(diff)) / KNOB_WHEEL_BITS;
+  if (level >= KNOB_WHEEL_LEVELS) {
+    _cv_far_push(sched, ev);
+    return;
+  }
+
+  size_t slot = (ev->time >> (level * KNOB_WHEEL_BITS)) & (KNOB_WHEEL_SLOTS - 1);
+  _cv_list_push(&sched->wheel[level][slot], ev);
+  sched->occupied[level][slot / 64] |= 1ULL << (slot % 64);
+}
+
+cv_event* cv_sched_schedule(cv_sched* sched, cv_time delay, cv_region region,
+                            cv_event_fn fn, void* ctx, uint64_t arg) {
+  cv_event* ev = CRPa(&sched->pool, cv_event);
+  ev->time = sched->now + delay;
+  ev->fn = fn;
+  ev->ctx = ctx;
+  ev->arg = arg;
+  ev->region = region;
+  _cv_sched_insert(sched, ev);
+  return ev;
+}
+
+// First occupied slot of a level strictly after `from`, or KNOB_WHEEL_SLOTS
+static size_t _cv_wheel_next(cv_sched* sched, size_t level, size_t from) {
+  size_t slot = from + 1;
+  while (slot < KNOB_WHEEL_SLOTS) {
+    uint64_t word = sched->occupied[level][slot / 64] >> (slot % 64);
+    if (word) return slot + __builtin_ctzll(word);
+    slot = (slot | 63) + 1;
+  }
+  return KNOB_WHEEL_SLOTS;
+}
+
+// Moves now to the next time that has events and puts them in their
+// regions. False if there is nothing left before `until`.
+static bool _cv_sched_advance(cv_sched* sched, cv_time until) {
+  for (;;) {
+    size_t level = 0;
+    size_t slot = KNOB_WHEEL_SLOTS;
+    for (; level < KNOB_WHEEL_LEVELS; level ++) {
+      size_t shift = level * KNOB_WHEEL_BITS;
+      slot = _cv_wheel_next(sched, level, (sched->now >> shift) & (KNOB_WHEEL_SLOTS - 1));
+      if (slot < KNOB_WHEEL_SLOTS) break;
+    }
+
+    cv_time next;
+    if (level < KNOB_WHEEL_LEVELS) {
+      size_t shift = level * KNOB_WHEEL_BITS;
+      cv_time span = (cv_time)1 << (shift + KNOB_WHEEL_BITS);
+      next = (sched->now & ~(span - 1)) | ((cv_time)slot << shift);
+    } else if (crena_da_len(sched->far)) {
+      next = sched->far[0]->time;
+    } else {
+      return false;
+    }
+    if (next > until) return false;
+
+    // Nothing is scheduled in between, so jumping there is safe
+    sched->now = next;
+
+    // Bring far events into range once the wheel spans them
+    while (crena_da_len(sched->far) &&
+           (sched->far[0]->time ^ sched->now) >> (KNOB_WHEEL_LEVELS * KNOB_WHEEL_BITS) == 0) {
+      _cv_sched_insert(sched, _cv_far_pop(sched));
+    }
+
+    if (level < KNOB_WHEEL_LEVELS) {
+      cv_event_list list = sched->wheel[level][slot];
+      sched->wheel[level][slot].head = sched->wheel[level][slot].tail = NULL;
+      sched->occupied[level][slot / 64] &= ~(1ULL << (slot % 64));
+
+      if (level == 0) {
+        // All of them are due now; keep them in scheduling order
+        for (cv_event* ev = list.head; ev;) {
+          cv_event* next_ev = ev->next;
+          _cv_list_push(&sched->regions[ev->region], ev);
+          ev = next_ev;
+        }
+        return true;
+      }
+
+      // Cascade: the slot now lines up with now, so its events land on
+      // lower levels (or are due right now)
+      sched->n_cascades ++;
+      for (cv_event* ev = list.head; ev;) {
+        cv_event* next_ev = ev->next;
+        _cv_sched_insert(sched, ev);
+        ev = next_ev;
+      }
+    }
+
+    for (size_t r = 0; r < CV_REGION_COUNT; r ++) {
+      if (sched->regions[r].head) return true;
+    }
+  }
+}
+
+static void _cv_sched_run_list(cv_sched* sched, cv_event_list* list) {
+  while (list->head && !sched->finished) {
+    cv_event* ev = list->head;
+    list->head = ev->next;
+    if (!list->head) list->tail = NULL;
+    ev->fn(sched, ev);
+    sched->n_events ++;
+    CRPf(&sched->pool, ev);
+  }
+}
+
+static void _cv_sched_run_step(cv_sched* sched) {
+  while (!sched->finished) {
+    cv_event_list* regions = sched->regions;
+    _cv_sched_run_list(sched, &regions[CV_REGION_ACTIVE]);
+    if (sched->finished) break;
+
+    if (regions[CV_REGION_INACTIVE].head) {
+      _cv_list_splice(&regions[CV_REGION_ACTIVE], &regions[CV_REGION_INACTIVE]);
+      continue;
+    }
+    if (regions[CV_REGION_NBA].head) {
+      sched->n_deltas ++;
+      _cv_list_splice(&regions[CV_REGION_ACTIVE], &regions[CV_REGION_NBA]);
+      continue;
+    }
+
+    // Monitors only read, but anything they do schedule for now still runs
+    _cv_sched_run_list(sched, &regions[CV_REGION_MONITOR]);
+    if (!regions[CV_REGION_ACTIVE].head && !regions[CV_REGION_INACTIVE].head && !regions[CV_REGION_NBA].head) {
+      break;
+    }
+  }
+}
+
+void cv_sched_run(cv_sched* sched, cv_time until) {
+  while (!sched->finished) {
+    _cv_sched_run_step(sched);
+    sched->n_steps ++;
+    if (sched->finished || !_cv_sched_advance(sched, until)) break;
+  }
+}
+
+void cv_sched_report(cv_sched* sched, FILE* out) {
+  fprintf(out, "sim time %" PRIu64 ", %zu time steps, %zu events, %zu nba deltas, %zu cascades\n",
+          sched->now, sched->n_steps, sched->n_events, sched->n_deltas, sched->n_cascades);
+}
+
+#endif
+
+#ifdef CVSCHED_UT
+
+static cv_time _cvsched_ut_last;
+static bool _cvsched_ut_ordered = true;
+static char _cvsched_ut_trace[16];
+static size_t _cvsched_ut_ntrace;
+
+static void _cvsched_ut_timed(cv_sched* sched, cv_event* ev) {
+  if (sched->now < _cvsched_ut_last || sched->now != ev->arg) _cvsched_ut_ordered = false;
+  _cvsched_ut_last = sched->now;
+}
+
+static void _cvsched_ut_region(cv_sched* sched, cv_event* ev) {
+  (void)sched;
+  if (_cvsched_ut_ntrace < sizeof(_cvsched_ut_trace) - 1) _cvsched_ut_trace[_cvsched_ut_ntrace++] = (char)ev->arg;
+}
+
+static void _cvsched_ut_spawn(cv_sched* sched, cv_event* ev) {
+  _cvsched_ut_region(sched, ev);
+  cv_sched_schedule(sched, 0, CV_REGION_NBA, _cvsched_ut_region, NULL, 'N');
+  cv_sched_schedule(sched, 0, CV_REGION_INACTIVE, _cvsched_ut_region, NULL, 'I');
+  cv_sched_schedule(sched, 0, CV_REGION_MONITOR, _cvsched_ut_region, NULL, 'M');
+  cv_sched_schedule(sched, 0, CV_REGION_ACTIVE, _cvsched_ut_region, NULL, 'a');
+}
+
+void cvsched_unit_test() {
+  crena_arena arena = crena_init_growing();
+  cv_sched sched;
+  cv_sched_init(&sched, &arena, -12);
+
+  cv_sched_schedule(&sched, 5, CV_REGION_ACTIVE, _cvsched_ut_spawn, NULL, 'A');
+  cv_sched_run(&sched, ~(cv_time)0);
+  printf("Region order in one step: %s\n", _cvsched_ut_trace);
+
+  // Pseudo random delays from 1 tick to well past the wheel span
+  uint64_t x = 88172645463325252ULL;
+  for (size_t i = 0; i < 20000; i ++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    cv_time delay = (x % 64 == 0) ? (x >> 20) : (x % 100000) + 1;
+    cv_sched_schedule(&sched, delay, CV_REGION_ACTIVE, _cvsched_ut_timed, NULL, sched.now + delay);
+  }
+  cv_sched_run(&sched, ~(cv_time)0);
+  printf("Timed events ran in order? %s, %zu events\n", _cvsched_ut_ordered ? "yes" : "no", sched.n_events);
+  printf("10 ns at 1 ps precision is %" PRIu64 " ticks\n", cv_sched_ticks(&sched, 10, -9));
+
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cvvec.h"
+
+// Strength resolution for multiply driven (.resolv) nets.
+// Every bit of a driver becomes a one byte code holding the strength
+// (0 highz .. 7 supply, vvp's numbering) of its 0 and of its 1 component:
+// a 0 at s is (s, 0), a 1 is (0, s), x is (s, s) and z is (0, 0). A code
+// fits in 6 bits, so resolving two codes is one lookup in a 64 x 64 table
+// per net kind. tri nets need no table while folding: the stronger side
+// always wins and equal strengths give x, so the fold is a max over each
+// of the two fields, 32 bits per AVX2 instruction, and one lookup in a 64
+// entry table normalizes the result at the end. wand/wor style nets break
+// strength ties with and/or and fold through their tables.
+// Ambiguous strength ranges (vvp's L/H and mixed x) are not kept: an x
+// carries the stronger of its two strengths.
+
+typedef uint8_t cv_sc;
+
+#define CV_SC(s0, s1) ((cv_sc)((s0) << 3 | (s1)))
+#define CV_SC_S0(c) ((c) >> 3 & 7)
+#define CV_SC_S1(c) ((c) & 7)
+#define CV_STRENGTH_PULL 5
+#define CV_STRENGTH_STRONG 6
+#define CV_DRIVE_STRONG CV_SC(CV_STRENGTH_STRONG, CV_STRENGTH_STRONG)
+
+#define X_CV_RESOLV_KINDS() \
+  XCVRK(TRI, "tri"), \
+  XCVRK(TRI0, "tri0"), \
+  XCVRK(TRI1, "tri1"), \
+  XCVRK(TRIAND, "triand"), \
+  XCVRK(TRIOR, "trior")
+
+#define XCVRK(k, s) CV_RESOLV_##k
+
+typedef enum {
+  X_CV_RESOLV_KINDS(),
+  CV_RESOLV_COUNT
+} cv_resolv_kind;
+
+#undef XCVRK
+
+cv_resolv_kind cv_resolv_kind_from_name(char const* name, size_t len);
+// Builds the tables once, before any resolution runs
+void cv_sc_init_tables(void);
+// codes[i] for bit i of v, driven with drive's 0 and 1 strengths
+void cv_sc_encode(cv_sc* codes, cv_vec4* v, cv_sc drive);
+// acc[i] = resolve(acc[i], codes[i]). acc starts out all z (0).
+void cv_sc_resolve(cv_resolv_kind kind, cv_sc* acc, cv_sc const* codes, size_t n);
+// Normalizes a finished fold in place, pulls z for tri0/tri1 and writes
+// the bits into v
+void cv_sc_decode(cv_vec4* v, cv_sc* codes, cv_resolv_kind kind);
+
+#ifdef CVSTRENGTH_IMPLEMENTATION
+
+#define XCVRK(k, s) s
+
+static char const* CV_RESOLV_NAMES[] = {
+  X_CV_RESOLV_KINDS()
+};
+
+#undef XCVRK
+
+cv_resolv_kind cv_resolv_kind_from_name(char const* name, size_t len) {
+  for (size_t i = 0; i < CV_RESOLV_COUNT; i ++) {
+    if (strlen(CV_RESOLV_NAMES[i]) == len && memcmp(CV_RESOLV_NAMES[i], name, len) == 0) return (cv_resolv_kind)i;
+  }
+  return CV_RESOLV_COUNT;
+}
+
+static bool _cv_sc_ready;
+static cv_sc _cv_sc_norm[64];
+static cv_sc _cv_sc_wired[2][64][64];
+
+static cv_sc _cv_sc_normalize(cv_sc c) {
+  uint8_t s0 = CV_SC_S0(c), s1 = CV_SC_S1(c);
+  return s0 > s1 ? CV_SC(s0, 0) : s1 > s0 ? CV_SC(0, s1) : c;
+}
+
+// The stronger one wins, a tie is and (wand) or or (wor) of the values
+static cv_sc _cv_sc_wire(cv_sc a, cv_sc b, bool is_or) {
+  a = _cv_sc_normalize(a);
+  b = _cv_sc_normalize(b);
+  uint8_t sa = CV_SC_S0(a) | CV_SC_S1(a), sb = CV_SC_S0(b) | CV_SC_S1(b);
+  if (sa != sb) return sa > sb ? a : b;
+  bool a0 = CV_SC_S1(a) == 0, b0 = CV_SC_S1(b) == 0;
+  bool a1 = CV_SC_S0(a) == 0, b1 = CV_SC_S0(b) == 0;
+  if (is_or) return (a1 || b1) ? CV_SC(0, sa) : (a0 && b0) ? CV_SC(sa, 0) : CV_SC(sa, sa);
+  return (a0 || b0) ? CV_SC(sa, 0) : (a1 && b1) ? CV_SC(0, sa) : CV_SC(sa, sa);
+}
+
+void cv_sc_init_tables(void) {
+  if (_cv_sc_ready) return;
+  for (size_t a = 0; a < 64; a ++) {
+    _cv_sc_norm[a] = _cv_sc_normalize((cv_sc)a);
+    for (size_t b = 0; b < 64; b ++) {
+      _cv_sc_wired[0][a][b] = _cv_sc_wire((cv_sc)a, (cv_sc)b, false);
+      _cv_sc_wired[1][a][b] = _cv_sc_wire((cv_sc)a, (cv_sc)b, true);
+    }
+  }
+  _cv_sc_ready = true;
+}
+
+void cv_sc_encode(cv_sc* codes, cv_vec4* v, cv_sc drive) {
+  uint8_t d0 = CV_SC_S0(drive), d1 = CV_SC_S1(drive);
+  uint8_t dx = d0 > d1 ? d0 : d1;
+  // Indexed by the four state encoding: 0, 1, z, x
+  cv_sc lut[4] = { CV_SC(d0, 0), CV_SC(0, d1), 0, CV_SC(dx, dx) };
+  uint64_t* a = cv_vec4_aval(v);
+  uint64_t* b = cv_vec4_bval(v);
+  for (uint32_t i = 0; i < v->width; i ++) {
+    codes[i] = lut[(a[i / 64] >> (i % 64) & 1) | (b[i / 64] >> (i % 64) & 1) << 1];
+  }
+}
+
+static void _cv_sc_max(cv_sc* acc, cv_sc const* codes, size_t i, size_t n) {
+  for (; i < n; i ++) {
+    uint8_t s0 = CV_SC_S0(acc[i]) > CV_SC_S0(codes[i]) ? CV_SC_S0(acc[i]) : CV_SC_S0(codes[i]);
+    uint8_t s1 = CV_SC_S1(acc[i]) > CV_SC_S1(codes[i]) ? CV_SC_S1(acc[i]) : CV_SC_S1(codes[i]);
+    acc[i] = CV_SC(s0, s1);
+  }
+}
+
+#ifdef CV_HAVE_AVX2_KERNELS
+__attribute__((target("avx2")))
+static void _cv_sc_max_avx2(cv_sc* acc, cv_sc const* codes, size_t n) {
+  __m256i m0 = _mm256_set1_epi8(0x38), m1 = _mm256_set1_epi8(0x07);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i a = _mm256_loadu_si256((__m256i const*)(acc + i));
+    __m256i c = _mm256_loadu_si256((__m256i const*)(codes + i));
+    __m256i s0 = _mm256_max_epu8(_mm256_and_si256(a, m0), _mm256_and_si256(c, m0));
+    __m256i s1 = _mm256_max_epu8(_mm256_and_si256(a, m1), _mm256_and_si256(c, m1));
+    _mm256_storeu_si256((__m256i*)(acc + i), _mm256_or_si256(s0, s1));
+  }
+  _cv_sc_max(acc, codes, i, n);
+}
+#endif
+
+void cv_sc_resolve(cv_resolv_kind kind, cv_sc* acc, cv_sc const* codes, size_t n) {
+  if (kind == CV_RESOLV_TRIAND || kind == CV_RESOLV_TRIOR) {
+    cv_sc (*table)[64] = _cv_sc_wired[kind == CV_RESOLV_TRIOR];
+    for (size_t i = 0; i < n; i ++) acc[i] = table[acc[i]][codes[i]];
+    return;
+  }
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (n >= 32 && _cv_use_avx2(4)) {
+    _cv_sc_max_avx2(acc, codes, n);
+    return;
+  }
+#endif
+  _cv_sc_max(acc, codes, 0, n);
+}
+
+void cv_sc_decode(cv_vec4* v, cv_sc* codes, cv_resolv_kind kind) {
+  cv_sc pull = kind == CV_RESOLV_TRI0 ? CV_SC(CV_STRENGTH_PULL, 0) :
+               kind == CV_RESOLV_TRI1 ? CV_SC(0, CV_STRENGTH_PULL) : 0;
+  uint64_t* a = cv_vec4_aval(v);
+  uint64_t* b = cv_vec4_bval(v);
+  for (size_t w = 0; w < CV_WORDS(v->width); w ++) {
+    uint64_t aw = 0, bw = 0;
+    for (uint32_t j = 0; j < 64 && w * 64 + j < v->width; j ++) {
+      cv_sc c = _cv_sc_norm[codes[w * 64 + j]];
+      if (!c) c = pull;
+      codes[w * 64 + j] = c;
+      // z has no strength either way (a 0, b 1), x both (a 1, b 1), and
+      // otherwise one side
+      bool has0 = CV_SC_S0(c) != 0, has1 = CV_SC_S1(c) != 0;
+      aw |= (uint64_t)has1 << j;
+      bw |= (uint64_t)(has0 == has1) << j;
+    }
+    a[w] = aw;
+    b[w] = bw;
+  }
+  cv_vec4_refresh_2state(v);
+}
+
+#endif
+
+#ifdef CVSTRENGTH_UT
+
+void cvstrength_unit_test() {
+  crena_arena arena = crena_init_growing();
+  cv_sc_init_tables();
+
+  // strong 0 against weak 1 and pull 1, a tie, and a supply 1
+  cv_vec4 d0, d1, r;
+  cv_vec4_init(&d0, 4, &arena);
+  cv_vec4_init(&d1, 4, &arena);
+  cv_vec4_init(&r, 4, &arena);
+  cv_vec4_set_str(&d0, "z000", 4);
+  cv_vec4_set_str(&d1, "z111", 4);
+  cv_sc acc[4] = {0}, c[4];
+  cv_sc_encode(c, &d0, CV_SC(6, 6));
+  cv_sc_resolve(CV_RESOLV_TRI, acc, c, 4);
+  cv_sc_encode(c, &d1, CV_SC(3, 3));
+  cv_sc_resolve(CV_RESOLV_TRI, acc, c, 4);
+  acc[1] = CV_SC(6, 6);
+  acc[2] = CV_SC(6, 7);
+  cv_sc_decode(&r, acc, CV_RESOLV_TRI1);
+  char s[8];
+  cv_vec4_to_str(&r, s);
+  printf("Strong 0 beats weak 1, ties are x, supply wins, tri1 pulls z: %s? %s\n", s,
+         strcmp(s, "11x0") == 0 && acc[3] == CV_SC(0, CV_STRENGTH_PULL) ? "yes" : "no");
+
+  // A plain tri net leaves its undriven bits z, and all of them when
+  // nothing drives it
+  cv_sc tacc[4] = {0};
+  cv_vec4_set_str(&d0, "zz10", 4);
+  cv_sc_encode(c, &d0, CV_DRIVE_STRONG);
+  cv_sc_resolve(CV_RESOLV_TRI, tacc, c, 4);
+  cv_sc_decode(&r, tacc, CV_RESOLV_TRI);
+  char t[8];
+  cv_vec4_to_str(&r, t);
+  memset(tacc, 0, sizeof(tacc));
+  cv_sc_decode(&r, tacc, CV_RESOLV_TRI);
+  cv_vec4_to_str(&r, s);
+  printf("tri floats: zz10 reads %s, undriven %s? %s\n", t, s,
+         strcmp(t, "zz10") == 0 && strcmp(s, "zzzz") == 0 ? "yes" : "no");
+
+  // wand/wor break ties with the value, the table and the max fold agree on tri
+  bool wired = _cv_sc_wired[0][CV_SC(6, 0)][CV_SC(0, 6)] == CV_SC(6, 0) &&
+               _cv_sc_wired[1][CV_SC(6, 0)][CV_SC(0, 6)] == CV_SC(0, 6) &&
+               _cv_sc_wired[0][CV_SC(6, 6)][CV_SC(0, 6)] == CV_SC(6, 6) &&
+               _cv_sc_wired[1][CV_SC(5, 0)][CV_SC(0, 6)] == CV_SC(0, 6);
+  printf("wand and wor break strength ties by value? %s\n", wired ? "yes" : "no");
+
+  // The AVX2 fold against the scalar one over random drivers
+  enum { N = 300, DRIVERS = 6 };
+  cv_sc wide[N], ref[N], codes[N];
+  memset(wide, 0, sizeof(wide));
+  memset(ref, 0, sizeof(ref));
+  uint64_t x = 88172645463325252ULL;
+  for (size_t d = 0; d < DRIVERS; d ++) {
+    for (size_t i = 0; i < N; i ++) {
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      codes[i] = _cv_sc_norm[x & 63];
+    }
+    cv_sc_resolve(CV_RESOLV_TRI, wide, codes, N);
+    _cv_sc_max(ref, codes, 0, N);
+  }
+  printf("Vector fold matches scalar? %s\n", memcmp(wide, ref, N) == 0 ? "yes" : "no");
+
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
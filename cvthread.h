@@ -0,0 +1,613 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "crena.h"
+#include "cvsched.h"
+#include "cvvec.h"
+#include "cvnet.h"
+#include "cvmem.h"
+
+// Behavioral threads (vvp's vthreads) as stackless coroutines.
+// The code of every initial/always block is assembled into one shared
+// instruction array. A running vthread is only a frame: its program
+// counter and a small stack of vec4 values, allocated from a pool.
+// Resuming one is an ordinary scheduler event whose ctx is the frame; the
+// thread runs instructions until one suspends it:
+//  - %delay schedules the frame to resume that many ticks later (#0 goes
+//    to the inactive region),
+//  - %wait links the frame into the event's wait list, %event resumes
+//    everything waiting on it in the active region. Edge events are
+//    triggered by the netlist through cv_net_watch, and an event can
+//    pass its triggers on to others like vvp's .event/or,
+//  - %end gives the frame back to the pool.
+// Nothing runs on an OS thread or a separate C stack, so a suspended
+// vthread costs sizeof(cv_vthread) bytes and a switch is one event.
+// Stores to vars go through cv_net_set; one settle of the netlist is
+// queued in the active region after the first store of a delta.
+// Like vvp, a frame has KNOB_VTHREAD_WORDS index registers and a set of
+// flags. %ix/load sets a register, %ix/vec4 pops one and sets flag 4 when
+// it had x/z, which makes %load/vec4a read x and %store/vec4a drop its
+// value; arrays themselves live in cvmem.h. Register 0 addresses word 0.
+// The offset registers of %store/vec4 and %store/vec4a place the value at
+// that bit of the var or word, with register 0 meaning bit 0.
+// Flags hold 0, 1 or neither (x); %flag_set/imm sets one and %jmp/0,
+// %jmp/1 branch on it.
+// Stack values up to 64 bits sit inline in the frame, wider ones take a
+// pool block of their own, which caps them at KNOB_VTHREAD_MAX_WIDTH.
+
+#ifndef KNOB_VTHREAD_STACK
+#define KNOB_VTHREAD_STACK 4
+#endif
+
+#ifndef KNOB_VTHREAD_WORDS
+#define KNOB_VTHREAD_WORDS 16
+#endif
+
+#ifndef KNOB_VTHREAD_MAX_WIDTH
+#define KNOB_VTHREAD_MAX_WIDTH 1024
+#endif
+
+#define X_CV_VTHREAD_OPS() \
+  XCVI(NOOP, ""),\
+  XCVI(PUSHI, "%pushi/vec4"),\
+  XCVI(LOAD, "%load/vec4"),\
+  XCVI(STORE, "%store/vec4"),\
+  XCVI(IXLOAD, "%ix/load"),\
+  XCVI(IXVEC4, "%ix/vec4"),\
+  XCVI(IXVEC4S, "%ix/vec4/s"),\
+  XCVI(FLAGSET, "%flag_set/imm"),\
+  XCVI(LOADA, "%load/vec4a"),\
+  XCVI(STOREA, "%store/vec4a"),\
+  XCVI(INV, "%inv"),\
+  XCVI(DELAY, "%delay"),\
+  XCVI(WAIT, "%wait"),\
+  XCVI(EVENT, "%event"),\
+  XCVI(JMP, "%jmp"),\
+  XCVI(JMP0, "%jmp/0"),\
+  XCVI(JMP1, "%jmp/1"),\
+  XCVI(FINISH, "$finish"),\
+  XCVI(END, "%end"),\
+
+#define XCVI(o, n) CV_VTI_##o
+
+typedef enum {
+  X_CV_VTHREAD_OPS()
+  CV_VTI_COUNT
+} cv_vti_op;
+
+#undef XCVI
+
+// target is the node of LOAD/STORE, the array of LOADA/STOREA, the pc of
+// the jumps, the event of WAIT/EVENT and the flag of FLAGSET. a and b are
+// the immediate planes of PUSHI, a the value of IXLOAD and FLAGSET, the
+// flag JMP0/JMP1 test and the ticks of DELAY. b is the index register of
+// IXLOAD, IXVEC4(S), LOADA and STOREA, and the bit offset register of
+// STORE; a is the part offset register of STOREA.
+typedef struct {
+  cv_vti_op op;
+  uint32_t width;
+  uint32_t target;
+  uint64_t a;
+  uint64_t b;
+} cv_vti;
+
+struct _cv_vthreads;
+
+typedef struct _cv_vthread {
+  struct _cv_vthread* next;
+  struct _cv_vthreads* rt;
+  uint32_t pc;
+  uint32_t sp;
+  cv_vec4 stack[KNOB_VTHREAD_STACK];
+  int64_t words[KNOB_VTHREAD_WORDS];
+  // Flags that are 0 and that are 1, the rest x
+  uint32_t flags0;
+  uint32_t flags1;
+} cv_vthread;
+
+typedef struct {
+  cv_vthread* head;
+  cv_vthread* tail;
+  // Events triggered along with this one
+  uint32_t* ors;
+} cv_vthread_event;
+
+typedef struct _cv_vthreads {
+  crena_arena* arena;
+  cv_vti* code;
+  cv_vthread_event* events;
+  cv_mem* mems;
+  cv_sched* sched;
+  cv_net* net;
+  crena_pool pool;
+  uint64_t* store_words;
+  bool settle_pending;
+  size_t n_live;
+  size_t max_live;
+  size_t n_spawned;
+  size_t n_resumes;
+  size_t n_errors;
+} cv_vthreads;
+
+extern char const* CV_VTI_NAMES[];
+
+// CV_VTI_COUNT when the mnemonic has no instruction
+cv_vti_op cv_vti_from_name(char const* name, size_t len);
+void cv_vthreads_init(cv_vthreads* rt, crena_arena* arena);
+uint32_t cv_vthreads_emit(cv_vthreads* rt, cv_vti insn);
+uint32_t cv_vthreads_event(cv_vthreads* rt);
+// Triggering sub triggers event as well
+void cv_vthreads_event_or(cv_vthreads* rt, uint32_t event, uint32_t sub);
+// Takes over an initialised array, returning its target index
+uint32_t cv_vthreads_mem(cv_vthreads* rt, cv_mem* mem);
+// Binds the code to a scheduler and netlist before threads are spawned,
+// taking over the net's on_event hook for watched edges
+void cv_vthreads_attach(cv_vthreads* rt, cv_sched* sched, cv_net* net);
+// Starts a thread at pc in the active region of the current time
+cv_vthread* cv_vthreads_spawn(cv_vthreads* rt, uint32_t pc);
+void cv_vthreads_trigger(cv_vthreads* rt, uint32_t event);
+void cv_vthreads_report(cv_vthreads* rt, FILE* out);
+
+#ifdef CVTHREAD_IMPLEMENTATION
+
+#define XCVI(o, n) n
+
+char const* CV_VTI_NAMES[] = {
+  X_CV_VTHREAD_OPS()
+};
+
+#undef XCVI
+
+cv_vti_op cv_vti_from_name(char const* name, size_t len) {
+  for (size_t i = 1; i < CV_VTI_COUNT; i ++) {
+    if (strlen(CV_VTI_NAMES[i]) == len && memcmp(CV_VTI_NAMES[i], name, len) == 0) return (cv_vti_op)i;
+  }
+  return CV_VTI_COUNT;
+}
+
+void cv_vthreads_init(cv_vthreads* rt, crena_arena* arena) {
+  *rt = (cv_vthreads){0};
+  rt->arena = arena;
+  rt->pool = crena_pool_init(arena);
+  crena_da_init(rt->code, arena);
+  crena_da_init(rt->events, arena);
+  crena_da_init(rt->mems, arena);
+}
+
+uint32_t cv_vthreads_emit(cv_vthreads* rt, cv_vti insn) {
+  crena_da_push(rt->code, insn);
+  return (uint32_t)(crena_da_len(rt->code) - 1);
+}
+
+uint32_t cv_vthreads_event(cv_vthreads* rt) {
+  cv_vthread_event e = {0};
+  crena_da_init(e.ors, rt->arena);
+  crena_da_push(rt->events, e);
+  return (uint32_t)(crena_da_len(rt->events) - 1);
+}
+
+void cv_vthreads_event_or(cv_vthreads* rt, uint32_t event, uint32_t sub) {
+  crena_da_push(rt->events[sub].ors, event);
+}
+
+static void _cv_vthreads_on_event(void* ctx, uint32_t event) {
+  cv_vthreads_trigger(ctx, event);
+}
+
+uint32_t cv_vthreads_mem(cv_vthreads* rt, cv_mem* mem) {
+  crena_da_push(rt->mems, *mem);
+  return (uint32_t)(crena_da_len(rt->mems) - 1);
+}
+
+static size_t _cv_vthread_words_size(uint32_t width) {
+  return 2 * CV_WORDS(width) * sizeof(uint64_t);
+}
+
+void cv_vthreads_attach(cv_vthreads* rt, cv_sched* sched, cv_net* net) {
+  rt->sched = sched;
+  rt->net = net;
+  net->on_event = _cv_vthreads_on_event;
+  net->event_ctx = rt;
+  rt->store_words = crena_alloc(rt->arena, _cv_vthread_words_size(net->max_width));
+}
+
+// New top of stack with room for width bits, NULL on overflow
+static cv_vec4* _cv_vthread_push(cv_vthread* th, uint32_t width) {
+  if (th->sp == KNOB_VTHREAD_STACK || width == 0 || width > KNOB_VTHREAD_MAX_WIDTH) return NULL;
+  cv_vec4* v = &th->stack[th->sp++];
+  v->width = width;
+  v->flags = 0;
+  if (!cv_vec4_is_small(v)) v->words = crena_pool_alloc(&th->rt->pool, _cv_vthread_words_size(width));
+  return v;
+}
+
+static void _cv_vthread_drop(cv_vthread* th) {
+  cv_vec4* v = &th->stack[--th->sp];
+  if (!cv_vec4_is_small(v)) crena_pool_free(&th->rt->pool, v->words, _cv_vthread_words_size(v->width));
+}
+
+static void _cv_vthread_free(cv_vthread* th) {
+  cv_vthreads* rt = th->rt;
+  while (th->sp) _cv_vthread_drop(th);
+  rt->n_live --;
+  CRPf(&rt->pool, th);
+}
+
+static void _cv_vthreads_settle(cv_sched* sched, cv_event* ev) {
+  (void)sched;
+  cv_vthreads* rt = ev->ctx;
+  rt->settle_pending = false;
+  cv_net_settle(rt->net);
+}
+
+// Bits of v that land inside dst when placed at bit off
+static void _cv_vthread_place(cv_vec4* dst, cv_vec4* v, int64_t off) {
+  int64_t soff = off < 0 ? -off : 0;
+  int64_t doff = off < 0 ? 0 : off;
+  int64_t w = (int64_t)v->width - soff;
+  if (w > (int64_t)dst->width - doff) w = (int64_t)dst->width - doff;
+  if (w <= 0) return;
+  cv_vec4_copy_bits(dst, (uint32_t)doff, v, (uint32_t)soff, (uint32_t)w);
+  cv_vec4_refresh_2state(dst);
+}
+
+// The popped value goes to the var at bit off
+static void _cv_vthread_store(cv_vthreads* rt, cv_vti* in, cv_vec4* v, int64_t off) {
+  cv_node* node = cv_net_node(rt->net, in->target);
+  if (v->width == node->value.width && off == 0) {
+    cv_net_set(rt->net, in->target, v);
+  } else {
+    cv_vec4 r = { .width = node->value.width };
+    if (!cv_vec4_is_small(&r)) r.words = rt->store_words;
+    cv_vec4_copy(&r, &node->value);
+    _cv_vthread_place(&r, v, off);
+    cv_net_set(rt->net, in->target, &r);
+  }
+  if (!rt->settle_pending) {
+    rt->settle_pending = true;
+    cv_sched_schedule(rt->sched, 0, CV_REGION_ACTIVE, _cv_vthreads_settle, rt, 0);
+  }
+}
+
+static void _cv_vthread_wake(cv_sched* sched, cv_event* ev);
+
+static void _cv_vthread_flag(cv_vthread* th, uint32_t flag, bool value) {
+  th->flags0 = (th->flags0 & ~(1u << flag)) | (uint32_t)!value << flag;
+  th->flags1 = (th->flags1 & ~(1u << flag)) | (uint32_t)value << flag;
+}
+
+// Value of index register reg (0 for register 0), false when flag 4 says
+// the index had x/z
+static bool _cv_vthread_addr(cv_vthread* th, uint64_t reg, int64_t* addr) {
+  *addr = reg ? th->words[reg] : 0;
+  return !reg || !(th->flags1 & 1u << 4);
+}
+
+// Runs until the thread suspends or ends
+static void _cv_vthread_run(cv_vthread* th) {
+  cv_vthreads* rt = th->rt;
+  rt->n_resumes ++;
+  for (;;) {
+    cv_vti* in = &rt->code[th->pc++];
+    cv_vec4* v;
+    switch (in->op) {
+    case CV_VTI_NOOP:
+      break;
+    case CV_VTI_PUSHI:
+      if (!(v = _cv_vthread_push(th, in->width))) goto fail;
+      cv_vec4_fill(v, CV_BIT_0);
+      cv_vec4_aval(v)[0] = in->a & (in->width < 64 ? cv_vec4_top_mask(in->width) : ~0ULL);
+      cv_vec4_bval(v)[0] = in->b & (in->width < 64 ? cv_vec4_top_mask(in->width) : ~0ULL);
+      cv_vec4_refresh_2state(v);
+      break;
+    case CV_VTI_LOAD: {
+      cv_vec4* src = &cv_net_node(rt->net, in->target)->value;
+      if (!(v = _cv_vthread_push(th, src->width))) goto fail;
+      cv_vec4_copy(v, src);
+      break;
+    }
+    case CV_VTI_STORE: {
+      if (!th->sp || in->b >= KNOB_VTHREAD_WORDS) goto fail;
+      int64_t off;
+      if (_cv_vthread_addr(th, in->b, &off)) _cv_vthread_store(rt, in, &th->stack[th->sp - 1], off);
+      _cv_vthread_drop(th);
+      break;
+    }
+    case CV_VTI_IXLOAD:
+      if (in->b >= KNOB_VTHREAD_WORDS) goto fail;
+      th->words[in->b] = (int64_t)in->a;
+      break;
+    case CV_VTI_IXVEC4:
+    case CV_VTI_IXVEC4S: {
+      if (!th->sp || in->b >= KNOB_VTHREAD_WORDS) goto fail;
+      v = &th->stack[th->sp - 1];
+      uint64_t w = cv_vec4_aval(v)[0];
+      if (in->op == CV_VTI_IXVEC4S && v->width < 64 && w >> (v->width - 1) & 1) w |= ~0ULL << v->width;
+      bool unknown = cv_vec4_has_xz(v);
+      th->words[in->b] = unknown ? 0 : (int64_t)w;
+      _cv_vthread_flag(th, 4, unknown);
+      _cv_vthread_drop(th);
+      break;
+    }
+    case CV_VTI_FLAGSET:
+      if (in->target >= 32) goto fail;
+      _cv_vthread_flag(th, in->target, in->a & 1);
+      break;
+    case CV_VTI_LOADA: {
+      if (in->b >= KNOB_VTHREAD_WORDS) goto fail;
+      cv_mem* m = &rt->mems[in->target];
+      int64_t addr;
+      bool known = _cv_vthread_addr(th, in->b, &addr);
+      if (!(v = _cv_vthread_push(th, m->width))) goto fail;
+      if (known) cv_mem_read(m, addr, v);
+      else cv_vec4_fill(v, CV_BIT_X);
+      break;
+    }
+    case CV_VTI_STOREA: {
+      if (!th->sp || in->b >= KNOB_VTHREAD_WORDS || in->a >= KNOB_VTHREAD_WORDS) goto fail;
+      cv_mem* m = &rt->mems[in->target];
+      int64_t addr, off;
+      bool known = _cv_vthread_addr(th, in->b, &addr);
+      known = _cv_vthread_addr(th, in->a, &off) && known;
+      if (known && off == 0) {
+        cv_mem_write(m, addr, &th->stack[th->sp - 1]);
+      } else if (known) {
+        // Part of the word: read it into a scratch slot on the stack
+        if (!(v = _cv_vthread_push(th, m->width))) goto fail;
+        cv_mem_read(m, addr, v);
+        _cv_vthread_place(v, &th->stack[th->sp - 2], off);
+        cv_mem_write(m, addr, v);
+        _cv_vthread_drop(th);
+      }
+      _cv_vthread_drop(th);
+      break;
+    }
+    case CV_VTI_INV:
+      if (!th->sp) goto fail;
+      v = &th->stack[th->sp - 1];
+      cv_vec4_not(v, v);
+      break;
+    case CV_VTI_DELAY:
+      cv_sched_schedule(rt->sched, in->a, in->a ? CV_REGION_ACTIVE : CV_REGION_INACTIVE, _cv_vthread_wake, th, 0);
+      return;
+    case CV_VTI_WAIT: {
+      cv_vthread_event* e = &rt->events[in->target];
+      th->next = NULL;
+      if (e->tail) e->tail->next = th;
+      else e->head = th;
+      e->tail = th;
+      return;
+    }
+    case CV_VTI_EVENT:
+      cv_vthreads_trigger(rt, in->target);
+      break;
+    case CV_VTI_JMP:
+      th->pc = in->target;
+      break;
+    case CV_VTI_JMP0:
+      if (in->a >= 32) goto fail;
+      if (th->flags0 & 1u << in->a) th->pc = in->target;
+      break;
+    case CV_VTI_JMP1:
+      if (in->a >= 32) goto fail;
+      if (th->flags1 & 1u << in->a) th->pc = in->target;
+      break;
+    case CV_VTI_FINISH:
+      cv_sched_finish(rt->sched);
+      break;
+    case CV_VTI_END:
+      _cv_vthread_free(th);
+      return;
+    default:
+      goto fail;
+    }
+  }
+
+fail:
+  rt->n_errors ++;
+  _cv_vthread_free(th);
+}
+
+static void _cv_vthread_wake(cv_sched* sched, cv_event* ev) {
+  (void)sched;
+  _cv_vthread_run(ev->ctx);
+}
+
+cv_vthread* cv_vthreads_spawn(cv_vthreads* rt, uint32_t pc) {
+  cv_vthread* th = CRPa(&rt->pool, cv_vthread);
+  th->next = NULL;
+  th->rt = rt;
+  th->pc = pc;
+  th->sp = 0;
+  // vvp starts threads with flag 0 at 0, flag 1 at 1 and the rest x
+  th->flags0 = 1u << 0;
+  th->flags1 = 1u << 1;
+  rt->n_spawned ++;
+  if (++rt->n_live > rt->max_live) rt->max_live = rt->n_live;
+  cv_sched_schedule(rt->sched, 0, CV_REGION_ACTIVE, _cv_vthread_wake, th, 0);
+  return th;
+}
+
+void cv_vthreads_trigger(cv_vthreads* rt, uint32_t event) {
+  cv_vthread_event* e = &rt->events[event];
+  cv_vthread* th = e->head;
+  e->head = e->tail = NULL;
+  while (th) {
+    cv_vthread* next = th->next;
+    cv_sched_schedule(rt->sched, 0, CV_REGION_ACTIVE, _cv_vthread_wake, th, 0);
+    th = next;
+  }
+  for (size_t i = 0; i < crena_da_len(e->ors); i ++) cv_vthreads_trigger(rt, e->ors[i]);
+}
+
+void cv_vthreads_report(cv_vthreads* rt, FILE* out) {
+  fprintf(out, "vthreads: %zu instructions, %zu spawned, %zu live (%zu at most, %zu bytes each), %zu resumes, %zu errors\n",
+          crena_da_len(rt->code), rt->n_spawned, rt->n_live, rt->max_live, sizeof(cv_vthread), rt->n_resumes, rt->n_errors);
+}
+
+#endif
+
+#ifdef CVTHREAD_UT
+
+void cvthread_unit_test() {
+  crena_arena arena = crena_init_growing();
+  cv_net net;
+  cv_net_init(&net, &arena);
+  cv_node_id v = cv_net_add(&net, CV_OP_VAR, 8);
+  cv_node_id n = cv_net_add(&net, CV_OP_NOT, 8);
+  cv_net_connect(&net, n, 0, v);
+  cv_node_id w = cv_net_add(&net, CV_OP_VAR, 8);
+  cv_node_id u = cv_net_add(&net, CV_OP_VAR, 8);
+  cv_node_id idx = cv_net_add(&net, CV_OP_VAR, 4);
+  cv_node_id clk = cv_net_add(&net, CV_OP_VAR, 1);
+  cv_node_id hits = cv_net_add(&net, CV_OP_VAR, 8);
+  cv_node_id part = cv_net_add(&net, CV_OP_VAR, 8);
+  cv_node_id pw = cv_net_add(&net, CV_OP_VAR, 8);
+
+  cv_sched sched;
+  cv_sched_init(&sched, &arena, -12);
+  cv_vthreads rt;
+  cv_vthreads_init(&rt, &arena);
+  uint32_t ev = cv_vthreads_event(&rt);
+  // .event posedge, clk;  .event negedge, clk;  .event/or of the negedge
+  uint32_t pos = cv_vthreads_event(&rt);
+  uint32_t neg = cv_vthreads_event(&rt);
+  uint32_t any = cv_vthreads_event(&rt);
+  cv_net_watch(&net, clk, CV_EDGE_POS, pos);
+  cv_net_watch(&net, clk, CV_EDGE_NEG, neg);
+  cv_vthreads_event_or(&rt, any, neg);
+  cv_net_elaborate(&net);
+  cv_mem mem;
+  cv_mem_init(&mem, 8, 0, 15, CV_BIT_X, CV_MEM_AUTO, &arena);
+  uint32_t m = cv_vthreads_mem(&rt, &mem);
+  cv_mem pmem;
+  cv_mem_init(&pmem, 8, 0, 15, CV_BIT_X, CV_MEM_AUTO, &arena);
+  uint32_t pm = cv_vthreads_mem(&rt, &pmem);
+
+  // v = 5; #10 v = 8'h0a; @ev v = ~v;
+  uint32_t t0 = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8, .a = 5 });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = v });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_DELAY, .a = 10 });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8, .a = 0x0a });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = v });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_WAIT, .target = ev });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_LOAD, .target = v });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_INV });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = v });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_END });
+  // #15 -> ev; #5 $finish
+  uint32_t t1 = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_DELAY, .a = 15 });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_EVENT, .target = ev });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_DELAY, .a = 5 });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_FINISH });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_END });
+  // Many short lived threads: #k end
+  uint32_t t2 = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_DELAY, .a = 3 });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_END });
+
+  // The code iverilog emits for mem[3] = 8'ha5; mem[i] = 8'h11; u = mem[i];
+  // w = mem[3]; plus the %jmp/1 .., 4 guard it puts around stores through
+  // an index. i is still x, so flag 4 drops the store, the read gives x
+  // and the guarded store is skipped.
+  uint32_t t3 = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8, .a = 0xa5 }); // %pushi/vec4 165, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXLOAD, .b = 3, .a = 3 });                     // %ix/load 3, 3, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_FLAGSET, .target = 4, .a = 0 });               // %flag_set/imm 4, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STOREA, .target = m, .b = 3 });                // %store/vec4a mem, 3, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8, .a = 0x11 });               // %pushi/vec4 17, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_LOAD, .target = idx });                        // %load/vec4 i;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXVEC4, .b = 3 });                             // %ix/vec4 3;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STOREA, .target = m, .b = 3 });                // %store/vec4a mem, 3, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_LOAD, .target = idx });                        // %load/vec4 i;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXVEC4, .b = 4 });                             // %ix/vec4 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_LOADA, .target = m, .b = 4 });                 // %load/vec4a mem, 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = u });             // %store/vec4 u, 0, 8;
+  uint32_t skip = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_JMP1, .a = 4 });               // %jmp/1 T_0.1, 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8, .a = 0x22 });               // %pushi/vec4 34, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = w });             // %store/vec4 w, 0, 8;
+  rt.code[skip].target = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXLOAD, .b = 5, .a = 3 }); // T_0.1 ; %ix/load 5, 3, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_FLAGSET, .target = 4, .a = 0 });               // %flag_set/imm 4, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_LOADA, .target = m, .b = 5 });                 // %load/vec4a mem, 5;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = w });             // %store/vec4 w, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_END });                                        // %end;
+
+  // @(posedge clk) hits = 1; @(negedge clk or ...) hits = 2;  against
+  // #1 clk = 0; #1 clk = 1; #1 clk = 1; #1 clk = 0;
+  uint32_t t4 = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_WAIT, .target = pos });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8, .a = 1 });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = hits });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_WAIT, .target = any });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8, .a = 2 });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = hits });
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_END });
+  uint32_t t5 = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_NOOP });
+  for (uint64_t k = 0; k < 4; k ++) {
+    cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_DELAY, .a = 1 });
+    cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 1, .a = k == 1 || k == 2 });
+    cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 1, .target = clk });
+  }
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_END });
+
+  // part = 0; part[4 +: 4] = 4'hb; part[i +: 4] = 4'h0; pmem[2] = 0;
+  // pmem[2][2 +: 4] = 4'hf; pw = pmem[2];  The store through x i is dropped.
+  uint32_t t6 = cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8 });             // %pushi/vec4 0, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = part });          // %store/vec4 part, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 4, .a = 0xb });                // %pushi/vec4 11, 0, 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXLOAD, .b = 4, .a = 4 });                     // %ix/load 4, 4, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_FLAGSET, .target = 4, .a = 0 });               // %flag_set/imm 4, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 4, .target = part, .b = 4 });  // %store/vec4 part, 4, 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 4 });                          // %pushi/vec4 0, 0, 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_LOAD, .target = idx });                        // %load/vec4 i;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXVEC4, .b = 4 });                             // %ix/vec4 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 4, .target = part, .b = 4 });  // %store/vec4 part, 4, 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 8 });                          // %pushi/vec4 0, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXLOAD, .b = 3, .a = 2 });                     // %ix/load 3, 2, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_FLAGSET, .target = 4, .a = 0 });               // %flag_set/imm 4, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STOREA, .target = pm, .b = 3 });               // %store/vec4a pmem, 3, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_PUSHI, .width = 4, .a = 0xf });                // %pushi/vec4 15, 0, 4;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_IXLOAD, .b = 5, .a = 2 });                     // %ix/load 5, 2, 0;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STOREA, .target = pm, .b = 3, .a = 5 });       // %store/vec4a pmem, 3, 5;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_LOADA, .target = pm, .b = 3 });                // %load/vec4a pmem, 3;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_STORE, .width = 8, .target = pw });            // %store/vec4 pw, 0, 8;
+  cv_vthreads_emit(&rt, (cv_vti){ .op = CV_VTI_END });                                        // %end;
+
+  cv_vthreads_attach(&rt, &sched, &net);
+  cv_vthreads_spawn(&rt, t0);
+  cv_vthreads_spawn(&rt, t1);
+  for (size_t i = 0; i < 20000; i ++) cv_vthreads_spawn(&rt, t2);
+  cv_vthreads_spawn(&rt, t3);
+  cv_vthreads_spawn(&rt, t4);
+  cv_vthreads_spawn(&rt, t5);
+  cv_vthreads_spawn(&rt, t6);
+
+  cv_sched_run(&sched, 12);
+  bool step1 = cv_net_node(&net, n)->value.small.a == 0xf5 && rt.n_live == 2;
+  cv_sched_run(&sched, ~(cv_time)0);
+  printf("vthreads suspend and resume? %s, finished at %" PRIu64 " with v = %02llx, ~v = %02llx\n",
+         step1 && rt.n_live == 0 && !rt.n_errors ? "yes" : "no", sched.now,
+         (unsigned long long)cv_net_node(&net, v)->value.small.a,
+         (unsigned long long)cv_net_node(&net, n)->value.small.a);
+  printf("20000 concurrent vthreads at %zu bytes each? %s\n", sizeof(cv_vthread),
+         rt.max_live == 20006 && rt.n_spawned == 20006 ? "yes" : "no");
+  char us[16];
+  cv_vec4_to_str(&cv_net_node(&net, u)->value, us);
+  printf("vthreads run iverilog's array code, x indices read x and drop stores? %s\n",
+         cv_net_node(&net, w)->value.small.a == 0xa5 && !cv_vec4_has_xz(&cv_net_node(&net, w)->value) &&
+         strcmp(us, "xxxxxxxx") == 0 && rt.mems[m].n_writes == 1 && !rt.n_errors ? "yes" : "no");
+
+  printf("Offset stores land at the index register's bit, x offsets drop them? %s\n",
+         cv_net_node(&net, part)->value.small.a == 0xb0 && !cv_vec4_has_xz(&cv_net_node(&net, part)->value) &&
+         cv_net_node(&net, pw)->value.small.a == 0x3c && !cv_vec4_has_xz(&cv_net_node(&net, pw)->value) &&
+         !rt.n_errors ? "yes" : "no");
+
+  printf("Edge events wake vthreads, .event/or passes them on? %s\n",
+         cv_net_node(&net, hits)->value.small.a == 2 && !rt.n_errors ? "yes" : "no");
+
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
@@ -0,0 +1,941 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "crena.h"
+
+// Four-state vector values.
+// Bits are stored as two planes of 64-bit words, encoded like vvp does:
+//   aval bval
+//    0    0   -> 0
+//    1    0   -> 1
+//    0    1   -> z
+//    1    1   -> x
+// Vectors up to 64 bits keep both planes inline and every kernel has an
+// inline single word path for them. Wider vectors point at an arena block
+// holding all aval words followed by all bval words; their kernels run over
+// whole words, with AVX2 versions picked at runtime when the CPU has it.
+// Bits above width are kept zero in both planes.
+// CV_VEC_2STATE marks a value known to hold no x/z. Its bval plane is all
+// zero, and kernels whose operands are all marked only compute aval with
+// the two state word kernels. A four state result drops the mark, and
+// cv_vec4_refresh_2state puts it back once the x/z are gone.
+
+#define CV_WORDS(width) (((size_t)(width) + 63) / 64)
+
+typedef enum {
+  CV_BIT_0 = 0,
+  CV_BIT_1 = 1,
+  CV_BIT_Z = 2,
+  CV_BIT_X = 3,
+} cv_bit;
+
+enum {
+  CV_VEC_2STATE = 1 << 0,
+};
+
+typedef struct {
+  uint32_t width;
+  uint32_t flags;
+  union {
+    struct {
+      uint64_t a;
+      uint64_t b;
+    } small;
+    uint64_t* words;
+  };
+} cv_vec4;
+
+static inline bool cv_vec4_is_small(cv_vec4 const* v) {
+  return v->width <= 64;
+}
+
+static inline uint64_t* cv_vec4_aval(cv_vec4* v) {
+  return cv_vec4_is_small(v) ? &v->small.a : v->words;
+}
+
+static inline uint64_t* cv_vec4_bval(cv_vec4* v) {
+  return cv_vec4_is_small(v) ? &v->small.b : v->words + CV_WORDS(v->width);
+}
+
+static inline uint64_t cv_vec4_top_mask(uint32_t width) {
+  return (width % 64) ? (~0ULL >> (64 - width % 64)) : ~0ULL;
+}
+
+void cv_vec4_init(cv_vec4* v, uint32_t width, crena_arena* arena);
+void cv_vec4_fill(cv_vec4* v, cv_bit bit);
+void cv_vec4_set_u64(cv_vec4* v, uint64_t value);
+bool cv_vec4_set_str(cv_vec4* v, char const* bits, size_t len);
+void cv_vec4_copy(cv_vec4* dst, cv_vec4* src);
+// Copy between widths, truncating or zero extending
+void cv_vec4_assign(cv_vec4* dst, cv_vec4* src);
+// Bits [soff, soff + width) of src to [doff, doff + width) of dst, in
+// whole words when both offsets are word aligned and by shift and mask
+// otherwise. Leaves dst's two state mark alone.
+void cv_vec4_copy_bits(cv_vec4* dst, uint32_t doff, cv_vec4* src, uint32_t soff, uint32_t width);
+void cv_vec4_fill_bits(cv_vec4* dst, uint32_t doff, uint32_t width, cv_bit bit);
+cv_bit cv_vec4_get_bit(cv_vec4* v, uint32_t i);
+void cv_vec4_set_bit(cv_vec4* v, uint32_t i, cv_bit bit);
+bool cv_vec4_has_xz(cv_vec4* v);
+bool cv_vec4_refresh_2state(cv_vec4* v);
+bool cv_vec4_identical(cv_vec4* a, cv_vec4* b);
+void cv_vec4_to_str(cv_vec4* v, char* out);
+
+// r may alias any operand. Operands have r's width.
+void cv_vec4_and(cv_vec4* r, cv_vec4* x, cv_vec4* y);
+void cv_vec4_or(cv_vec4* r, cv_vec4* x, cv_vec4* y);
+void cv_vec4_xor(cv_vec4* r, cv_vec4* x, cv_vec4* y);
+void cv_vec4_not(cv_vec4* r, cv_vec4* x);
+void cv_vec4_buf(cv_vec4* r, cv_vec4* x);
+// Per bit: sel 0 picks x, 1 picks y, x/z merges them
+void cv_vec4_mux(cv_vec4* r, cv_vec4* sel, cv_vec4* x, cv_vec4* y);
+void cv_vec4_mux1(cv_vec4* r, cv_bit sel, cv_vec4* x, cv_vec4* y);
+
+cv_bit cv_vec4_eq(cv_vec4* x, cv_vec4* y);
+cv_bit cv_vec4_lt(cv_vec4* x, cv_vec4* y);
+
+// Two-state word kernels over n words, a single plane with no x/z.
+// r may alias the operands. mux picks y where s is 1.
+void cv_w2_and(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n);
+void cv_w2_or(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n);
+void cv_w2_xor(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n);
+void cv_w2_not(uint64_t* r, uint64_t const* x, size_t n);
+void cv_w2_mux(uint64_t* r, uint64_t const* s, uint64_t const* x, uint64_t const* y, size_t n);
+
+#ifdef CVVEC_IMPLEMENTATION
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CV_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+void cv_vec4_init(cv_vec4* v, uint32_t width, crena_arena* arena) {
+  v->width = width;
+  v->flags = 0;
+  if (!cv_vec4_is_small(v)) {
+    v->words = crena_alloc_aligned(arena, 2 * CV_WORDS(width) * sizeof(uint64_t), 32);
+  }
+  // Verilog 4-state storage starts out x
+  cv_vec4_fill(v, CV_BIT_X);
+}
+
+void cv_vec4_fill(cv_vec4* v, cv_bit bit) {
+  size_t n = CV_WORDS(v->width);
+  uint64_t* a = cv_vec4_aval(v);
+  uint64_t* b = cv_vec4_bval(v);
+  uint64_t aw = (bit & 1) ? ~0ULL : 0;
+  uint64_t bw = (bit & 2) ? ~0ULL : 0;
+  for (size_t i = 0; i < n; i ++) {
+    a[i] = aw;
+    b[i] = bw;
+  }
+  a[n - 1] &= cv_vec4_top_mask(v->width);
+  b[n - 1] &= cv_vec4_top_mask(v->width);
+  v->flags = (bit & 2) ? (v->flags & ~CV_VEC_2STATE) : (v->flags | CV_VEC_2STATE);
+}
+
+void cv_vec4_set_u64(cv_vec4* v, uint64_t value) {
+  cv_vec4_fill(v, CV_BIT_0);
+  cv_vec4_aval(v)[0] = value & (v->width < 64 ? cv_vec4_top_mask(v->width) : ~0ULL);
+}
+
+// MSB first, as in C4<...> literals. Shorter strings are zero extended.
+bool cv_vec4_set_str(cv_vec4* v, char const* bits, size_t len) {
+  cv_vec4_fill(v, CV_BIT_0);
+  for (size_t i = 0; i < len && i < v->width; i ++) {
+    cv_bit bit;
+    switch (bits[len - 1 - i]) {
+    case '0': bit = CV_BIT_0; break;
+    case '1': bit = CV_BIT_1; break;
+    case 'z': case 'Z': bit = CV_BIT_Z; break;
+    case 'x': case 'X': bit = CV_BIT_X; break;
+    default: return false;
+    }
+    cv_vec4_set_bit(v, i, bit);
+  }
+  return true;
+}
+
+void cv_vec4_copy(cv_vec4* dst, cv_vec4* src) {
+  dst->flags = src->flags;
+  if (cv_vec4_is_small(dst)) {
+    dst->small = src->small;
+    return;
+  }
+  memcpy(dst->words, src->words, 2 * CV_WORDS(dst->width) * sizeof(uint64_t));
+}
+
+void cv_vec4_assign(cv_vec4* dst, cv_vec4* src) {
+  if (dst->width == src->width) {
+    cv_vec4_copy(dst, src);
+    return;
+  }
+  size_t dn = CV_WORDS(dst->width);
+  size_t sn = CV_WORDS(src->width);
+  uint64_t* da = cv_vec4_aval(dst);
+  uint64_t* db = cv_vec4_bval(dst);
+  uint64_t* sa = cv_vec4_aval(src);
+  uint64_t* sb = cv_vec4_bval(src);
+  for (size_t i = 0; i < dn; i ++) {
+    da[i] = i < sn ? sa[i] : 0;
+    db[i] = i < sn ? sb[i] : 0;
+  }
+  da[dn - 1] &= cv_vec4_top_mask(dst->width);
+  db[dn - 1] &= cv_vec4_top_mask(dst->width);
+  dst->flags = src->flags;
+}
+
+static inline uint64_t _cv_low_mask(uint32_t n) {
+  return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+// One plane. Each step fills the rest of one dst word from up to two src
+// words.
+static void _cv_bits_copy(uint64_t* d, size_t doff, uint64_t const* s, size_t soff, size_t n) {
+  if (doff % 64 == 0 && soff % 64 == 0) {
+    memcpy(d + doff / 64, s + soff / 64, n / 64 * sizeof(uint64_t));
+    doff += n / 64 * 64;
+    soff += n / 64 * 64;
+    n %= 64;
+  }
+  while (n) {
+    uint32_t db = doff % 64, sb = soff % 64;
+    uint32_t chunk = 64 - db < n ? 64 - db : (uint32_t)n;
+    uint64_t v = s[soff / 64] >> sb;
+    if (sb && sb + chunk > 64) v |= s[soff / 64 + 1] << (64 - sb);
+    uint64_t m = _cv_low_mask(chunk) << db;
+    d[doff / 64] = (d[doff / 64] & ~m) | ((v << db) & m);
+    doff += chunk;
+    soff += chunk;
+    n -= chunk;
+  }
+}
+
+static void _cv_bits_fill(uint64_t* d, size_t doff, size_t n, uint64_t w) {
+  while (n) {
+    uint32_t db = doff % 64;
+    uint32_t chunk = 64 - db < n ? 64 - db : (uint32_t)n;
+    uint64_t m = _cv_low_mask(chunk) << db;
+    d[doff / 64] = (d[doff / 64] & ~m) | (w & m);
+    doff += chunk;
+    n -= chunk;
+  }
+}
+
+void cv_vec4_copy_bits(cv_vec4* dst, uint32_t doff, cv_vec4* src, uint32_t soff, uint32_t width) {
+  _cv_bits_copy(cv_vec4_aval(dst), doff, cv_vec4_aval(src), soff, width);
+  _cv_bits_copy(cv_vec4_bval(dst), doff, cv_vec4_bval(src), soff, width);
+}
+
+void cv_vec4_fill_bits(cv_vec4* dst, uint32_t doff, uint32_t width, cv_bit bit) {
+  _cv_bits_fill(cv_vec4_aval(dst), doff, width, (bit & 1) ? ~0ULL : 0);
+  _cv_bits_fill(cv_vec4_bval(dst), doff, width, (bit & 2) ? ~0ULL : 0);
+}
+
+cv_bit cv_vec4_get_bit(cv_vec4* v, uint32_t i) {
+  uint64_t a = cv_vec4_aval(v)[i / 64] >> (i % 64);
+  uint64_t b = cv_vec4_bval(v)[i / 64] >> (i % 64);
+  return (cv_bit)((a & 1) | ((b & 1) << 1));
+}
+
+void cv_vec4_set_bit(cv_vec4* v, uint32_t i, cv_bit bit) {
+  uint64_t m = 1ULL << (i % 64);
+  uint64_t* a = &cv_vec4_aval(v)[i / 64];
+  uint64_t* b = &cv_vec4_bval(v)[i / 64];
+  *a = (bit & 1) ? (*a | m) : (*a & ~m);
+  *b = (bit & 2) ? (*b | m) : (*b & ~m);
+  if (bit & 2) v->flags &= ~CV_VEC_2STATE;
+}
+
+bool cv_vec4_has_xz(cv_vec4* v) {
+  size_t n = CV_WORDS(v->width);
+  uint64_t* b = cv_vec4_bval(v);
+  uint64_t any = 0;
+  for (size_t i = 0; i < n; i ++) any |= b[i];
+  return any != 0;
+}
+
+bool cv_vec4_refresh_2state(cv_vec4* v) {
+  if (cv_vec4_has_xz(v)) {
+    v->flags &= ~CV_VEC_2STATE;
+    return false;
+  }
+  v->flags |= CV_VEC_2STATE;
+  return true;
+}
+
+bool cv_vec4_identical(cv_vec4* x, cv_vec4* y) {
+  if (cv_vec4_is_small(x)) return x->small.a == y->small.a && x->small.b == y->small.b;
+  return memcmp(x->words, y->words, 2 * CV_WORDS(x->width) * sizeof(uint64_t)) == 0;
+}
+
+void cv_vec4_to_str(cv_vec4* v, char* out) {
+  static char const names[] = "01zx";
+  for (uint32_t i = 0; i < v->width; i ++) {
+    out[v->width - 1 - i] = names[cv_vec4_get_bit(v, i)];
+  }
+  out[v->width] = '\0';
+}
+
+// Word kernels. The formulas are shared by the scalar loops, the inline
+// small paths and the AVX2 versions.
+#define _CV_AND(ra, rb, xa, xb, ya, yb) \
+  do { ra = ((xa) | (xb)) & ((ya) | (yb)); rb = ra & ((xb) | (yb)); } while (0)
+#define _CV_OR(ra, rb, xa, xb, ya, yb) \
+  do { ra = (xa) | (xb) | (ya) | (yb); rb = ra & ~(((xa) & ~(xb)) | ((ya) & ~(yb))); } while (0)
+#define _CV_XOR(ra, rb, xa, xb, ya, yb) \
+  do { rb = (xb) | (yb); ra = ((xa) ^ (ya)) | rb; } while (0)
+
+#define _CV_W2_AND(a, b) ((a) & (b))
+#define _CV_W2_OR(a, b) ((a) | (b))
+#define _CV_W2_XOR(a, b) ((a) ^ (b))
+
+typedef void (*_cv_binop_kernel)(uint64_t* ra, uint64_t* rb, uint64_t const* xa, uint64_t const* xb,
+                                 uint64_t const* ya, uint64_t const* yb, size_t n);
+
+#define _CV_SCALAR_BINOP(name, OP) \
+  static void name(uint64_t* ra, uint64_t* rb, uint64_t const* xa, uint64_t const* xb, \
+                   uint64_t const* ya, uint64_t const* yb, size_t n) { \
+    for (size_t i = 0; i < n; i ++) { \
+      uint64_t a, b; \
+      OP(a, b, xa[i], xb[i], ya[i], yb[i]); \
+      ra[i] = a; \
+      rb[i] = b; \
+    } \
+  }
+
+_CV_SCALAR_BINOP(_cv_and_scalar, _CV_AND)
+_CV_SCALAR_BINOP(_cv_or_scalar, _CV_OR)
+_CV_SCALAR_BINOP(_cv_xor_scalar, _CV_XOR)
+
+#ifdef CV_HAVE_AVX2_KERNELS
+
+#define _CV_LD(p, i) _mm256_loadu_si256((__m256i const*)((p) + (i)))
+#define _CV_ST(p, i, v) _mm256_storeu_si256((__m256i*)((p) + (i)), v)
+
+// Four words per iteration, scalar tail
+#define _CV_AVX2_BINOP(name, BODY, OP) \
+  __attribute__((target("avx2"))) \
+  static void name(uint64_t* ra, uint64_t* rb, uint64_t const* xa, uint64_t const* xb, \
+                   uint64_t const* ya, uint64_t const* yb, size_t n) { \
+    size_t i = 0; \
+    for (; i + 4 <= n; i += 4) { \
+      __m256i va = _CV_LD(xa, i), vb = _CV_LD(xb, i), wa = _CV_LD(ya, i), wb = _CV_LD(yb, i); \
+      __m256i oa, ob; \
+      BODY; \
+      _CV_ST(ra, i, oa); \
+      _CV_ST(rb, i, ob); \
+    } \
+    for (; i < n; i ++) { \
+      uint64_t a, b; \
+      OP(a, b, xa[i], xb[i], ya[i], yb[i]); \
+      ra[i] = a; \
+      rb[i] = b; \
+    } \
+  }
+
+_CV_AVX2_BINOP(_cv_and_avx2, {
+  oa = _mm256_and_si256(_mm256_or_si256(va, vb), _mm256_or_si256(wa, wb));
+  ob = _mm256_and_si256(oa, _mm256_or_si256(vb, wb));
+}, _CV_AND)
+
+_CV_AVX2_BINOP(_cv_or_avx2, {
+  oa = _mm256_or_si256(_mm256_or_si256(va, vb), _mm256_or_si256(wa, wb));
+  __m256i one = _mm256_or_si256(_mm256_andnot_si256(vb, va), _mm256_andnot_si256(wb, wa));
+  ob = _mm256_andnot_si256(one, oa);
+}, _CV_OR)
+
+_CV_AVX2_BINOP(_cv_xor_avx2, {
+  ob = _mm256_or_si256(vb, wb);
+  oa = _mm256_or_si256(_mm256_xor_si256(va, wa), ob);
+}, _CV_XOR)
+
+#endif
+
+// -1 until detected. Netlist workers race on the first check, so it is
+// read and written atomically; they all store the same answer.
+static int _cv_avx2 = -1;
+
+static bool _cv_use_avx2(size_t n) {
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (n < 4) return false;
+  int avx2 = __atomic_load_n(&_cv_avx2, __ATOMIC_RELAXED);
+  if (avx2 < 0) {
+    avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    __atomic_store_n(&_cv_avx2, avx2, __ATOMIC_RELAXED);
+  }
+  return avx2;
+#else
+  (void)n;
+  return false;
+#endif
+}
+
+static void _cv_binop(cv_vec4* r, cv_vec4* x, cv_vec4* y, _cv_binop_kernel scalar, _cv_binop_kernel avx2) {
+  size_t n = CV_WORDS(r->width);
+  _cv_binop_kernel k = (avx2 && _cv_use_avx2(n)) ? avx2 : scalar;
+  k(cv_vec4_aval(r), cv_vec4_bval(r), cv_vec4_aval(x), cv_vec4_bval(x), cv_vec4_aval(y), cv_vec4_bval(y), n);
+}
+
+#ifdef CV_HAVE_AVX2_KERNELS
+#define _CV_AVX2_OR_NULL(k) k
+#else
+#define _CV_AVX2_OR_NULL(k) NULL
+#endif
+
+#define _CV_ALL_2STATE(...) _cv_all_2state((cv_vec4*[]){__VA_ARGS__, NULL})
+
+static bool _cv_all_2state(cv_vec4** v) {
+  for (; *v; v ++) {
+    if (!((*v)->flags & CV_VEC_2STATE)) return false;
+  }
+  return true;
+}
+
+// Called once aval holds a two state result
+static void _cv_vec4_mark_2state(cv_vec4* r) {
+  if (!(r->flags & CV_VEC_2STATE)) memset(cv_vec4_bval(r), 0, CV_WORDS(r->width) * sizeof(uint64_t));
+  r->flags |= CV_VEC_2STATE;
+}
+
+#define _CV_2STATE_BINOP(r, x, y, EXPR, kernel) \
+  do { \
+    if (_CV_ALL_2STATE(x, y)) { \
+      if (cv_vec4_is_small(r)) r->small.a = EXPR(x->small.a, y->small.a); \
+      else kernel(cv_vec4_aval(r), cv_vec4_aval(x), cv_vec4_aval(y), CV_WORDS(r->width)); \
+      _cv_vec4_mark_2state(r); \
+      return; \
+    } \
+    r->flags &= ~CV_VEC_2STATE; \
+  } while (0)
+
+void cv_vec4_and(cv_vec4* r, cv_vec4* x, cv_vec4* y) {
+  _CV_2STATE_BINOP(r, x, y, _CV_W2_AND, cv_w2_and);
+  if (cv_vec4_is_small(r)) {
+    _CV_AND(r->small.a, r->small.b, x->small.a, x->small.b, y->small.a, y->small.b);
+    return;
+  }
+  _cv_binop(r, x, y, _cv_and_scalar, _CV_AVX2_OR_NULL(_cv_and_avx2));
+}
+
+void cv_vec4_or(cv_vec4* r, cv_vec4* x, cv_vec4* y) {
+  _CV_2STATE_BINOP(r, x, y, _CV_W2_OR, cv_w2_or);
+  if (cv_vec4_is_small(r)) {
+    uint64_t a, b;
+    _CV_OR(a, b, x->small.a, x->small.b, y->small.a, y->small.b);
+    r->small.a = a;
+    r->small.b = b;
+    return;
+  }
+  _cv_binop(r, x, y, _cv_or_scalar, _CV_AVX2_OR_NULL(_cv_or_avx2));
+}
+
+void cv_vec4_xor(cv_vec4* r, cv_vec4* x, cv_vec4* y) {
+  _CV_2STATE_BINOP(r, x, y, _CV_W2_XOR, cv_w2_xor);
+  if (cv_vec4_is_small(r)) {
+    uint64_t a, b;
+    _CV_XOR(a, b, x->small.a, x->small.b, y->small.a, y->small.b);
+    r->small.a = a;
+    r->small.b = b;
+    return;
+  }
+  _cv_binop(r, x, y, _cv_xor_scalar, _CV_AVX2_OR_NULL(_cv_xor_avx2));
+}
+
+static inline void _cv_mux_word(uint64_t* ra, uint64_t* rb, uint64_t sa, uint64_t sb,
+                                uint64_t xa, uint64_t xb, uint64_t ya, uint64_t yb) {
+  uint64_t s0 = ~sa & ~sb;
+  uint64_t s1 = sa & ~sb;
+  // Unknown select still gives a known bit where both inputs agree on one
+  uint64_t agree = ~xb & ~yb & ~(xa ^ ya);
+  *ra = (s0 & xa) | (s1 & ya) | (sb & (~agree | xa));
+  *rb = (s0 & xb) | (s1 & yb) | (sb & ~agree);
+}
+
+#ifdef CV_HAVE_AVX2_KERNELS
+
+__attribute__((target("avx2")))
+static void _cv_not_avx2(uint64_t* ra, uint64_t* rb, uint64_t const* xa, uint64_t const* xb, size_t n) {
+  size_t i = 0;
+  __m256i ones = _mm256_set1_epi64x(-1);
+  for (; i + 4 <= n; i += 4) {
+    __m256i b = _CV_LD(xb, i);
+    _CV_ST(ra, i, _mm256_or_si256(_mm256_xor_si256(_CV_LD(xa, i), ones), b));
+    _CV_ST(rb, i, b);
+  }
+  for (; i < n; i ++) {
+    uint64_t b = xb[i];
+    ra[i] = ~xa[i] | b;
+    rb[i] = b;
+  }
+}
+
+// _cv_mux_word four words at a time
+__attribute__((target("avx2")))
+static void _cv_mux_avx2(uint64_t* ra, uint64_t* rb, uint64_t const* sa, uint64_t const* sb, uint64_t const* xa,
+                         uint64_t const* xb, uint64_t const* ya, uint64_t const* yb, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i vsa = _CV_LD(sa, i), vsb = _CV_LD(sb, i);
+    __m256i vxa = _CV_LD(xa, i), vxb = _CV_LD(xb, i), vya = _CV_LD(ya, i), vyb = _CV_LD(yb, i);
+    __m256i s0 = _mm256_andnot_si256(_mm256_or_si256(vsa, vsb), _mm256_set1_epi64x(-1));
+    __m256i s1 = _mm256_andnot_si256(vsb, vsa);
+    __m256i disagree = _mm256_or_si256(_mm256_or_si256(vxb, vyb), _mm256_xor_si256(vxa, vya));
+    __m256i oa = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(s0, vxa), _mm256_and_si256(s1, vya)),
+                                 _mm256_and_si256(vsb, _mm256_or_si256(disagree, vxa)));
+    __m256i ob = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(s0, vxb), _mm256_and_si256(s1, vyb)),
+                                 _mm256_and_si256(vsb, disagree));
+    _CV_ST(ra, i, oa);
+    _CV_ST(rb, i, ob);
+  }
+  for (; i < n; i ++) _cv_mux_word(&ra[i], &rb[i], sa[i], sb[i], xa[i], xb[i], ya[i], yb[i]);
+}
+
+// 0 on a known mismatch, else 1 or x by whether any bit was x/z
+__attribute__((target("avx2")))
+static cv_bit _cv_eq_avx2(uint64_t const* xa, uint64_t const* xb, uint64_t const* ya, uint64_t const* yb, size_t n) {
+  size_t i = 0;
+  __m256i unknown = _mm256_setzero_si256();
+  for (; i + 4 <= n; i += 4) {
+    __m256i u = _mm256_or_si256(_CV_LD(xb, i), _CV_LD(yb, i));
+    __m256i diff = _mm256_xor_si256(_CV_LD(xa, i), _CV_LD(ya, i));
+    if (!_mm256_testc_si256(u, diff)) return CV_BIT_0;
+    unknown = _mm256_or_si256(unknown, u);
+  }
+  uint64_t rest = !_mm256_testz_si256(unknown, unknown);
+  for (; i < n; i ++) {
+    uint64_t u = xb[i] | yb[i];
+    if ((xa[i] ^ ya[i]) & ~u) return CV_BIT_0;
+    rest |= u;
+  }
+  return rest ? CV_BIT_X : CV_BIT_1;
+}
+
+// Index of the highest word where x and y differ, n when none does
+__attribute__((target("avx2")))
+static size_t _cv_top_diff_avx2(uint64_t const* x, uint64_t const* y, size_t n) {
+  size_t i = n;
+  for (; i >= 4; i -= 4) {
+    __m256i eq = _mm256_cmpeq_epi64(_CV_LD(x, i - 4), _CV_LD(y, i - 4));
+    unsigned ne = ~(unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) & 15;
+    if (ne) return i - 4 + (31 - __builtin_clz(ne));
+  }
+  while (i-- > 0) {
+    if (x[i] != y[i]) return i;
+  }
+  return n;
+}
+
+#endif
+
+void cv_vec4_not(cv_vec4* r, cv_vec4* x) {
+  size_t n = CV_WORDS(r->width);
+  uint64_t* ra = cv_vec4_aval(r);
+  uint64_t* rb = cv_vec4_bval(r);
+  uint64_t* xa = cv_vec4_aval(x);
+  uint64_t* xb = cv_vec4_bval(x);
+  if (x->flags & CV_VEC_2STATE) {
+    cv_w2_not(ra, xa, n);
+    ra[n - 1] &= cv_vec4_top_mask(r->width);
+    _cv_vec4_mark_2state(r);
+    return;
+  }
+  r->flags &= ~CV_VEC_2STATE;
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (_cv_use_avx2(n)) _cv_not_avx2(ra, rb, xa, xb, n);
+  else
+#endif
+  for (size_t i = 0; i < n; i ++) {
+    uint64_t b = xb[i];
+    ra[i] = ~xa[i] | b;
+    rb[i] = b;
+  }
+  ra[n - 1] &= cv_vec4_top_mask(r->width);
+}
+
+// Gate buffer: like a copy but z comes out as x
+void cv_vec4_buf(cv_vec4* r, cv_vec4* x) {
+  if (x->flags & CV_VEC_2STATE) {
+    if (r != x) cv_vec4_copy(r, x);
+    return;
+  }
+  r->flags &= ~CV_VEC_2STATE;
+  size_t n = CV_WORDS(r->width);
+  uint64_t* ra = cv_vec4_aval(r);
+  uint64_t* rb = cv_vec4_bval(r);
+  uint64_t* xa = cv_vec4_aval(x);
+  uint64_t* xb = cv_vec4_bval(x);
+  for (size_t i = 0; i < n; i ++) {
+    uint64_t b = xb[i];
+    ra[i] = xa[i] | b;
+    rb[i] = b;
+  }
+}
+
+void cv_vec4_mux(cv_vec4* r, cv_vec4* sel, cv_vec4* x, cv_vec4* y) {
+  size_t n = CV_WORDS(r->width);
+  uint64_t* ra = cv_vec4_aval(r);
+  uint64_t* rb = cv_vec4_bval(r);
+  uint64_t* sa = cv_vec4_aval(sel);
+  uint64_t* sb = cv_vec4_bval(sel);
+  uint64_t* xa = cv_vec4_aval(x);
+  uint64_t* xb = cv_vec4_bval(x);
+  uint64_t* ya = cv_vec4_aval(y);
+  uint64_t* yb = cv_vec4_bval(y);
+  if (_CV_ALL_2STATE(sel, x, y)) {
+    cv_w2_mux(ra, sa, xa, ya, n);
+    _cv_vec4_mark_2state(r);
+    return;
+  }
+  r->flags &= ~CV_VEC_2STATE;
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (_cv_use_avx2(n)) _cv_mux_avx2(ra, rb, sa, sb, xa, xb, ya, yb, n);
+  else
+#endif
+  for (size_t i = 0; i < n; i ++) {
+    _cv_mux_word(&ra[i], &rb[i], sa[i], sb[i], xa[i], xb[i], ya[i], yb[i]);
+  }
+  ra[n - 1] &= cv_vec4_top_mask(r->width);
+  rb[n - 1] &= cv_vec4_top_mask(r->width);
+}
+
+void cv_vec4_mux1(cv_vec4* r, cv_bit sel, cv_vec4* x, cv_vec4* y) {
+  if (sel == CV_BIT_0) {
+    if (r != x) cv_vec4_copy(r, x);
+    return;
+  }
+  if (sel == CV_BIT_1) {
+    if (r != y) cv_vec4_copy(r, y);
+    return;
+  }
+
+  r->flags &= ~CV_VEC_2STATE;
+  size_t n = CV_WORDS(r->width);
+  uint64_t* ra = cv_vec4_aval(r);
+  uint64_t* rb = cv_vec4_bval(r);
+  uint64_t* xa = cv_vec4_aval(x);
+  uint64_t* xb = cv_vec4_bval(x);
+  uint64_t* ya = cv_vec4_aval(y);
+  uint64_t* yb = cv_vec4_bval(y);
+  for (size_t i = 0; i < n; i ++) {
+    _cv_mux_word(&ra[i], &rb[i], 0, ~0ULL, xa[i], xb[i], ya[i], yb[i]);
+  }
+  ra[n - 1] &= cv_vec4_top_mask(r->width);
+  rb[n - 1] &= cv_vec4_top_mask(r->width);
+}
+
+// Logical equality: a known mismatch anywhere is 0, otherwise any x/z is x
+cv_bit cv_vec4_eq(cv_vec4* x, cv_vec4* y) {
+  size_t n = CV_WORDS(x->width);
+  uint64_t* xa = cv_vec4_aval(x);
+  uint64_t* xb = cv_vec4_bval(x);
+  uint64_t* ya = cv_vec4_aval(y);
+  uint64_t* yb = cv_vec4_bval(y);
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (_cv_use_avx2(n)) return _cv_eq_avx2(xa, xb, ya, yb, n);
+#endif
+  uint64_t unknown = 0;
+  for (size_t i = 0; i < n; i ++) {
+    uint64_t u = xb[i] | yb[i];
+    if ((xa[i] ^ ya[i]) & ~u) return CV_BIT_0;
+    unknown |= u;
+  }
+  return unknown ? CV_BIT_X : CV_BIT_1;
+}
+
+// Unsigned less than
+cv_bit cv_vec4_lt(cv_vec4* x, cv_vec4* y) {
+  if (cv_vec4_has_xz(x) || cv_vec4_has_xz(y)) return CV_BIT_X;
+  size_t n = CV_WORDS(x->width);
+  uint64_t* xa = cv_vec4_aval(x);
+  uint64_t* ya = cv_vec4_aval(y);
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (_cv_use_avx2(n)) {
+    size_t i = _cv_top_diff_avx2(xa, ya, n);
+    return i < n && xa[i] < ya[i] ? CV_BIT_1 : CV_BIT_0;
+  }
+#endif
+  for (size_t i = n; i-- > 0;) {
+    if (xa[i] != ya[i]) return xa[i] < ya[i] ? CV_BIT_1 : CV_BIT_0;
+  }
+  return CV_BIT_0;
+}
+
+typedef void (*_cv_w2_kernel)(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n);
+
+#define _CV_SCALAR_W2(name, EXPR) \
+  static void name(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) { \
+    for (size_t i = 0; i < n; i ++) r[i] = EXPR(x[i], y[i]); \
+  }
+
+_CV_SCALAR_W2(_cv_w2_and_scalar, _CV_W2_AND)
+_CV_SCALAR_W2(_cv_w2_or_scalar, _CV_W2_OR)
+_CV_SCALAR_W2(_cv_w2_xor_scalar, _CV_W2_XOR)
+
+#ifdef CV_HAVE_AVX2_KERNELS
+
+#define _CV_AVX2_W2(name, INTRIN, EXPR) \
+  __attribute__((target("avx2"))) \
+  static void name(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) { \
+    size_t i = 0; \
+    for (; i + 4 <= n; i += 4) _CV_ST(r, i, INTRIN(_CV_LD(x, i), _CV_LD(y, i))); \
+    for (; i < n; i ++) r[i] = EXPR(x[i], y[i]); \
+  }
+
+_CV_AVX2_W2(_cv_w2_and_avx2, _mm256_and_si256, _CV_W2_AND)
+_CV_AVX2_W2(_cv_w2_or_avx2, _mm256_or_si256, _CV_W2_OR)
+_CV_AVX2_W2(_cv_w2_xor_avx2, _mm256_xor_si256, _CV_W2_XOR)
+
+__attribute__((target("avx2")))
+static void _cv_w2_mux_avx2(uint64_t* r, uint64_t const* s, uint64_t const* x, uint64_t const* y, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i vs = _CV_LD(s, i);
+    _CV_ST(r, i, _mm256_or_si256(_mm256_andnot_si256(vs, _CV_LD(x, i)), _mm256_and_si256(vs, _CV_LD(y, i))));
+  }
+  for (; i < n; i ++) r[i] = (x[i] & ~s[i]) | (y[i] & s[i]);
+}
+
+__attribute__((target("avx2")))
+static void _cv_w2_not_avx2(uint64_t* r, uint64_t const* x, size_t n) {
+  size_t i = 0;
+  __m256i ones = _mm256_set1_epi64x(-1);
+  for (; i + 4 <= n; i += 4) _CV_ST(r, i, _mm256_xor_si256(_CV_LD(x, i), ones));
+  for (; i < n; i ++) r[i] = ~x[i];
+}
+
+#endif
+
+static void _cv_w2(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n, _cv_w2_kernel scalar, _cv_w2_kernel avx2) {
+  ((avx2 && _cv_use_avx2(n)) ? avx2 : scalar)(r, x, y, n);
+}
+
+void cv_w2_and(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) {
+  _cv_w2(r, x, y, n, _cv_w2_and_scalar, _CV_AVX2_OR_NULL(_cv_w2_and_avx2));
+}
+
+void cv_w2_or(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) {
+  _cv_w2(r, x, y, n, _cv_w2_or_scalar, _CV_AVX2_OR_NULL(_cv_w2_or_avx2));
+}
+
+void cv_w2_xor(uint64_t* r, uint64_t const* x, uint64_t const* y, size_t n) {
+  _cv_w2(r, x, y, n, _cv_w2_xor_scalar, _CV_AVX2_OR_NULL(_cv_w2_xor_avx2));
+}
+
+void cv_w2_not(uint64_t* r, uint64_t const* x, size_t n) {
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (_cv_use_avx2(n)) {
+    _cv_w2_not_avx2(r, x, n);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i ++) r[i] = ~x[i];
+}
+
+void cv_w2_mux(uint64_t* r, uint64_t const* s, uint64_t const* x, uint64_t const* y, size_t n) {
+#ifdef CV_HAVE_AVX2_KERNELS
+  if (_cv_use_avx2(n)) {
+    _cv_w2_mux_avx2(r, s, x, y, n);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i ++) r[i] = (x[i] & ~s[i]) | (y[i] & s[i]);
+}
+
+#endif
+
+#ifdef CVVEC_UT
+
+// Lets the unit test compare both paths
+static void _cv_vec_force_scalar(bool scalar) {
+  __atomic_store_n(&_cv_avx2, scalar ? 0 : -1, __ATOMIC_RELAXED);
+}
+
+void cvvec_unit_test() {
+  crena_arena arena = crena_init_growing();
+  static char const names[] = "01zx";
+
+  // Truth tables on single bits, rows are x, columns y, order 0 1 z x
+  char and_tab[17] = {0}, or_tab[17] = {0}, xor_tab[17] = {0}, not_tab[5] = {0};
+  for (int i = 0; i < 4; i ++) {
+    cv_vec4 x, y, r;
+    cv_vec4_init(&x, 1, &arena);
+    cv_vec4_init(&r, 1, &arena);
+    cv_vec4_set_bit(&x, 0, (cv_bit)i);
+    cv_vec4_not(&r, &x);
+    not_tab[i] = names[cv_vec4_get_bit(&r, 0)];
+    for (int j = 0; j < 4; j ++) {
+      cv_vec4_init(&y, 1, &arena);
+      cv_vec4_set_bit(&y, 0, (cv_bit)j);
+      cv_vec4_and(&r, &x, &y);
+      and_tab[i * 4 + j] = names[cv_vec4_get_bit(&r, 0)];
+      cv_vec4_or(&r, &x, &y);
+      or_tab[i * 4 + j] = names[cv_vec4_get_bit(&r, 0)];
+      cv_vec4_xor(&r, &x, &y);
+      xor_tab[i * 4 + j] = names[cv_vec4_get_bit(&r, 0)];
+    }
+  }
+  printf("and %s or %s xor %s not %s\n", and_tab, or_tab, xor_tab, not_tab);
+
+  // Wide vectors: AVX2 and scalar paths must agree
+  uint32_t width = 1000;
+  cv_vec4 x, y, r1, r2;
+  cv_vec4_init(&x, width, &arena);
+  cv_vec4_init(&y, width, &arena);
+  cv_vec4_init(&r1, width, &arena);
+  cv_vec4_init(&r2, width, &arena);
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  for (uint32_t i = 0; i < width; i ++) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    cv_vec4_set_bit(&x, i, (cv_bit)(seed & 3));
+    cv_vec4_set_bit(&y, i, (cv_bit)((seed >> 2) & 3));
+  }
+  bool same = true;
+  void (*ops[])(cv_vec4*, cv_vec4*, cv_vec4*) = {cv_vec4_and, cv_vec4_or, cv_vec4_xor};
+  for (size_t o = 0; o < 3; o ++) {
+    _cv_vec_force_scalar(true);
+    ops[o](&r1, &x, &y);
+    _cv_vec_force_scalar(false);
+    ops[o](&r2, &x, &y);
+    same = same && cv_vec4_identical(&r1, &r2);
+  }
+  cv_vec4 sel;
+  cv_vec4_init(&sel, width, &arena);
+  for (uint32_t i = 0; i < width; i ++) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    cv_vec4_set_bit(&sel, i, (cv_bit)(seed & 3));
+  }
+  _cv_vec_force_scalar(true);
+  cv_vec4_not(&r1, &x);
+  _cv_vec_force_scalar(false);
+  cv_vec4_not(&r2, &x);
+  same = same && cv_vec4_identical(&r1, &r2);
+  _cv_vec_force_scalar(true);
+  cv_vec4_mux(&r1, &sel, &x, &y);
+  _cv_vec_force_scalar(false);
+  cv_vec4_mux(&r2, &sel, &x, &y);
+  same = same && cv_vec4_identical(&r1, &r2);
+  // Compares against zero: equal, an x in the middle, a known top bit, and
+  // a known top bit past an x
+  cv_vec4 c;
+  cv_vec4_init(&c, width, &arena);
+  cv_vec4_set_u64(&r1, 0);
+  cv_bit want[] = {CV_BIT_1, CV_BIT_X, CV_BIT_0, CV_BIT_0};
+  for (int k = 0; k < 4; k ++) {
+    cv_vec4_set_u64(&c, 0);
+    if (k == 1 || k == 3) cv_vec4_set_bit(&c, 500, CV_BIT_X);
+    if (k >= 2) cv_vec4_set_bit(&c, width - 1, CV_BIT_1);
+    _cv_vec_force_scalar(true);
+    cv_bit e1 = cv_vec4_eq(&c, &r1);
+    _cv_vec_force_scalar(false);
+    cv_bit e2 = cv_vec4_eq(&c, &r1);
+    same = same && e1 == e2 && e1 == want[k];
+  }
+  for (uint32_t bit = 0; bit < width; bit += width - 1) {
+    cv_vec4_set_u64(&r1, 0);
+    cv_vec4_set_u64(&c, 0);
+    cv_vec4_set_bit(&c, bit, CV_BIT_1);
+    _cv_vec_force_scalar(true);
+    cv_bit lt1 = cv_vec4_lt(&r1, &c), gt1 = cv_vec4_lt(&c, &r1);
+    _cv_vec_force_scalar(false);
+    cv_bit lt2 = cv_vec4_lt(&r1, &c), gt2 = cv_vec4_lt(&c, &r1);
+    same = same && lt1 == CV_BIT_1 && gt1 == CV_BIT_0 && lt2 == lt1 && gt2 == gt1;
+  }
+  _cv_vec_force_scalar(false);
+  printf("Wide kernels match scalar? %s\n", same ? "yes" : "no");
+
+  // Fast two state path against the four state kernels on the same planes
+  bool fast_same = true;
+  uint32_t widths[] = {13, 64, 300};
+  for (size_t wi = 0; wi < 3; wi ++) {
+    cv_vec4 p, q, s4, f, g;
+    cv_vec4_init(&p, widths[wi], &arena);
+    cv_vec4_init(&q, widths[wi], &arena);
+    cv_vec4_init(&s4, widths[wi], &arena);
+    cv_vec4_init(&f, widths[wi], &arena);
+    cv_vec4_init(&g, widths[wi], &arena);
+    for (uint32_t i = 0; i < widths[wi]; i ++) {
+      seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+      cv_vec4_set_bit(&p, i, (cv_bit)(seed & 1));
+      cv_vec4_set_bit(&q, i, (cv_bit)((seed >> 1) & 1));
+      cv_vec4_set_bit(&s4, i, (cv_bit)((seed >> 2) & 1));
+    }
+    for (int op = 0; op < 6; op ++) {
+      for (int fast = 0; fast < 2; fast ++) {
+        cv_vec4* out = fast ? &f : &g;
+        uint32_t mark = fast ? CV_VEC_2STATE : 0;
+        p.flags = q.flags = s4.flags = mark;
+        switch (op) {
+        case 0: cv_vec4_and(out, &p, &q); break;
+        case 1: cv_vec4_or(out, &p, &q); break;
+        case 2: cv_vec4_xor(out, &p, &q); break;
+        case 3: cv_vec4_not(out, &p); break;
+        case 4: cv_vec4_buf(out, &p); break;
+        case 5: cv_vec4_mux(out, &s4, &p, &q); break;
+        }
+      }
+      fast_same = fast_same && cv_vec4_identical(&f, &g) && (f.flags & CV_VEC_2STATE);
+    }
+  }
+  printf("Two state fast path matches four state? %s\n", fast_same ? "yes" : "no");
+
+  cv_vec4 a, b;
+  cv_vec4_init(&a, 130, &arena);
+  cv_vec4_init(&b, 130, &arena);
+  cv_vec4_set_u64(&a, 5);
+  cv_vec4_set_u64(&b, 5);
+  printf("5 == 5: %c, ", names[cv_vec4_eq(&a, &b)]);
+  cv_vec4_set_bit(&b, 129, CV_BIT_X);
+  printf("with x: %c, ", names[cv_vec4_eq(&a, &b)]);
+  cv_vec4_set_bit(&b, 0, CV_BIT_0);
+  printf("with x and a known mismatch: %c, ", names[cv_vec4_eq(&a, &b)]);
+  cv_vec4_set_u64(&b, 7);
+  printf("5 < 7: %c\n", names[cv_vec4_lt(&a, &b)]);
+
+  cv_vec4 s, m;
+  cv_vec4_init(&s, 4, &arena);
+  cv_vec4_init(&m, 4, &arena);
+  cv_vec4 a4, b4;
+  cv_vec4_init(&a4, 4, &arena);
+  cv_vec4_init(&b4, 4, &arena);
+  cv_vec4_set_str(&a4, "0011", 4);
+  cv_vec4_set_str(&b4, "0101", 4);
+  cv_vec4_set_str(&s, "x01z", 4);
+  cv_vec4_mux(&m, &s, &a4, &b4);
+  char buf[8];
+  cv_vec4_to_str(&m, buf);
+  printf("mux sel x01z of 0011/0101: %s\n", buf);
+
+  // Bit ranges at every offset against get/set one bit at a time
+  cv_vec4 src, dst, ref;
+  cv_vec4_init(&src, 300, &arena);
+  cv_vec4_init(&dst, 300, &arena);
+  cv_vec4_init(&ref, 300, &arena);
+  for (uint32_t i = 0; i < 300; i ++) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    cv_vec4_set_bit(&src, i, (cv_bit)(seed & 3));
+  }
+  bool ranges = true;
+  for (size_t t = 0; t < 500; t ++) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    uint32_t soff = seed % 300, doff = (seed >> 12) % 300;
+    if (t % 4 == 0) { soff &= ~63u; doff &= ~63u; }
+    uint32_t room = 300 - (soff > doff ? soff : doff);
+    uint32_t width = (uint32_t)((seed >> 24) % (room + 1));
+    cv_vec4_fill(&dst, CV_BIT_X);
+    cv_vec4_fill(&ref, CV_BIT_X);
+    cv_vec4_copy_bits(&dst, doff, &src, soff, width);
+    for (uint32_t i = 0; i < width; i ++) cv_vec4_set_bit(&ref, doff + i, cv_vec4_get_bit(&src, soff + i));
+    cv_vec4_fill_bits(&dst, 0, doff < 10 ? doff : 10, CV_BIT_Z);
+    for (uint32_t i = 0; i < (doff < 10 ? doff : 10); i ++) cv_vec4_set_bit(&ref, i, CV_BIT_Z);
+    ranges = ranges && cv_vec4_identical(&dst, &ref);
+  }
+  printf("Unaligned bit ranges copy and fill exactly? %s\n", ranges ? "yes" : "no");
+
+  crena_free(&arena, CRENA_FT_ALL);
+}
+
+#endif
@@ -7,10 +7,34 @@
 #include <assert.h>
 
 #define CRENA_IMPLEMENTATION
+#define CVSCHED_IMPLEMENTATION
+#define CVVEC_IMPLEMENTATION
+#define CVARITH_IMPLEMENTATION
+#define CVSTRENGTH_IMPLEMENTATION
+#define CVMEM_IMPLEMENTATION
+#define CVNET_IMPLEMENTATION
+#define CVJIT_IMPLEMENTATION
+#define CVTHREAD_IMPLEMENTATION
 #ifdef UNIT_TEST
 #define CRENA_UT
+#define CVSCHED_UT
+#define CVVEC_UT
+#define CVARITH_UT
+#define CVSTRENGTH_UT
+#define CVMEM_UT
+#define CVNET_UT
+#define CVJIT_UT
+#define CVTHREAD_UT
 #endif
 #include "crena.h"
+#include "cvsched.h"
+#include "cvvec.h"
+#include "cvarith.h"
+#include "cvstrength.h"
+#include "cvmem.h"
+#include "cvnet.h"
+#include "cvjit.h"
+#include "cvthread.h"
 
 typedef struct {
   char const* str;
@@ -34,6 +58,21 @@ bool str_equal(str a, str b) {
   return true;
 }
 
+bool str_startswith(str a, str prefix) {
+  if (a.len < prefix.len) return false;
+  return memcmp(a.str, prefix.str, prefix.len) == 0;
+}
+
+// For crena_hm maps keyed by str
+size_t str_hm_hash(void const* key) {
+  str const* s = key;
+  return crena_hm_hash_bytes(s->str, s->len);
+}
+
+bool str_hm_eq(void const* a, void const* b) {
+  return str_equal(*(str const*)a, *(str const*)b);
+}
+
 str_scanner str_scanner_init(str input) {
   return (str_scanner) {
     .base = input,
@@ -323,12 +362,31 @@ typedef struct _vpi_scope {
   bool is_cell;
 } vpi_scope;
 
+typedef struct {
+  size_t key;
+  vpi_scope* value;
+} scope_id_entry;
+
+typedef struct {
+  str key;
+  cv_node_id value;
+} label_entry;
+
 typedef struct {
   ivl_version version;
   IVL_DELAY_SELECTION delay_selection;
   vpi_time_precision time_precision;
   str* file_names;
-  vpi_scope* scopes;
+  crena_sda(vpi_scope) scopes;
+  scope_id_entry* scope_ids;
+  signal_type_varnet* varnets;
+  label_entry* labels;
+  cv_net net;
+  label_entry* events;
+  label_entry* arrays;
+  char const** array_names;
+  cv_vthreads threads;
+  uint32_t* thread_starts;
 } vvp_module;
 
 str read_entire_file(char const* filename, crena_arena* arena) {
@@ -456,6 +514,110 @@ size_t get_scope_id_from_str(str scopeid) {
   return strtoll(scopeid.str + 2, NULL, 0);
 }
 
+typedef struct {
+  cv_node_id node;
+  size_t cursor;
+  uint32_t n_ports; // 0 for up to CV_NODE_MAX_IN
+} pending_inputs;
+
+typedef struct {
+  uint32_t pc;
+  str label;
+} pending_jump;
+
+// An edge .event watching nets, or an .event/or of other events
+typedef struct {
+  uint32_t event;
+  bool is_or;
+  cv_edge edge;
+  size_t cursor;
+} pending_event;
+
+#define X_EVENT_EDGE() \
+  XEVE(posedge, CV_EDGE_POS),\
+  XEVE(negedge, CV_EDGE_NEG),\
+  XEVE(edge, CV_EDGE_BOTH),\
+  XEVE(anyedge, CV_EDGE_ANY)
+
+#define XEVE(n, e) { STR_CONST(n), e }
+
+struct {
+  str name;
+  cv_edge edge;
+} EVENT_EDGES[] = {
+  X_EVENT_EDGE()
+};
+
+#undef XEVE
+
+// Next comma separated operand of an instruction or statement
+str next_operand(str_scanner* scan) {
+  str op = str_scanner_nexttoken(scan);
+  if (op.len && (str_back(op) == ',' || str_back(op) == ';')) op.len --;
+  return op;
+}
+
+// .net/2u, .var/s, .net8 etc all map onto the base statement
+statement_type get_statement_type(str type) {
+  str base = type;
+  for (size_t i = 0; i < type.len; i ++) {
+    if (type.str[i] == '/') {
+      base.len = i;
+      break;
+    }
+  }
+  if (str_equal(base, STR_CONST(.net8))) return SIGNAL_TYPE_net;
+  for (size_t i = 0; i < N_SIGNAL_TYPE; i ++) {
+    if (str_equal(base, SIGNAL_TYPE_NAMES[i])) return (statement_type)i;
+  }
+  return (statement_type)N_SIGNAL_TYPE;
+}
+
+varnet_type get_varnet_type(str type) {
+  for (size_t i = 0; i < type.len; i ++) {
+    if (type.str[i] != '/') continue;
+    str suffix = { .str = type.str + i + 1, .len = type.len - i - 1 };
+    for (size_t t = 0; t < N_VARNET_TYPE; t ++) {
+      if (str_equal(suffix, VARNET_TYPE_NAMES[t])) return (varnet_type)t;
+    }
+  }
+  return VARNET_TYPE_NONE;
+}
+
+// .arith, .cmp and .shift nodes by full type. Signed and real variants
+// have no entry.
+#define X_ARITH_TYPE() \
+  XART(.arith/sum, ADD),\
+  XART(.arith/sub, SUB),\
+  XART(.arith/mult, MUL),\
+  XART(.arith/div, DIV),\
+  XART(.arith/mod, MOD),\
+  XART(.cmp/eq, EQ),\
+  XART(.cmp/ne, NE),\
+  XART(.cmp/eeq, EEQ),\
+  XART(.cmp/nee, NEE),\
+  XART(.cmp/ge, GE),\
+  XART(.cmp/gt, GT),\
+  XART(.shift/l, SHL),\
+  XART(.shift/r, SHR)
+
+#define XART(t, op) { STR_CONST(t), CV_OP_##op }
+
+struct { str name; cv_op op; } ARITH_TYPES[] = {
+  X_ARITH_TYPE()
+};
+
+#undef XART
+
+size_t N_ARITH_TYPE = sizeof(ARITH_TYPES) / sizeof(ARITH_TYPES[0]);
+
+cv_op get_arith_op(str type) {
+  for (size_t i = 0; i < N_ARITH_TYPE; i ++) {
+    if (str_equal(type, ARITH_TYPES[i].name)) return ARITH_TYPES[i].op;
+  }
+  return CV_OP_COUNT;
+}
+
 vvp_module parse_vvp_module(str bytecode, crena_arena* arena) {
   vvp_module ret = {0};
 
@@ -484,7 +646,8 @@ vvp_module parse_vvp_module(str bytecode, crena_arena* arena) {
     if (ident_parsers[i].fin_fn) ident_parsers[i].fin_fn(&ret, arena);
   }
 
-  crena_da_init(ret.scopes, arena);
+  crena_sda_init(ret.scopes, arena);
+  crena_hm_init(ret.scope_ids, arena);
   // Scope parsing
   // Stage 1: Find all scopes
   // and parse the basic information
@@ -531,12 +694,8 @@ vvp_module parse_vvp_module(str bytecode, crena_arena* arena) {
 
         size_t pid = get_scope_id_from_str(sparent);
 
-        for (size_t i = 0; i < crena_da_len(ret.scopes); i ++) {
-          if (ret.scopes[i].scope_id == pid) {
-            scope.parent = &ret.scopes[i];
-            break;
-          }
-        }
+        scope_id_entry* parent = crena_hm_get(ret.scope_ids, pid);
+        if (parent) scope.parent = parent->value;
       }
 
       //TODO: Probably some defensive programming here
@@ -554,19 +713,19 @@ vvp_module parse_vvp_module(str bytecode, crena_arena* arena) {
         scope.ports = (port_info*)ports_start; // Cursed, but let's store the start location of ports in the pointer
       }
 
-      crena_da_push(ret.scopes, scope);
+      crena_sda_push(ret.scopes, scope);
+      crena_hm_put(ret.scope_ids, scope.scope_id, &crena_sda_at(ret.scopes, crena_sda_len(ret.scopes) - 1));
     }
 
     str_scanner_skipuntil_nextline(&ss1);
   }
 
-  crena_da_compress(ret.scopes);
-
   // Stage 2: Process port info on scopes
-  for (size_t i = 0; i < crena_da_len(ret.scopes); i ++) {
+  for (size_t i = 0; i < crena_sda_len(ret.scopes); i ++) {
+    vpi_scope* scope = &crena_sda_at(ret.scopes, i);
     str_scanner scope_scan = str_scanner_init(bytecode);
-    scope_scan.cursor = (size_t)ret.scopes[i].ports; // hehe un_curse
-    crena_da_init(ret.scopes[i].ports, arena);
+    scope_scan.cursor = (size_t)scope->ports; // hehe un_curse
+    crena_da_init(scope->ports, arena);
     if (scope_scan.cursor) {
       while (1) {
         str port_info_ident = str_scanner_nexttoken(&scope_scan);
@@ -590,30 +749,463 @@ vvp_module parse_vvp_module(str bytecode, crena_arena* arena) {
         }
         inf.width = atoi(swidth.str);
         inf.name = pname;
-        crena_da_push(ret.scopes[i].ports, inf);
+        crena_da_push(scope->ports, inf);
         str_scanner_skipuntil_nextline(&scope_scan);
       }
     }
-    crena_da_compress(ret.scopes[i].ports);
+    crena_da_compress(scope->ports);
   }
 
-  for (size_t i = 0; i < crena_da_len(ret.scopes); i ++) {
-    printf("Found a scope: %.*s\n", STR_PF(ret.scopes[i].name));
-    printf("The scope has %ld ports\n", crena_da_len(ret.scopes[i].ports));
+  for (size_t i = 0; i < crena_sda_len(ret.scopes); i ++) {
+    vpi_scope* scope = &crena_sda_at(ret.scopes, i);
+    printf("Found a scope: %.*s\n", STR_PF(scope->name));
+    printf("The scope has %ld ports\n", crena_da_len(scope->ports));
   }
 
   // Finally, let's grab the nets, vars, and functors
+  // Stage 3: every one becomes a netlist node under its label
+  // Inputs are resolved in stage 4, since labels get used before
+  // the line declaring them
+  cv_net_init(&ret.net, arena);
+  crena_da_init(ret.varnets, arena);
+  crena_hm_init_fn(ret.labels, arena, str_hm_hash, str_hm_eq);
+  crena_hm_init_fn(ret.events, arena, str_hm_hash, str_hm_eq);
+  crena_hm_init_fn(ret.arrays, arena, str_hm_hash, str_hm_eq);
+  crena_da_init(ret.array_names, arena);
+  cv_vthreads_init(&ret.threads, arena);
+
+  pending_inputs* pending;
+  crena_da_init(pending, arena);
+  pending_event* pending_events;
+  crena_da_init(pending_events, arena);
+  size_t unsupported = 0;
+
+  str_scanner lines = str_scanner_init(bytecode);
+  while (str_scanner_more(lines)) {
+    str line = str_scanner_takeuntil_nextline(&lines);
+    str_scanner ss3 = str_scanner_init(line);
+    size_t line_start = line.str - bytecode.str;
+    str ident = str_scanner_nexttoken(&ss3);
+    str type = str_scanner_nexttoken(&ss3);
+    statement_type st = get_statement_type(type);
+
+    if (st == SIGNAL_TYPE_functor) {
+      str fname = str_scanner_nexttoken(&ss3);
+      str swidth = str_scanner_nexttoken(&ss3);
+      cv_sc drive = CV_DRIVE_STRONG;
+      if (str_back(swidth) != ',') {
+        // Drive strengths: [<s0> <s1>],
+        str s0 = str_scanner_nexttoken(&ss3);
+        str s1 = str_scanner_nexttoken(&ss3);
+        if (s0.len > 1 && str_front(s0) == '[') drive = CV_SC(atoi(s0.str + 1) & 7, atoi(s1.str) & 7);
+        if (str_back(s1) != ',') str_scanner_skipuntil(&ss3, ',');
+      }
+      str_scanner_skipnext(&ss3);
+
+      cv_op op = cv_op_from_name(fname.str, fname.len);
+      if (op == CV_OP_COUNT) unsupported ++;
+      cv_node_id id = cv_net_add(&ret.net, op, atoi(swidth.str));
+      cv_net_node(&ret.net, id)->drive = drive;
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = line_start + ss3.cursor }));
+    } else if (st == SIGNAL_TYPE_net || st == SIGNAL_TYPE_var) {
+      signal_type_varnet vn = {0};
+      vn.type = get_varnet_type(type);
+      vn.name = str_scanner_nexttoken(&ss3);
+      str_scanner_skipuntil(&ss3, ',');
+      str_scanner_skipnext(&ss3);
+      vn.msb = atoi(str_scanner_nexttoken(&ss3).str);
+      vn.lsb = atoi(str_scanner_nexttoken(&ss3).str);
+      uint32_t width = (vn.msb > vn.lsb ? vn.msb - vn.lsb : vn.lsb - vn.msb) + 1;
+
+      vn.driver = cv_net_add(&ret.net, st == SIGNAL_TYPE_net ? CV_OP_NET : CV_OP_VAR, width);
+      crena_hm_put(ret.labels, ident, (cv_node_id)vn.driver);
+      crena_da_push(ret.varnets, vn);
+      if (st == SIGNAL_TYPE_net) {
+        crena_da_push(pending, ((pending_inputs){ .node = vn.driver, .cursor = line_start + ss3.cursor }));
+      }
+    } else if (st == SIGNAL_TYPE_dff || st == SIGNAL_TYPE_latch) {
+      // .dff/p|n[/aclr|/aset] <width> d, clk, ce[, async];  .latch <width> d, en;
+      str swidth = str_scanner_nexttoken(&ss3);
+      cv_node_id id;
+      if (st == SIGNAL_TYPE_latch) {
+        id = cv_net_add(&ret.net, CV_OP_LATCH, atoi(swidth.str));
+      } else {
+        cv_edge edge = str_startswith(type, STR_CONST(.dff/n)) ? CV_EDGE_NEG : CV_EDGE_POS;
+        cv_async async = CV_ASYNC_NONE;
+        if (type.len > 5 && str_equal((str){ type.str + type.len - 5, 5 }, STR_CONST(/aclr))) async = CV_ASYNC_CLEAR;
+        if (type.len > 5 && str_equal((str){ type.str + type.len - 5, 5 }, STR_CONST(/aset))) async = CV_ASYNC_SET;
+        id = cv_net_add_dff(&ret.net, atoi(swidth.str), edge, async);
+      }
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = line_start + ss3.cursor }));
+    } else if (st == SIGNAL_TYPE_arith || st == SIGNAL_TYPE_cmp || st == SIGNAL_TYPE_shift) {
+      // .arith/<op> <width>, a, b;  .cmp/<op> <width>, a, b;  .shift/<dir> <width>, a, amount;
+      str swidth = str_scanner_nexttoken(&ss3);
+      cv_op op = get_arith_op(type);
+      if (op == CV_OP_COUNT) {
+        unsupported ++;
+        continue;
+      }
+      cv_node_id id = cv_net_add(&ret.net, op, st == SIGNAL_TYPE_cmp ? 1 : atoi(swidth.str));
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = line_start + ss3.cursor }));
+    } else if (st == SIGNAL_TYPE_resolv) {
+      // .resolv <kind>, drivers...;  sized by its drivers
+      str kind = str_scanner_nexttoken(&ss3);
+      if (str_back(kind) == ',') kind.len --;
+      cv_resolv_kind k = cv_resolv_kind_from_name(kind.str, kind.len);
+      if (k == CV_RESOLV_COUNT) unsupported ++;
+      cv_node_id id = cv_net_add_resolv(&ret.net, 0, k == CV_RESOLV_COUNT ? CV_RESOLV_TRI : k);
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = line_start + ss3.cursor }));
+    } else if (st == SIGNAL_TYPE_part) {
+      // .part a, <base>, <width>;  .part/pv a, <base>, <width>, <vector width>;
+      size_t cursor = line_start + ss3.cursor;
+      str_scanner_nexttoken(&ss3);
+      uint32_t base = atoi(str_scanner_nexttoken(&ss3).str);
+      uint32_t width = atoi(str_scanner_nexttoken(&ss3).str);
+      cv_node_id id;
+      if (str_equal(type, STR_CONST(.part))) {
+        id = cv_net_add_view(&ret.net, width);
+        cv_net_view_seg(&ret.net, id, 0, base, width);
+      } else if (str_equal(type, STR_CONST(.part/pv))) {
+        uint32_t vwidth = atoi(str_scanner_nexttoken(&ss3).str);
+        id = cv_net_add_view(&ret.net, vwidth);
+        uint32_t in = base < vwidth ? (vwidth - base < width ? vwidth - base : width) : 0;
+        cv_net_view_fill(&ret.net, id, base < vwidth ? base : vwidth, CV_BIT_Z);
+        cv_net_view_seg(&ret.net, id, 0, 0, in);
+        cv_net_view_fill(&ret.net, id, vwidth - (base < vwidth ? base : vwidth) - in, CV_BIT_Z);
+      } else {
+        // Indexed by another signal
+        unsupported ++;
+        id = cv_net_add(&ret.net, CV_OP_COUNT, width);
+      }
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = cursor, .n_ports = 1 }));
+    } else if (st == SIGNAL_TYPE_concat) {
+      // .concat [<w0> <w1> <w2> <w3>], i0, ...;  i0 in the low bits
+      uint32_t widths[CV_NODE_MAX_IN] = {0}, total = 0;
+      for (uint32_t k = 0;;) {
+        str w = str_scanner_nexttoken(&ss3);
+        if (w.len == 0) break;
+        bool end = memchr(w.str, ']', w.len) != NULL;
+        if (str_front(w) == '[') {
+          w.str ++;
+          w.len --;
+        }
+        if (w.len && isdigit(str_front(w)) && k < CV_NODE_MAX_IN) {
+          widths[k] = atoi(w.str);
+          total += widths[k ++];
+        }
+        if (end) break;
+      }
+      cv_node_id id = cv_net_add_view(&ret.net, total);
+      for (uint32_t k = 0; k < CV_NODE_MAX_IN; k ++) cv_net_view_seg(&ret.net, id, k, 0, widths[k]);
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = line_start + ss3.cursor }));
+    } else if (st == SIGNAL_TYPE_repeat) {
+      // .repeat <width>, <count>, a;
+      uint32_t width = atoi(str_scanner_nexttoken(&ss3).str);
+      uint32_t count = atoi(str_scanner_nexttoken(&ss3).str);
+      cv_node_id id = cv_net_add_view(&ret.net, width);
+      uint32_t each = count ? width / count : 0;
+      for (uint32_t k = 0; k < count; k ++) cv_net_view_seg(&ret.net, id, 0, 0, each);
+      cv_net_view_fill(&ret.net, id, width - each * count, CV_BIT_X);
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = line_start + ss3.cursor, .n_ports = 1 }));
+    } else if (st == SIGNAL_TYPE_substitute) {
+      // .substitute <width>, <base>, <sub width>, a, b;  b over a's [base +: sub width]
+      uint32_t width = atoi(str_scanner_nexttoken(&ss3).str);
+      uint32_t base = atoi(str_scanner_nexttoken(&ss3).str);
+      uint32_t swidth = atoi(str_scanner_nexttoken(&ss3).str);
+      if (base > width) base = width;
+      if (swidth > width - base) swidth = width - base;
+      cv_node_id id = cv_net_add_view(&ret.net, width);
+      cv_net_view_seg(&ret.net, id, 0, 0, base);
+      cv_net_view_seg(&ret.net, id, 1, 0, swidth);
+      cv_net_view_seg(&ret.net, id, 0, base + swidth, width - base - swidth);
+      crena_hm_put(ret.labels, ident, id);
+      crena_da_push(pending, ((pending_inputs){ .node = id, .cursor = line_start + ss3.cursor, .n_ports = 2 }));
+    } else if (st == SIGNAL_TYPE_array) {
+      // .array[/s|/2u|/2s|/i] "name", <first> <last>, <msb> <lsb>;  words live in cvmem,
+      // not the netlist. Net arrays (no width), real, string and /port are not there yet
+      varnet_type vt = get_varnet_type(type);
+      str name = str_scanner_nexttoken(&ss3);
+      str_scanner_skipuntil(&ss3, ',');
+      str_scanner_skipnext(&ss3);
+      int64_t first = atoll(str_scanner_nexttoken(&ss3).str);
+      int64_t last = atoll(str_scanner_nexttoken(&ss3).str);
+      str smsb = str_scanner_nexttoken(&ss3);
+      str slsb = str_scanner_nexttoken(&ss3);
+      bool four_state = vt == VARNET_TYPE_NONE || vt == VARNET_TYPE_s;
+      if ((vt == VARNET_TYPE_NONE && !str_equal(type, STR_CONST(.array))) || vt == VARNET_TYPE_real ||
+          vt == VARNET_TYPE_str || slsb.len == 0) {
+        unsupported ++;
+        continue;
+      }
+      int msb = atoi(smsb.str), lsb = atoi(slsb.str);
+      cv_mem mem;
+      if (!cv_mem_init(&mem, (msb > lsb ? msb - lsb : lsb - msb) + 1, first, last,
+                       four_state ? CV_BIT_X : CV_BIT_0, CV_MEM_AUTO, arena)) {
+        unsupported ++;
+        continue;
+      }
+      char* cname = crena_alloc(arena, name.len + 1);
+      memcpy(cname, name.str, name.len);
+      cname[name.len] = 0;
+      crena_da_push(ret.array_names, cname);
+      crena_hm_put(ret.arrays, ident, cv_vthreads_mem(&ret.threads, &mem));
+    } else if (st == SIGNAL_TYPE_event) {
+      // .event <edge>, nets...;  .event/or events...;  .event "name";
+      uint32_t event = cv_vthreads_event(&ret.threads);
+      crena_hm_put(ret.events, ident, event);
+      if (str_equal(type, STR_CONST(.event/or))) {
+        crena_da_push(pending_events, ((pending_event){ .event = event, .is_or = true, .cursor = line_start + ss3.cursor }));
+        continue;
+      }
+      str kind = str_scanner_nexttoken(&ss3);
+      if (str_back(kind) != ',') continue;
+      kind.len --;
+      size_t e = 0;
+      while (e < sizeof(EVENT_EDGES) / sizeof(EVENT_EDGES[0]) && !str_equal(kind, EVENT_EDGES[e].name)) e ++;
+      if (e == sizeof(EVENT_EDGES) / sizeof(EVENT_EDGES[0])) {
+        unsupported ++;
+        continue;
+      }
+      crena_da_push(pending_events, ((pending_event){ .event = event, .edge = EVENT_EDGES[e].edge, .cursor = line_start + ss3.cursor }));
+    }
+  }
+
+  // Stage 4: connect inputs, either labels or C4<...> constants
+  size_t unresolved = 0;
+  for (size_t i = 0; i < crena_da_len(pending); i ++) {
+    str_scanner in_scan = str_scanner_init(bytecode);
+    in_scan.cursor = pending[i].cursor;
+    uint32_t n_ports = pending[i].n_ports ? pending[i].n_ports : CV_NODE_MAX_IN;
+    for (uint32_t port = 0; port < n_ports; port ++) {
+      str input = str_scanner_nexttoken(&in_scan);
+      if (input.len == 0) break;
+      char end = str_back(input);
+      if (end == ',' || end == ';') input.len --;
+
+      label_entry* src = crena_hm_get(ret.labels, input);
+      cv_node_id src_id = src ? src->value : CV_NODE_NONE;
+      if (!src && str_startswith(input, STR_CONST(C4<)) && str_back(input) == '>') {
+        size_t digits = input.len - 4;
+        src_id = cv_net_add(&ret.net, CV_OP_CONST, digits);
+        cv_vec4_set_str(&cv_net_node(&ret.net, src_id)->value, input.str + 3, digits);
+        crena_hm_put(ret.labels, input, src_id);
+      }
+      if (src_id == CV_NODE_NONE) unresolved ++;
+      cv_net_connect(&ret.net, pending[i].node, port, src_id);
+
+      if (end == ';') break;
+    }
+  }
+
+  // Edge events watch their nets, or events pass triggers on
+  for (size_t i = 0; i < crena_da_len(pending_events); i ++) {
+    str_scanner in_scan = str_scanner_init(bytecode);
+    in_scan.cursor = pending_events[i].cursor;
+    for (;;) {
+      str input = str_scanner_nexttoken(&in_scan);
+      if (input.len == 0) break;
+      char end = str_back(input);
+      if (end == ',' || end == ';') input.len --;
+      label_entry* src = crena_hm_get(pending_events[i].is_or ? ret.events : ret.labels, input);
+      if (!src) unresolved ++;
+      else if (pending_events[i].is_or) cv_vthreads_event_or(&ret.threads, pending_events[i].event, src->value);
+      else cv_net_watch(&ret.net, src->value, pending_events[i].edge, pending_events[i].event);
+      if (end == ';') break;
+    }
+  }
+
+  for (size_t i = 0; i < crena_da_len(ret.varnets); i ++) {
+    signal_type_varnet* vn = &ret.varnets[i];
+    printf("Found a %s: %.*s [%d:%d]\n", cv_net_node(&ret.net, vn->driver)->op == CV_OP_NET ? "net" : "var",
+           STR_PF(vn->name), vn->msb, vn->lsb);
+  }
+
+  // Stage 5: thread code, one instruction per % line, labels marking
+  // jump targets and .thread starting points
+  label_entry* code_labels;
+  crena_hm_init_fn(code_labels, arena, str_hm_hash, str_hm_eq);
+  pending_jump* jumps;
+  crena_da_init(jumps, arena);
+  str* starts;
+  crena_da_init(starts, arena);
+  size_t unsupported_ops = 0;
+
+  lines = str_scanner_init(bytecode);
+  while (str_scanner_more(lines)) {
+    str line = str_scanner_takeuntil_nextline(&lines);
+    str_scanner ss5 = str_scanner_init(line);
+    str first = str_scanner_nexttoken(&ss5);
+    if (first.len == 0) continue;
+    uint32_t pc = (uint32_t)crena_da_len(ret.threads.code);
+
+    if (str_equal(first, STR_CONST(.thread))) {
+      crena_da_push(starts, next_operand(&ss5));
+      continue;
+    }
+    if (str_front(first) != '%') {
+      str second = str_scanner_nexttoken(&ss5);
+      if (!isspace(str_front(line)) && str_equal(second, STR_CONST(;))) crena_hm_put(code_labels, first, pc);
+      continue;
+    }
+
+    if (str_back(first) == ';') first.len --;
+    cv_vti insn = { .op = cv_vti_from_name(first.str, first.len) };
+    if (str_equal(first, STR_CONST(%vpi_call))) {
+      next_operand(&ss5); // file
+      next_operand(&ss5); // line
+      insn.op = str_equal(next_operand(&ss5), STR_CONST($finish)) ? CV_VTI_FINISH : CV_VTI_NOOP;
+    }
+
+    label_entry* target;
+    switch (insn.op) {
+    case CV_VTI_PUSHI:
+      insn.a = strtoull(next_operand(&ss5).str, NULL, 0);
+      insn.b = strtoull(next_operand(&ss5).str, NULL, 0);
+      insn.width = atoi(next_operand(&ss5).str);
+      break;
+    case CV_VTI_LOAD:
+    case CV_VTI_STORE:
+      target = crena_hm_get(ret.labels, next_operand(&ss5));
+      if (!target) {
+        insn.op = CV_VTI_COUNT;
+        break;
+      }
+      insn.target = target->value;
+      // %load/vec4 <var>;  %store/vec4 <var>, <offset reg>, <wid>;
+      if (insn.op == CV_VTI_STORE) {
+        insn.b = strtoull(next_operand(&ss5).str, NULL, 0);
+        insn.width = atoi(next_operand(&ss5).str);
+        if (insn.b >= KNOB_VTHREAD_WORDS) insn.op = CV_VTI_COUNT;
+      }
+      break;
+    case CV_VTI_IXLOAD:
+      // %ix/load <reg>, <low>, <high>;
+      insn.b = strtoull(next_operand(&ss5).str, NULL, 0);
+      insn.a = strtoull(next_operand(&ss5).str, NULL, 0);
+      insn.a |= strtoull(next_operand(&ss5).str, NULL, 0) << 32;
+      if (insn.b >= KNOB_VTHREAD_WORDS) insn.op = CV_VTI_COUNT;
+      break;
+    case CV_VTI_IXVEC4:
+    case CV_VTI_IXVEC4S:
+      insn.b = strtoull(next_operand(&ss5).str, NULL, 0);
+      if (insn.b >= KNOB_VTHREAD_WORDS) insn.op = CV_VTI_COUNT;
+      break;
+    case CV_VTI_FLAGSET:
+      // %flag_set/imm <flag>, <value>;
+      insn.target = atoi(next_operand(&ss5).str);
+      insn.a = strtoull(next_operand(&ss5).str, NULL, 0);
+      if (insn.target >= 32) insn.op = CV_VTI_COUNT;
+      break;
+    case CV_VTI_LOADA:
+    case CV_VTI_STOREA:
+      // %load/vec4a <array>, <reg>;  %store/vec4a <array>, <reg>, <offset reg>;
+      target = crena_hm_get(ret.arrays, next_operand(&ss5));
+      if (!target) {
+        insn.op = CV_VTI_COUNT;
+        break;
+      }
+      insn.target = target->value;
+      insn.b = strtoull(next_operand(&ss5).str, NULL, 0);
+      if (insn.op == CV_VTI_STOREA) insn.a = strtoull(next_operand(&ss5).str, NULL, 0);
+      if (insn.b >= KNOB_VTHREAD_WORDS || insn.a >= KNOB_VTHREAD_WORDS) insn.op = CV_VTI_COUNT;
+      break;
+    case CV_VTI_DELAY:
+      insn.a = strtoull(next_operand(&ss5).str, NULL, 0);
+      insn.a |= strtoull(next_operand(&ss5).str, NULL, 0) << 32;
+      break;
+    case CV_VTI_WAIT:
+    case CV_VTI_EVENT:
+      target = crena_hm_get(ret.events, next_operand(&ss5));
+      if (target) insn.target = target->value;
+      else insn.op = CV_VTI_COUNT;
+      break;
+    case CV_VTI_JMP:
+    case CV_VTI_JMP0:
+    case CV_VTI_JMP1:
+      // %jmp <label>;  %jmp/0 <label>, <flag>;  %jmp/1 <label>, <flag>;
+      crena_da_push(jumps, ((pending_jump){ .pc = pc, .label = next_operand(&ss5) }));
+      if (insn.op != CV_VTI_JMP) insn.a = strtoull(next_operand(&ss5).str, NULL, 0);
+      if (insn.a >= 32) insn.op = CV_VTI_COUNT;
+      break;
+    default:
+      break;
+    }
+    if (insn.op == CV_VTI_COUNT) unsupported_ops ++;
+    cv_vthreads_emit(&ret.threads, insn);
+  }
+
+  for (size_t i = 0; i < crena_da_len(jumps); i ++) {
+    label_entry* target = crena_hm_get(code_labels, jumps[i].label);
+    if (target) ret.threads.code[jumps[i].pc].target = target->value;
+    else ret.threads.code[jumps[i].pc].op = CV_VTI_COUNT;
+  }
+  crena_da_init(ret.thread_starts, arena);
+  for (size_t i = 0; i < crena_da_len(starts); i ++) {
+    label_entry* target = crena_hm_get(code_labels, starts[i]);
+    if (target) crena_da_push(ret.thread_starts, target->value);
+  }
+  printf("Thread code has %zu instructions, %zu unsupported, %zu threads\n",
+         crena_da_len(ret.threads.code), unsupported_ops, crena_da_len(ret.thread_starts));
+
+  cv_net_elaborate(&ret.net);
+  printf("Netlist has %zu nodes, %zu unresolved inputs, %zu unsupported functors\n",
+         cv_net_len(&ret.net), unresolved, unsupported);
+  // CVP_JIT=<cache dir>, or empty for the default one, compiles the netlist
+  char const* jit_dir = getenv("CVP_JIT");
+  if (jit_dir) {
+    cv_jit jit;
+    if (cv_jit_compile(&jit, &ret.net, *jit_dir ? jit_dir : NULL)) {
+      printf("Netlist compiled to native code %016llx%s\n", (unsigned long long)jit.hash, jit.cached ? " (cached)" : "");
+    } else {
+      printf("Netlist stays interpreted\n");
+    }
+  }
+  cv_net_report(&ret.net, stdout);
 
   return ret;
 }
 
+// Runs the .thread blocks until $finish or until nothing is scheduled
+void run_vvp_module(vvp_module* mod, crena_arena* arena) {
+  cv_sched sched;
+  cv_sched_init(&sched, arena, mod->time_precision.precision);
+  cv_vthreads_attach(&mod->threads, &sched, &mod->net);
+  for (size_t i = 0; i < crena_da_len(mod->thread_starts); i ++) {
+    cv_vthreads_spawn(&mod->threads, mod->thread_starts[i]);
+  }
+  cv_sched_run(&sched, ~(cv_time)0);
+
+  for (size_t i = 0; i < crena_da_len(mod->varnets); i ++) {
+    signal_type_varnet* vn = &mod->varnets[i];
+    cv_vec4* v = &cv_net_node(&mod->net, vn->driver)->value;
+    char* bits = crena_alloc(arena, v->width + 1);
+    cv_vec4_to_str(v, bits);
+    printf("%.*s = %s\n", STR_PF(vn->name), bits);
+  }
+  cv_sched_report(&sched, stdout);
+  cv_vthreads_report(&mod->threads, stdout);
+  for (size_t i = 0; i < crena_da_len(mod->array_names); i ++) {
+    cv_mem_report(&mod->threads.mems[i], mod->array_names[i], stdout);
+  }
+  cv_net_report(&mod->net, stdout);
+}
+
 #ifndef UNIT_TEST
 
 int main(int argc, char** argv) {
   crena_arena parse_arena = crena_init_growing();
+  crena_stats_name(&parse_arena, "parse");
   if (argc > 1) {
     str bytecode_str = read_entire_file(argv[1], &parse_arena);
-    parse_vvp_module(bytecode_str, &parse_arena);
+    vvp_module mod = parse_vvp_module(bytecode_str, &parse_arena);
+    run_vvp_module(&mod, &parse_arena);
   }
 }
 
@@ -624,6 +1216,14 @@ int main(int argc, char** argv) {
   (void)argv;
   printf("I am unit testing now!\n");
   crena_unit_test();
+  cvsched_unit_test();
+  cvvec_unit_test();
+  cvarith_unit_test();
+  cvstrength_unit_test();
+  cvmem_unit_test();
+  cvnet_unit_test();
+  cvjit_unit_test();
+  cvthread_unit_test();
 }
 
 #endif
@@ -7,10 +7,13 @@ int main(int argc, char **argv)
 {
   NOB_GO_REBUILD_URSELF(argc, argv);
 
-  nob_cmd_append(&cmd, "cc", "-Wall", "-Wextra", "-o", "main", "main.c", "-ggdb");
+  nob_cmd_append(&cmd, "cc", "-Wall", "-Wextra", "-o", "main", "main.c", "-ggdb", "-ldl");
   if (!nob_cmd_run(&cmd)) return 1;
 
-  nob_cmd_append(&cmd, "cc", "-Wall", "-Wextra", "-o", "ut", "main.c", "-ggdb", "-DUNIT_TEST");
+  nob_cmd_append(&cmd, "cc", "-Wall", "-Wextra", "-o", "ut", "main.c", "-ggdb", "-DUNIT_TEST", "-DCRENA_STATS", "-pthread", "-ldl");
+  if (!nob_cmd_run(&cmd)) return 1;
+
+  nob_cmd_append(&cmd, "cc", "-Wall", "-Wextra", "-O2", "-o", "bench", "bench.c", "-ggdb", "-pthread");
   if (!nob_cmd_run(&cmd)) return 1;
 
   return 0;